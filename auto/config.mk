@@ -5,7 +5,7 @@ ASAN_CFLAGS=-fsanitize=address
 ASAN_LDFLAGS=-fsanitize=address
 
 # initial set of libraries, others are added by autotests
-LIBS=-lm
+LIBS=-lm -lpthread
 
 .PHONY: rieman
 
@@ -18,6 +18,10 @@ $(eval $(call pkg-test,test_cairo_lib,cairo,CAIRO))
 $(eval $(call pkg-test,test_fc_lib,fontconfig,FONTCONFIG))
 $(eval $(call pkg-test,test_ft_lib,freetype2,FREETYPE))
 
+$(eval $(call lib-test-opt,test_xcb-shm_lib,xcb-shm,$(call pcf,xcb-shm),$(call plf,xcb-shm),XCB_SHM))
+$(eval $(call lib-test-opt,test_xcb-composite_lib,xcb-composite,$(call pcf,xcb-composite),$(call plf,xcb-composite),XCB_COMPOSITE))
+$(eval $(call lib-test-opt,test_xcb-damage_lib,xcb-damage,$(call pcf,xcb-damage),$(call plf,xcb-damage),XCB_DAMAGE))
+
 result=$(if $(findstring yes,$1),$2: yes,$2: no)
 oresult=$(if $1,$2: $1)
 
@@ -0,0 +1,7 @@
+#include <xcb/composite.h>
+
+int main()
+{
+    (void) xcb_composite_name_window_pixmap(NULL, 0, 0);
+    return 0;
+}
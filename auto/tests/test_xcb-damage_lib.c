@@ -0,0 +1,7 @@
+#include <xcb/damage.h>
+
+int main()
+{
+    (void) xcb_damage_subtract(NULL, 0, 0, 0);
+    return 0;
+}
@@ -0,0 +1,7 @@
+#include <xcb/shm.h>
+
+int main()
+{
+    (void) xcb_shm_query_version(NULL);
+    return 0;
+}
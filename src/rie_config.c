@@ -58,6 +58,7 @@ static int rie_conf_init_defaults(rie_conf_item_t *cf, void *ctx);
 static int rie_conf_handle_key(char *key, char*arg,
     rie_conf_item_t *cf, void *ctx);
 static int rie_conf_parse(char *filename, rie_conf_item_t *spec, void *ctx);
+static int rie_conf_item_equal(rie_conf_item_t *spec, void *ctx, void *newctx);
 
 
 rie_conf_type_parse_pt rie_conf_type_parser[] = {
@@ -659,10 +660,12 @@ rie_conf_cleanup(rie_conf_meta_t *meta, void *ctx)
     void   *res;
     rie_conf_item_t  *spec;
 
+    /*
+     * 'initialized' flags are shared by all contexts loaded with the same
+     * spec, and may describe another context; contexts are zeroed before
+     * loading, so any string found is owned by this one
+     */
     for (spec = meta->spec; spec->name; spec++) {
-        if (!spec->initialized) {
-            continue;
-        }
 
         if (spec->type == RIE_CTYPE_STR && spec->convert == NULL) {
             /* converters free source string by themselves */
@@ -677,7 +680,68 @@ rie_conf_cleanup(rie_conf_meta_t *meta, void *ctx)
                 *conf_key = NULL;
             }
         }
+    }
+}
 
-        spec->initialized = 0;
+
+/*
+ * compares two contexts loaded with the same spec and returns
+ * reload flags of all keys that have different values
+ */
+uint32_t
+rie_conf_diff(rie_conf_meta_t *meta, void *ctx, void *newctx)
+{
+    uint32_t          changes;
+    rie_conf_item_t  *spec;
+
+    changes = 0;
+
+    for (spec = meta->spec; spec->name; spec++) {
+        if (rie_conf_item_equal(spec, ctx, newctx)) {
+            continue;
+        }
+
+        rie_debug("key \"%s\" changed", spec->name);
+
+        changes |= spec->reload;
     }
+
+    return changes;
+}
+
+
+static int
+rie_conf_item_equal(rie_conf_item_t *spec, void *ctx, void *newctx)
+{
+    char  *s1, *s2;
+    void  *v1, *v2;
+
+    v1 = (char *) ctx + spec->offset;
+    v2 = (char *) newctx + spec->offset;
+
+    if (spec->convert) {
+        /* variants are stored as numbers */
+        return *(uint32_t *) v1 == *(uint32_t *) v2;
+    }
+
+    switch (spec->type) {
+    case RIE_CTYPE_STR:
+        s1 = *(char **) v1;
+        s2 = *(char **) v2;
+
+        if (s1 == NULL || s2 == NULL) {
+            return s1 == s2;
+        }
+
+        return strcmp(s1, s2) == 0;
+
+    case RIE_CTYPE_BOOL:     /* bool is stored as uint32 */
+    case RIE_CTYPE_UINT32:
+        return *(uint32_t *) v1 == *(uint32_t *) v2;
+
+    case RIE_CTYPE_DBL:
+        return *(double *) v1 == *(double *) v2;
+    }
+
+    return 0;
 }
@@ -59,6 +59,7 @@ struct rie_conf_item_s {
         void              *ptr;
         uint32_t           u32;
     } data;
+    uint32_t               reload;  /* what to rebuild if value changes */
     int                    initialized;
 };
 
@@ -87,5 +88,6 @@ int rie_locate_skin(char (*found)[FILENAME_MAX], char *fname);
 
 int rie_conf_load(char *conf_file, rie_conf_meta_t *meta, void *ctx);
 void rie_conf_cleanup(rie_conf_meta_t *meta, void *ctx);
+uint32_t rie_conf_diff(rie_conf_meta_t *meta, void *ctx, void *newctx);
 
 #endif
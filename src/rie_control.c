@@ -39,6 +39,8 @@ struct rie_control_s {
     struct sockaddr_un   sa;
     char                *path;
     void                *data; /* context for pager */
+    rie_loop_t          *loop;
+    rie_loop_source_t   *src;  /* socket in event loop */
 };
 
 typedef struct {
@@ -61,8 +63,11 @@ static rie_cmd_desc_t  rie_control_messages[] = {
 };
 
 
+static int rie_control_handle_socket_event(void *data, uint32_t arg);
+
+
 rie_control_t *
-rie_control_new(rie_settings_t *cfg, void *data)
+rie_control_new(rie_settings_t *cfg, rie_loop_t *loop, void *data)
 {
     int             rc;
     size_t          len;
@@ -82,7 +87,7 @@ rie_control_new(rie_settings_t *cfg, void *data)
     rie_memzero(ctl, sizeof(struct rie_control_s));
 
     ctl->data = data;
-    ctl->path = cfg->control_socket_path;
+    ctl->loop = loop;
 
     ctl->fd = socket(AF_UNIX, SOCK_DGRAM, 0);
     if (ctl->fd == -1) {
@@ -99,7 +104,10 @@ rie_control_new(rie_settings_t *cfg, void *data)
     }
 
     ctl->sa.sun_family = AF_UNIX;
-    strcpy(ctl->sa.sun_path, ctl->path);
+    strcpy(ctl->sa.sun_path, cfg->control_socket_path);
+
+    /* own copy, settings may be replaced on reload */
+    ctl->path = ctl->sa.sun_path;
 
     (void) unlink(ctl->path);
 
@@ -112,6 +120,14 @@ rie_control_new(rie_settings_t *cfg, void *data)
         return NULL;
     }
 
+    ctl->src = rie_loop_add_fd(loop, ctl->fd, rie_control_handle_socket_event,
+                               ctl);
+    if (ctl->src == NULL) {
+        (void) close(ctl->fd);
+        free(ctl);
+        return NULL;
+    }
+
     rie_log("listening for user commands at '%s'", ctl->path);
 
     return ctl;
@@ -166,16 +182,11 @@ rie_control_send_message(char *sockpath, char *msg)
 }
 
 
-int
-rie_control_get_fd(rie_control_t *ctl)
+static int
+rie_control_handle_socket_event(void *data, uint32_t arg)
 {
-    return ctl ? ctl->fd : -1;
-}
-
+    rie_control_t  *ctl = data;
 
-int
-rie_control_handle_socket_event(rie_control_t *ctl)
-{
     int              found;
     ssize_t          n;
     rie_cmd_desc_t  *cmd;
@@ -224,6 +235,8 @@ rie_control_delete(rie_control_t *ctl, int final)
         return;
     }
 
+    rie_loop_remove(ctl->loop, ctl->src);
+
     if (ctl->fd != -1) {
         (void) close(ctl->fd);
     }
@@ -22,14 +22,11 @@
 #ifndef __RIE_CONTROL_H__
 #define __RIE_CONTROL_H__
 
-rie_control_t *rie_control_new(rie_settings_t *cfg, void *data);
+rie_control_t *rie_control_new(rie_settings_t *cfg, rie_loop_t *loop,
+    void *data);
 
 void rie_control_delete(rie_control_t *ctl, int final);
 
-int rie_control_get_fd(rie_control_t *ctl);
-
-int rie_control_handle_socket_event(rie_control_t *ctl);
-
 int rie_control_send_message(char *sockpath, char *msg);
 
 #endif
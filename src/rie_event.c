@@ -21,16 +21,22 @@
 
 #include "rieman.h"
 #include "rie_event.h"
+#include "rie_config.h"
 #include "rie_xcb.h"
 #include "rie_gfx.h"
 #include "rie_render.h"
-#include "rie_external.h"
+#include "rie_thumb.h"
 
-#include <sys/select.h>
 
 
 #define RIE_PAGER_EVENT  0x2
 
+/* maximum number of queued events coalesced at once */
+#define RIE_EVENT_BATCH  256
+
+/* msec; editors save files in several steps, reload when they settle */
+#define RIE_EVENT_RELOAD_DELAY  250
+
 
 typedef int (*rie_event_handler_pt)(rie_t *pager, xcb_generic_event_t *ev);
 
@@ -41,8 +47,34 @@ typedef struct {
     uint8_t                loggable;
 } rie_event_t;
 
-
-static int rie_event_wait(rie_t *pager, sigset_t *sigmask);
+/* events with same key supersede each other, only the latest is handled */
+typedef struct {
+    uint8_t                type;
+    uint8_t                synthetic;   /* sent by client, not by server */
+    uint32_t               window;
+    uint32_t               atom;
+} rie_event_key_t;
+
+
+static int rie_event_xcb_process(void *data, uint32_t arg);
+static int rie_event_signal(void *data, uint32_t signo);
+static int rie_event_init_timers(rie_t *pager);
+static void rie_event_move_state(rie_t *pager, rie_t *oldpager);
+static void rie_event_reload_thumbs(rie_t *pager);
+static int rie_event_reload_timer(void *data, uint32_t arg);
+static int rie_event_files_changed(void *data, uint32_t what);
+static void rie_event_watch_files(rie_t *pager);
+static int rie_event_watch_path(rie_loop_source_t *watcher, char *path,
+    int entry, uint32_t what);
+static void rie_event_frame_render(rie_t *pager, uint64_t now);
+static int rie_event_frame_schedule(rie_t *pager);
+static int rie_event_frame_timer(void *data, uint32_t arg);
+static int rie_event_thumb_timer(void *data, uint32_t arg);
+static size_t rie_event_collect(rie_t *pager, xcb_generic_event_t **batch,
+    size_t size);
+static int rie_event_key(xcb_generic_event_t *ev, rie_event_key_t *key);
+static int rie_event_dispatch(rie_t *pager, xcb_generic_event_t **batch,
+    size_t n);
 static uint32_t rie_event_mask(rie_t *pager, xcb_generic_event_t *ev);
 static int rie_event_handle_pager_event(rie_t *pager, xcb_generic_event_t *ev);
 static void rie_event_reload(rie_t **ppager);
@@ -52,7 +84,10 @@ static int rie_event_xcb_leave_notify(rie_t *pager, xcb_generic_event_t *ev);
 static int rie_event_xcb_motion_notify(rie_t *pager, xcb_generic_event_t *ev);
 static int rie_event_xcb_button_release(rie_t *pager, xcb_generic_event_t *ev);
 static int rie_event_xcb_configure_notify(rie_t *pager, xcb_generic_event_t *ev);
+static int rie_event_xcb_reparent_notify(rie_t *pager, xcb_generic_event_t *ev);
 static int rie_event_xcb_destroy_notify(rie_t *pager, xcb_generic_event_t *ev);
+static int rie_event_xcb_map_notify(rie_t *pager, xcb_generic_event_t *ev);
+static int rie_event_xcb_unmap_notify(rie_t *pager, xcb_generic_event_t *ev);
 static int rie_event_xcb_property_notify(rie_t *pager, xcb_generic_event_t *ev);
 static int rie_event_xcb_randr_notify(rie_t *pager, xcb_generic_event_t *ev);
 static int rie_event_number_of_desktops(rie_t *pager, xcb_generic_event_t *ev);
@@ -63,6 +98,10 @@ static int rie_event_desktop_geometry(rie_t *pager, xcb_generic_event_t *ev);
 static int rie_event_wm_state(rie_t *pager, xcb_generic_event_t *ev);
 static int rie_event_wm_window_type(rie_t *pager, xcb_generic_event_t *ev);
 static int rie_event_wm_desktop(rie_t *pager, xcb_generic_event_t *ev);
+static int rie_event_wm_name(rie_t *pager, xcb_generic_event_t *ev);
+static int rie_event_wm_class(rie_t *pager, xcb_generic_event_t *ev);
+static int rie_event_wm_icon(rie_t *pager, xcb_generic_event_t *ev);
+static int rie_event_frame_extents(rie_t *pager, xcb_generic_event_t *ev);
 static int rie_event_xrootpmap_id(rie_t *pager,  xcb_generic_event_t *ev);
 static int rie_event_active_window(rie_t *pager, xcb_generic_event_t *ev);
 static int rie_event_workarea(rie_t *pager, xcb_generic_event_t *ev);
@@ -78,7 +117,10 @@ rie_event_t rie_event_handlers[] = {
     { named(XCB_MOTION_NOTIFY),    rie_event_xcb_motion_notify,    0 },
     { named(XCB_BUTTON_RELEASE),   rie_event_xcb_button_release,   1 },
     { named(XCB_CONFIGURE_NOTIFY), rie_event_xcb_configure_notify, 1 },
+    { named(XCB_REPARENT_NOTIFY),  rie_event_xcb_reparent_notify,  0 },
     { named(XCB_DESTROY_NOTIFY),   rie_event_xcb_destroy_notify,   0 },
+    { named(XCB_MAP_NOTIFY),       rie_event_xcb_map_notify,       0 },
+    { named(XCB_UNMAP_NOTIFY),     rie_event_xcb_unmap_notify,     0 },
     { named(XCB_PROPERTY_NOTIFY),  rie_event_xcb_property_notify,  0 },
 };
 
@@ -95,6 +137,10 @@ rie_event_t rie_property_event_handlers[] ={
     { named(RIE_NET_WM_STATE),             rie_event_wm_state,           1 },
     { named(RIE_NET_WM_WINDOW_TYPE),       rie_event_wm_window_type,     1 },
     { named(RIE_NET_WM_DESKTOP),           rie_event_wm_desktop,         1 },
+    { named(RIE_NET_WM_NAME),              rie_event_wm_name,            0 },
+    { named(RIE_WM_CLASS),                 rie_event_wm_class,           1 },
+    { named(RIE_NET_WM_ICON),              rie_event_wm_icon,            1 },
+    { named(RIE_NET_FRAME_EXTENTS),        rie_event_frame_extents,      1 },
     { named(RIE_XROOTPMAP_ID),             rie_event_xrootpmap_id,       1 },
     { named(RIE_NET_ACTIVE_WINDOW),        rie_event_active_window,      1 },
     { named(RIE_NET_WORKAREA),             rie_event_workarea,           1 },
@@ -103,10 +149,10 @@ rie_event_t rie_property_event_handlers[] ={
 };
 
 
-extern uint8_t  rie_quit;
-extern uint8_t  rie_reload;
-
-
+/*
+ * queries X server state; skin is not used here, as it may still be
+ * loaded by another thread at startup
+ */
 int
 rie_event_init(rie_t *pager)
 {
@@ -121,7 +167,6 @@ rie_event_init(rie_t *pager)
         rie_event_desktop_names,
         rie_event_current_desktop,
         rie_event_client_list,
-        rie_event_xrootpmap_id,
         NULL
     };
 
@@ -129,6 +174,15 @@ rie_event_init(rie_t *pager)
         rie_event_xcb_randr_notify(pager, NULL);
     }
 
+    rie_thumb_init(pager);
+
+    if (rie_event_init_timers(pager) != RIE_OK) {
+        return RIE_ERROR;
+    }
+
+    /* layout is not yet known, icons are fetched for configured size */
+    pager->icon_size = rie_render_icon_size(pager);
+
     /* trigger fake events to populate initial settings */
     for (i = 0; init_handlers[i]; i++) {
         if (init_handlers[i](pager, NULL) != RIE_OK) {
@@ -136,19 +190,190 @@ rie_event_init(rie_t *pager)
         }
     }
 
+    return RIE_OK;
+}
+
+
+/* the rest of initialization that needs skin to be loaded */
+int
+rie_event_start(rie_t *pager)
+{
+    /* skin defines if root background is needed */
+    if (rie_event_xrootpmap_id(pager, NULL) != RIE_OK) {
+        return RIE_ERROR;
+    }
+
+    pager->frame_time = rie_loop_msec();
+
     /* initial render with window positioning and resize */
     return rie_render(pager);
 }
 
 
+/*
+ * takes over everything known about X server state from the pager being
+ * replaced, so that nothing has to be queried again; only state that
+ * depends on changed settings is refreshed
+ */
+int
+rie_event_transplant(rie_t *pager, rie_t *oldpager)
+{
+    uint32_t  changes;
+
+    changes = rie_conf_diff(&pager->cfg->meta, oldpager->cfg, pager->cfg);
+
+    if (changes & RIE_RELOAD_THUMBS) {
+        rie_thumb_init(pager);
+
+    } else {
+        pager->thumbnails = oldpager->thumbnails;
+    }
+
+    if (rie_event_init_timers(pager) != RIE_OK) {
+        return RIE_ERROR;
+    }
+
+    rie_event_move_state(pager, oldpager);
+
+    /* old pager is left empty, errors below are only logged */
+
+    if (pager->cfg->subset.enabled && (changes & RIE_RELOAD_SUBSET)) {
+        (void) rie_event_xcb_randr_notify(pager, NULL);
+    }
+
+    if (changes & RIE_RELOAD_THUMBS) {
+        rie_event_reload_thumbs(pager);
+    }
+
+    if (changes & (RIE_RELOAD_SKIN | RIE_RELOAD_ROOT)) {
+        /* new skin may show root background in another way */
+        (void) rie_event_xrootpmap_id(pager, NULL);
+    }
+
+    if (changes & RIE_RELOAD_HINTS) {
+        (void) rie_xcb_set_window_hints(pager->xcb, pager->cfg,
+                                        pager->current_desktop);
+    }
+
+    /* new gfx context needs window size */
+    pager->resize = 1;
+
+    rie_event_frame_render(pager, rie_loop_msec());
+
+    return RIE_OK;
+}
+
+
+static int
+rie_event_init_timers(rie_t *pager)
+{
+    if (pager->frame_timer == NULL) {
+        pager->frame_timer = rie_loop_add_timer(pager->loop,
+                                                rie_event_frame_timer, pager);
+        if (pager->frame_timer == NULL) {
+            return RIE_ERROR;
+        }
+    }
+
+    if (pager->thumbnails && pager->thumb_timer == NULL) {
+        pager->thumb_timer = rie_loop_add_timer(pager->loop,
+                                                rie_event_thumb_timer, pager);
+        if (pager->thumb_timer == NULL) {
+            return RIE_ERROR;
+        }
+    }
+
+    return RIE_OK;
+}
+
+
+static void
+rie_event_move_state(rie_t *pager, rie_t *oldpager)
+{
+    pager->windows = oldpager->windows;
+    pager->windex = oldpager->windex;
+    pager->fwindow = oldpager->fwindow;
+    pager->active_window = oldpager->active_window;
+    pager->icon_size = oldpager->icon_size;
+
+    pager->desktops = oldpager->desktops;
+    pager->desktop_names = oldpager->desktop_names;
+    pager->workareas = oldpager->workareas;
+    pager->viewports = oldpager->viewports;
+    pager->virtual_roots = oldpager->virtual_roots;
+    pager->current_desktop = oldpager->current_desktop;
+
+    pager->desktop_geom = oldpager->desktop_geom;
+    pager->monitor_geom = oldpager->monitor_geom;
+
+    pager->root_bg = oldpager->root_bg;
+    pager->root_bg_scaled = oldpager->root_bg_scaled;
+
+    pager->exposed = oldpager->exposed;
+    pager->thumb_due = oldpager->thumb_due;
+    pager->current_tile_mode = oldpager->current_tile_mode;
+
+    /* arrays are emptied, so cleanup of old pager has nothing to free */
+    rie_memzero(&oldpager->windows, sizeof(rie_array_t));
+    rie_memzero(&oldpager->windex, sizeof(rie_array_t));
+    rie_memzero(&oldpager->desktops, sizeof(rie_array_t));
+    rie_memzero(&oldpager->desktop_names, sizeof(rie_array_t));
+    rie_memzero(&oldpager->workareas, sizeof(rie_array_t));
+    rie_memzero(&oldpager->viewports, sizeof(rie_array_t));
+    rie_memzero(&oldpager->virtual_roots, sizeof(rie_array_t));
+
+    oldpager->fwindow = NULL;
+    oldpager->root_bg.tx = NULL;
+}
+
+
+static void
+rie_event_reload_thumbs(rie_t *pager)
+{
+    size_t         i;
+    rie_window_t  *win;
+
+    win = pager->windows.data;
+
+    for (i = 0; i < pager->windows.nitems; i++) {
+
+        if (win[i].dead) {
+            continue;
+        }
+
+        if (pager->thumbnails) {
+            rie_thumb_start(pager, &win[i]);
+
+        } else {
+            rie_thumb_stop(pager, &win[i], 1);
+        }
+    }
+}
+
+
 void
 rie_event_cleanup(rie_t *pager)
 {
+    size_t         i;
+    rie_window_t  *win;
+
     if (pager->windows.data) {
+
+        win = pager->windows.data;
+
+        /* windows stay redirected, next configuration may use them */
+        for (i = 0; i < pager->windows.nitems; i++) {
+            rie_thumb_stop(pager, &win[i], 0);
+        }
+
         rie_array_wipe(&pager->windows);
         pager->fwindow = NULL;
     }
 
+    if (pager->windex.data) {
+        rie_array_wipe(&pager->windex);
+    }
+
     rie_array_wipe(&pager->desktops);
     rie_array_wipe(&pager->vdesktops);
     rie_array_wipe(&pager->desktop_names);
@@ -157,147 +382,409 @@ rie_event_cleanup(rie_t *pager)
     rie_array_wipe(&pager->viewports);
     rie_array_wipe(&pager->virtual_roots);
 
+    rie_render_root_reset(pager);
+
     if (pager->root_bg.tx) {
         rie_gfx_surface_free(pager->root_bg.tx);
         pager->root_bg.tx = NULL;
     }
+
+    if (pager->frame_timer) {
+        rie_loop_remove(pager->loop, pager->frame_timer);
+        pager->frame_timer = NULL;
+    }
+
+    if (pager->thumb_timer) {
+        rie_loop_remove(pager->loop, pager->thumb_timer);
+        pager->thumb_timer = NULL;
+    }
+}
+
+
+int
+rie_event_loop(rie_t *pager, sigset_t *sigmask)
+{
+    rie_loop_t  *loop;
+
+    loop = pager->loop;
+
+    /*
+     * these sources live across reloads and refer to the current pager,
+     * which is replaced by rie_event_reload()
+     */
+
+    if (rie_loop_add_fd(loop, rie_xcb_get_fd(pager->xcb),
+                        rie_event_xcb_process, &pager) == NULL)
+    {
+        goto done;
+    }
+
+    /* replies may leave events queued without making socket readable */
+    if (rie_loop_add_idle(loop, rie_event_xcb_process, &pager) == NULL) {
+        goto done;
+    }
+
+    if (rie_loop_add_signals(loop, sigmask, rie_event_signal, &pager)
+        == NULL)
+    {
+        goto done;
+    }
+
+    pager->reload_timer = rie_loop_add_timer(loop, rie_event_reload_timer,
+                                             &pager);
+    if (pager->reload_timer == NULL) {
+        goto done;
+    }
+
+    pager->watcher = rie_loop_add_files(loop, rie_event_files_changed, &pager);
+    if (pager->watcher == NULL) {
+        rie_log("WARNING: configuration files changes are not tracked");
+
+    } else {
+        rie_event_watch_files(pager);
+    }
+
+    (void) rie_loop_run(loop);
+
+done:
+
+    rie_log("rieman ver. %s (%s) exiting...", RIEMAN_VERSION, RIE_REV);
+
+    rie_pager_delete(pager, 1);
+
+    return EXIT_SUCCESS;
 }
 
 
-/* interruptable event wait; multiplex xcb events and control socket */
+/* handles all events available from X server */
 static int
-rie_event_wait(rie_t *pager, sigset_t *sigmask)
+rie_event_xcb_process(void *data, uint32_t arg)
 {
-    int     xcb_fd, rc, err, ctl_sock, max;
-    fd_set  fds;
+    rie_t  *pager = *(rie_t **) data;
 
-    xcb_fd = rie_xcb_get_fd(pager->xcb);
-    ctl_sock = rie_control_get_fd(pager->ctl);
+    size_t                n;
+    xcb_generic_event_t  *batch[RIE_EVENT_BATCH];
 
-    while (1) {
+    if (rie_xcb_event_is_error(pager->xcb)) {
+        return RIE_ERROR;
+    }
 
-        FD_ZERO(&fds);
-        FD_SET(xcb_fd, &fds);
-        if (ctl_sock != -1) {
-            FD_SET(ctl_sock, &fds);
-            max = ctl_sock > xcb_fd ? ctl_sock : xcb_fd;
+    while ((n = rie_event_collect(pager, batch, RIE_EVENT_BATCH))) {
 
-        } else {
-            max = xcb_fd;
+        if (rie_event_dispatch(pager, batch, n) != RIE_OK) {
+            return RIE_ERROR;
         }
+    }
 
-        rc = pselect(max + 1, &fds, NULL, NULL, NULL, sigmask);
+    if (pager->render) {
+        /* also picks up changes made by control commands */
+        return rie_event_frame_schedule(pager);
+    }
 
-        err = errno;
+    return RIE_OK;
+}
 
-        if (rc > 0) {
 
-            if (ctl_sock != -1 && FD_ISSET(ctl_sock, &fds)) {
-                return rie_control_handle_socket_event(pager->ctl);
-            }
+static int
+rie_event_signal(void *data, uint32_t signo)
+{
+    rie_t  *pager = *(rie_t **) data;
 
-            /* else: xcb event */
+    switch (signo) {
+    case SIGTERM:
+    case SIGINT:   /* CTRL-C */
+        rie_log(" *** terminate signal received ***");
+        rie_pager_run_cmd(pager, RIE_CMD_EXIT);
+        break;
 
-            if (rie_xcb_event_is_error(pager->xcb)) {
-                return RIE_ERROR;
-            }
+    case SIGUSR1:
+        rie_log(" *** reload signal received ***");
+        rie_pager_run_cmd(pager, RIE_CMD_RELOAD);
+        break;
 
-            return RIE_OK;
-        }
+    default:
+        /* should never happen */
+        break;
+    }
 
-        if (rc == 0) {
-            /* should never happen since no timeout */
-            continue;
-        }
+    return RIE_OK;
+}
 
-        if (err == EINTR) {
-            return RIE_OK;
-        }
 
-        rie_log_error0(errno, "pselect()");
+static int
+rie_event_reload_timer(void *data, uint32_t arg)
+{
+    rie_event_reload((rie_t **) data);
+
+    return RIE_OK;
+}
+
+
+/* repeated changes only postpone reload, so it is done once */
+static int
+rie_event_files_changed(void *data, uint32_t what)
+{
+    rie_t  *pager = *(rie_t **) data;
+
+    rie_debug("configuration files changed: 0x%x", what);
+
+    pager->reload_pending |= what;
+
+    return rie_loop_timer_set(pager->reload_timer, RIE_EVENT_RELOAD_DELAY);
+}
+
+
+/* skin may be changed by reload, so watches are set again each time */
+static void
+rie_event_watch_files(rie_t *pager)
+{
+    char  skin_conf[FILENAME_MAX];
+
+    if (pager->watcher == NULL) {
+        return;
+    }
+
+    rie_loop_unwatch_all(pager->watcher);
 
+    /* errors are logged, reload is still available by signal or command */
+
+    (void) rie_event_watch_path(pager->watcher, pager->cfg->meta.conf_file,
+                                1, RIE_CONF_MAIN);
+
+    if (rie_locate_skin(&skin_conf, pager->cfg->skin) == RIE_OK) {
+        /* any skin file may be changed, not only configuration */
+        (void) rie_event_watch_path(pager->watcher, skin_conf, 0,
+                                    RIE_CONF_SKIN);
+    }
+}
+
+
+/* watches directory of the file, either for the file only or any entry */
+static int
+rie_event_watch_path(rie_loop_source_t *watcher, char *path, int entry,
+    uint32_t what)
+{
+    char  *name;
+    char   dir[FILENAME_MAX];
+
+    if (strlen(path) >= FILENAME_MAX) {
+        rie_log_error(0, "path \"%s\" is too long", path);
         return RIE_ERROR;
     }
 
-    /* unreachable */
+    strcpy(dir, path);
+
+    name = strrchr(dir, '/');
+    if (name == NULL) {
+        return rie_loop_watch(watcher, ".", entry ? path : NULL, what);
+    }
+
+    *name++ = 0;
+
+    return rie_loop_watch(watcher, dir[0] ? dir : "/", entry ? name : NULL,
+                          what);
+}
+
+
+static void
+rie_event_frame_render(rie_t *pager, uint64_t now)
+{
+    /* render errors are ignored in hope they are not permanent */
+    (void) rie_render(pager);
+
+    pager->render = 0;
+    pager->frame_time = now;
+}
+
+
+/*
+ * renders at most once per frame interval: the first change after idle
+ * is shown immediately, while changes arriving within the interval only
+ * leave pager dirty and are shown when the frame timer expires
+ */
+static int
+rie_event_frame_schedule(rie_t *pager)
+{
+    uint64_t  now, interval, elapsed;
+
+    if (rie_loop_timer_armed(pager->frame_timer)) {
+        /* pending frame will pick up the latest state */
+        return RIE_OK;
+    }
+
+    now = rie_loop_msec();
+
+    interval = pager->cfg->fps ? 1000 / pager->cfg->fps : 0;
+    elapsed = now - pager->frame_time;
+
+    if (elapsed >= interval) {
+        rie_event_frame_render(pager, now);
+        return RIE_OK;
+    }
+
+    return rie_loop_timer_set(pager->frame_timer, interval - elapsed);
+}
+
+
+static int
+rie_event_frame_timer(void *data, uint32_t arg)
+{
+    rie_t  *pager = data;
+
+    if (pager->render) {
+        rie_event_frame_render(pager, rie_loop_msec());
+    }
+
     return RIE_OK;
 }
 
 
-int
-rie_event_loop(rie_t *pager, sigset_t *sigmask)
+/* some damaged windows were throttled and may be updated now */
+static int
+rie_event_thumb_timer(void *data, uint32_t arg)
 {
-    int       rc;
-    uint32_t  mask;
+    rie_t  *pager = data;
 
-    xcb_generic_event_t  *ev;
+    pager->render = 1;
 
-    do {
+    return rie_event_frame_schedule(pager);
+}
 
-        while ((ev = rie_xcb_next_event(pager->xcb))) {
-            rc = RIE_OK;
 
-            rie_debug("event: #%d", rie_xcb_event_type(ev));
+/*
+ * reads next event and drains everything already queued after it;
+ * superseded events (i.e. intermediate ConfigureNotify during window move)
+ * are dropped, so that only the latest one of each kind is handled
+ */
+static size_t
+rie_event_collect(rie_t *pager, xcb_generic_event_t **batch, size_t size)
+{
+    size_t                i, n;
+    rie_event_key_t       key, keys[RIE_EVENT_BATCH];
+    xcb_generic_event_t  *ev;
+
+    ev = rie_xcb_next_event(pager->xcb);
+    if (ev == NULL) {
+        return 0;
+    }
 
-            mask = rie_event_mask(pager, ev);
+    n = 0;
 
-            if (mask & RIE_PAGER_EVENT) {
-                if (rie_event_handle_pager_event(pager, ev) != RIE_OK) {
-                    rc = RIE_ERROR;
+    do {
+        if (rie_event_key(ev, &key)) {
+
+            for (i = 0; i < n; i++) {
+                if (batch[i]
+                    && keys[i].type == key.type
+                    && keys[i].synthetic == key.synthetic
+                    && keys[i].window == key.window
+                    && keys[i].atom == key.atom)
+                {
+                    free(batch[i]);
+                    batch[i] = NULL;
+                    break;
                 }
             }
 
-            if (rc != RIE_OK) {
+        } else {
+            key.type = 0;
+        }
 
-#if defined (RIE_DEBUG)
-                rie_debug("leaving event loop during processing event %d "
-                          "due to error, backtrace of the last one is below",
-                          rie_xcb_event_type(ev));
-                rie_log_backtrace();
-#endif
-                free(ev);
-                goto done;
-            }
+        keys[n] = key;
+        batch[n++] = ev;
 
-            free(ev);
+    } while (n < size && (ev = rie_xcb_next_queued_event(pager->xcb)));
 
-            if (pager->render) {
-                /* render errors are ignored in hope they are not permanent */
-                (void) rie_render(pager);
-                pager->render = 0;
-            }
-        }
+    return n;
+}
 
-        if (rie_event_wait(pager, sigmask) != RIE_OK) {
-            goto done;
-        }
 
-        /* handle received signals */
+static int
+rie_event_key(xcb_generic_event_t *ev, rie_event_key_t *key)
+{
+    key->type = rie_xcb_event_type(ev);
+    key->synthetic = (ev->response_type & 0x80) ? 1 : 0;
+    key->window = 0;
+    key->atom = 0;
 
-        if (rie_quit) {
-            rie_quit = 0;
+    switch (key->type) {
 
-            rie_log(" *** terminate signal received ***");
-            break;
-        }
+    case XCB_CONFIGURE_NOTIFY:
+        /*
+         * synthetic event has root coordinates of the frame, and real one
+         * is relative to parent: both are needed to track position
+         */
+        key->window = ((xcb_configure_notify_event_t *) ev)->window;
+        return 1;
+
+    case XCB_PROPERTY_NOTIFY:
+        key->window = ((xcb_property_notify_event_t *) ev)->window;
+        key->atom = ((xcb_property_notify_event_t *) ev)->atom;
+        return 1;
+
+    case XCB_MOTION_NOTIFY:
+        key->window = ((xcb_motion_notify_event_t *) ev)->event;
+        return 1;
+
+    default:
+        /*
+         * order matters: enter/leave, buttons, destroy...
+         * each expose carries its own rectangle, none can be dropped
+         */
+        return 0;
+    }
+}
+
+
+static int
+rie_event_dispatch(rie_t *pager, xcb_generic_event_t **batch, size_t n)
+{
+    int                   rc;
+    size_t                i;
+    uint32_t              mask;
+    xcb_generic_event_t  *ev;
+
+    rc = RIE_OK;
+
+    for (i = 0; i < n; i++) {
 
-        if (rie_reload) {
-            rie_reload = 0;
+        ev = batch[i];
 
-            rie_log(" *** reload signal received ***");
-            rie_event_reload(&pager);
+        if (ev == NULL) {
+            /* superseded by later event */
+            continue;
         }
 
-    } while (1);
+        if (rc != RIE_OK) {
+            /* error occured, just release the rest */
+            free(ev);
+            continue;
+        }
 
-done:
+        rie_debug("event: #%d", rie_xcb_event_type(ev));
 
-    rie_log("rieman ver. %s (%s) exiting...", RIEMAN_VERSION, RIE_REV);
+        mask = rie_event_mask(pager, ev);
 
-    rie_pager_delete(pager, 1);
+        if (mask & RIE_PAGER_EVENT) {
+            if (rie_event_handle_pager_event(pager, ev) != RIE_OK) {
+                rc = RIE_ERROR;
+            }
+        }
 
-    return EXIT_SUCCESS;
+        if (rc != RIE_OK) {
 
+#if defined (RIE_DEBUG)
+            rie_debug("leaving event loop during processing event %d "
+                      "due to error, backtrace of the last one is below",
+                      rie_xcb_event_type(ev));
+            rie_log_backtrace();
+#endif
+        }
+
+        free(ev);
+    }
+
+    return rc;
 }
 
 
@@ -311,9 +798,10 @@ rie_event_mask(rie_t *pager, xcb_generic_event_t *ev)
 static int
 rie_event_handle_pager_event(rie_t *pager, xcb_generic_event_t *ev)
 {
-    int      i;
-    size_t   nhandlers;
-    uint8_t  evid;
+    int           i;
+    size_t        nhandlers;
+    uint8_t       evid;
+    xcb_window_t  win;
 
     nhandlers = sizeof(rie_event_handlers) / sizeof(rie_event_handlers[0]);
 
@@ -327,6 +815,11 @@ rie_event_handle_pager_event(rie_t *pager, xcb_generic_event_t *ev)
         }
     }
 
+    if (rie_xcb_damage_notify(pager->xcb, ev, &win)) {
+        rie_thumb_damaged(pager, win);
+        return RIE_OK;
+    }
+
     if (!pager->cfg->subset.enabled) {
         goto done;
     }
@@ -359,20 +852,52 @@ done:
 static void
 rie_event_reload(rie_t **ppager)
 {
-    rie_t  *newpager, *oldpager;
+    int              rc;
+    rie_t           *newpager, *oldpager;
+    uint32_t         what, force;
+    rie_settings_t  *cfg;
 
     oldpager = *ppager;
+    newpager = NULL;
+    cfg = NULL;
 
-    newpager = rie_pager_new(oldpager->cfg->meta.conf_file, oldpager->log);
-    if (newpager == NULL) {
+    what = oldpager->reload_pending;
+    oldpager->reload_pending = 0;
+
+    if (what & RIE_CONF_MAIN) {
+        cfg = rie_settings_new(oldpager->cfg->meta.conf_file);
+        if (cfg == NULL) {
+            goto failed;
+        }
+    }
+
+    force = (what & RIE_CONF_SKIN) ? RIE_RELOAD_SKIN : RIE_RELOAD_NONE;
+
+    rc = rie_pager_reconfigure(oldpager, cfg, force);
+
+    if (rc == RIE_OK) {
+        rie_log("configuration reloaded in place");
+        rie_event_watch_files(oldpager);
+        (void) rie_event_frame_schedule(oldpager);
+        return;
+    }
+
+    if (rc == RIE_ERROR) {
+        if (cfg) {
+            rie_settings_delete(cfg);
+        }
         goto failed;
     }
 
-    if (rie_pager_init(newpager, oldpager) != RIE_OK) {
+    /* new pager is created, known windows and desktops are moved to it */
+
+    newpager = rie_pager_new(cfg, oldpager->log);
+    if (newpager == NULL) {
+        rie_settings_delete(cfg);
         goto failed;
     }
 
-    if (rie_event_init(newpager) != RIE_OK) {
+    if (rie_pager_init(newpager, oldpager) != RIE_OK) {
         goto failed;
     }
 
@@ -380,6 +905,8 @@ rie_event_reload(rie_t **ppager)
 
     *ppager = newpager;
 
+    rie_event_watch_files(newpager);
+
     return;
 
 failed:
@@ -395,14 +922,33 @@ failed:
 static int
 rie_event_xcb_expose(rie_t *pager, xcb_generic_event_t *ev)
 {
+    rie_rect_t           box;
     xcb_expose_event_t  *expose = (xcb_expose_event_t *) ev;
 
+    box.x = expose->x;
+    box.y = expose->y;
+    box.w = expose->width;
+    box.h = expose->height;
+
+    /* last rendered frame is kept in back buffer, just copy it */
+    if (pager->exposed && rie_gfx_expose(pager->gfx, &box) == RIE_OK) {
+
+        if (expose->count == 0) {
+            rie_xcb_flush(pager->xcb);
+        }
+
+        return RIE_OK;
+    }
+
     /* Avoid extra redraws by checking if this is
      * the last expose event in the sequence
      */
     if (expose->count == 0) {
         pager->render = 1;
 
+        /* exposed contents must be redrawn, even if unchanged */
+        rie_gfx_invalidate(pager->gfx);
+
         if (!pager->exposed) {
             /* resize after first expose event */
             pager->resize = 1;
@@ -605,9 +1151,12 @@ rie_event_xcb_button_release(rie_t *pager, xcb_generic_event_t *ev)
 static int
 rie_event_xcb_configure_notify(rie_t *pager, xcb_generic_event_t *ev)
 {
-    xcb_configure_request_event_t *xce = (xcb_configure_request_event_t *) ev;
+    xcb_configure_notify_event_t *xce = (xcb_configure_notify_event_t *) ev;
 
     int            rc;
+    uint8_t        synthetic;
+    uint32_t       w, h;
+    rie_rect_t     box;
     rie_window_t  *win;
     xcb_window_t   root;
 
@@ -619,11 +1168,24 @@ rie_event_xcb_configure_notify(rie_t *pager, xcb_generic_event_t *ev)
     }
 
     win = rie_window_lookup(pager, xce->window);
-    if (win == NULL) {
+    if (win == NULL || win->dead) {
         return RIE_OK;
     }
 
-    rc = rie_window_query(pager, win, xce->window);
+    /* only position and size may change, event carries both */
+
+    box.x = xce->x;
+    box.y = xce->y;
+    box.w = xce->width;
+    box.h = xce->height;
+
+    synthetic = (xce->response_type & 0x80) ? 1 : 0;
+
+    w = win->box.w;
+    h = win->box.h;
+
+    rc = rie_window_update_position(pager, win, &box, xce->border_width,
+                                    synthetic);
     if (rc == RIE_ERROR) {
         return RIE_ERROR;
     }
@@ -632,6 +1194,10 @@ rie_event_xcb_configure_notify(rie_t *pager, xcb_generic_event_t *ev)
         /* we failed to obtain information about this window, ignore it */
         win->dead = 1;
         win->desktop = 0;
+
+    } else if (win->box.w != w || win->box.h != h) {
+        /* resized window has new storage for contents */
+        rie_thumb_contents(pager, win);
     }
 
     pager->render = 1;
@@ -640,6 +1206,24 @@ rie_event_xcb_configure_notify(rie_t *pager, xcb_generic_event_t *ev)
 }
 
 
+static int
+rie_event_xcb_reparent_notify(rie_t *pager, xcb_generic_event_t *ev)
+{
+    xcb_reparent_notify_event_t *rn = (xcb_reparent_notify_event_t *) ev;
+
+    rie_window_t  *win;
+
+    win = rie_window_lookup(pager, rn->window);
+
+    if (win) {
+        /* new parent position will be queried on next move */
+        win->parent_known = 0;
+    }
+
+    return RIE_OK;
+}
+
+
 static int
 rie_event_xcb_destroy_notify(rie_t *pager, xcb_generic_event_t *ev)
 {
@@ -660,6 +1244,48 @@ rie_event_xcb_destroy_notify(rie_t *pager, xcb_generic_event_t *ev)
 }
 
 
+static int
+rie_event_xcb_map_notify(rie_t *pager, xcb_generic_event_t *ev)
+{
+    xcb_map_notify_event_t *mn = (xcb_map_notify_event_t *) ev;
+
+    rie_window_t  *win;
+
+    /* frames and subwindows of clients are not known */
+    win = rie_window_lookup(pager, mn->window);
+    if (win == NULL || win->dead) {
+        return RIE_OK;
+    }
+
+    win->viewable = 1;
+
+    rie_thumb_contents(pager, win);
+
+    return RIE_OK;
+}
+
+
+static int
+rie_event_xcb_unmap_notify(rie_t *pager, xcb_generic_event_t *ev)
+{
+    xcb_unmap_notify_event_t *un = (xcb_unmap_notify_event_t *) ev;
+
+    rie_window_t  *win;
+
+    win = rie_window_lookup(pager, un->window);
+    if (win == NULL || win->dead) {
+        return RIE_OK;
+    }
+
+    win->viewable = 0;
+
+    /* last snapshot is shown until window is mapped again */
+    rie_thumb_contents(pager, win);
+
+    return RIE_OK;
+}
+
+
 static int
 rie_event_xcb_property_notify(rie_t *pager, xcb_generic_event_t *ev)
 {
@@ -872,10 +1498,7 @@ rie_event_current_desktop(rie_t *pager, xcb_generic_event_t *ev)
 static int
 rie_event_client_list(rie_t *pager, xcb_generic_event_t *ev)
 {
-    int  rc, screen, i;
-
-    rie_array_t     winlist;
-    rie_window_t   *win;
+    int  rc, screen;
 
     xcb_generic_error_t           *err;
     xcb_ewmh_connection_t         *ec;
@@ -896,54 +1519,19 @@ rie_event_client_list(rie_t *pager, xcb_generic_event_t *ev)
         return RIE_OK;
     }
 
-    rc = rie_window_init_list(&winlist, clients.windows_len);
+    rc = rie_window_update_list(pager, clients.windows, clients.windows_len);
+
+    xcb_ewmh_get_windows_reply_wipe(&clients);
 
     if (rc != RIE_OK) {
-        xcb_ewmh_get_windows_reply_wipe(&clients);
         return RIE_ERROR;
     }
 
-    win = (rie_window_t *) winlist.data;
-
-    for (i = 0; i < clients.windows_len; i++) {
-        rc = rie_window_query(pager, &win[i], clients.windows[i]);
-
-        if (rc == RIE_ERROR) {
-            rie_array_wipe(&winlist);
-            xcb_ewmh_get_windows_reply_wipe(&clients);
-            return RIE_ERROR;
-        }
-
-        if (rc == RIE_NOTFOUND) {
-            /* we failed to obtain information about this window, ignore it */
-            win[i].dead = 1;
-            win[i].desktop = 0;
-            continue;
-        }
-
-        rc = rie_xcb_get_window_state(pager->xcb, &win[i], clients.windows[i]);
-
-        if (rc == RIE_ERROR) {
-            rie_array_wipe(&winlist);
-            xcb_ewmh_get_windows_reply_wipe(&clients);
-            return RIE_ERROR;
-        }
-    }
-
-    if (pager->windows.data != NULL) {
-        rie_array_wipe(&pager->windows);
-        pager->fwindow = NULL;
-    }
-
-    pager->windows = winlist;
-
     /* trigger NET_ACTIVE_WINDOW lookup - it does not change with client list */
     (void) rie_event_active_window(pager, ev);
     /* focused window inside pager also needs to be updated */
     rie_window_update_pager_focus(pager);
 
-    xcb_ewmh_get_windows_reply_wipe(&clients);
-
     pager->render = 1;
     return RIE_OK;
 }
@@ -952,8 +1540,9 @@ rie_event_client_list(rie_t *pager, xcb_generic_event_t *ev)
 static int
 rie_event_desktop_geometry(rie_t *pager, xcb_generic_event_t *ev)
 {
-    int       rc, screen;
-    uint32_t  w, h;
+    int         screen;
+    uint32_t    w, h;
+    rie_rect_t  root_geom;
 
     xcb_generic_error_t        *err;
     xcb_ewmh_connection_t      *ec;
@@ -968,10 +1557,11 @@ rie_event_desktop_geometry(rie_t *pager, xcb_generic_event_t *ev)
         /* may fail if NET_DESKTOP_GEOMETRY is not set */
         rie_xcb_handle_error0(err, "xcb_ewmh_get_desktop_geometry");
 
-        rc = rie_external_get_desktop_geometry(&w, &h);
-        if (rc != RIE_OK) {
-            return rc;
-        }
+        /* screen size, kept up to date on RandR changes of root window */
+        root_geom = rie_xcb_root_geom(pager->xcb);
+
+        w = root_geom.w;
+        h = root_geom.h;
     }
 
     pager->desktop_geom.w = w;
@@ -1071,15 +1661,110 @@ rie_event_wm_desktop(rie_t *pager, xcb_generic_event_t *ev)
 }
 
 
+static int
+rie_event_wm_name(rie_t *pager, xcb_generic_event_t *ev)
+{
+    xcb_property_notify_event_t *xpe = (xcb_property_notify_event_t *) ev;
+
+    int            rc;
+    rie_window_t  *win;
+
+    win = rie_window_lookup(pager, xpe->window);
+    if (win == NULL || win->dead) {
+        return RIE_OK;
+    }
+
+    rc = rie_window_update_title(pager, win);
+    if (rc == RIE_ERROR) {
+        return RIE_ERROR;
+    }
+
+    pager->render = 1;
+
+    return RIE_OK;
+}
+
+
+static int
+rie_event_wm_class(rie_t *pager, xcb_generic_event_t *ev)
+{
+    xcb_property_notify_event_t *xpe = (xcb_property_notify_event_t *) ev;
+
+    int            rc;
+    rie_window_t  *win;
+
+    win = rie_window_lookup(pager, xpe->window);
+    if (win == NULL || win->dead) {
+        return RIE_OK;
+    }
+
+    rc = rie_window_update_name(pager, win);
+    if (rc == RIE_ERROR) {
+        return RIE_ERROR;
+    }
+
+    pager->render = 1;
+
+    return RIE_OK;
+}
+
+
+static int
+rie_event_wm_icon(rie_t *pager, xcb_generic_event_t *ev)
+{
+    xcb_property_notify_event_t *xpe = (xcb_property_notify_event_t *) ev;
+
+    int            rc;
+    rie_window_t  *win;
+
+    win = rie_window_lookup(pager, xpe->window);
+    if (win == NULL || win->dead) {
+        return RIE_OK;
+    }
+
+    rc = rie_window_update_icon(pager, win);
+    if (rc == RIE_ERROR) {
+        return RIE_ERROR;
+    }
+
+    pager->render = 1;
+
+    return RIE_OK;
+}
+
+
+static int
+rie_event_frame_extents(rie_t *pager, xcb_generic_event_t *ev)
+{
+    xcb_property_notify_event_t *xpe = (xcb_property_notify_event_t *) ev;
+
+    int            rc;
+    rie_window_t  *win;
+
+    win = rie_window_lookup(pager, xpe->window);
+    if (win == NULL || win->dead) {
+        return RIE_OK;
+    }
+
+    rc = rie_xcb_get_window_frame(pager->xcb, xpe->window, &win->frame);
+    if (rc == RIE_ERROR) {
+        return RIE_ERROR;
+    }
+
+    pager->render = 1;
+
+    return RIE_OK;
+}
+
+
 static int
 rie_event_xrootpmap_id(rie_t *pager, xcb_generic_event_t *ev)
 {
     int  rc;
 
-    rc = rie_xcb_get_root_pixmap(pager->xcb, pager->gfx, &pager->root_bg);
+    rc = rie_render_root_background(pager);
     if (rc == RIE_ERROR) {
         /* do not fail hardly if there is not root window */
-        pager->root_bg.tx = NULL;
         rie_log("WARNING: can't get root window pixmap,"
                 " continuing with color background");
 
@@ -1095,7 +1780,7 @@ rie_event_xrootpmap_id(rie_t *pager, xcb_generic_event_t *ev)
 static int
 rie_event_active_window(rie_t *pager, xcb_generic_event_t *ev)
 {
-    int       rc, i;
+    int       rc;
     uint32_t  focused;
 
     rie_window_t  *win;
@@ -1112,18 +1797,20 @@ rie_event_active_window(rie_t *pager, xcb_generic_event_t *ev)
         return RIE_OK;
     }
 
-    win = pager->windows.data;
-
     /* only single window can be focused */
-    for (i = 0; i < pager->windows.nitems; i++) {
-        if (win[i].winid == focused) {
-            win[i].focused = 1;
 
-        } else {
-            win[i].focused = 0;
-        }
+    win = rie_window_lookup(pager, pager->active_window);
+    if (win) {
+        win->focused = 0;
     }
 
+    win = rie_window_lookup(pager, focused);
+    if (win) {
+        win->focused = 1;
+    }
+
+    pager->active_window = focused;
+
     rie_window_update_pager_focus(pager);
 
     pager->render = 1;
@@ -27,6 +27,8 @@
 #include <signal.h>
 
 int rie_event_init(rie_t *pager);
+int rie_event_start(rie_t *pager);
+int rie_event_transplant(rie_t *pager, rie_t *oldpager);
 void rie_event_cleanup(rie_t *pager);
 int rie_event_loop(rie_t *pager, sigset_t *sigmask);
 
@@ -27,9 +27,21 @@
 #include <cairo/cairo-ft.h>
 
 
+typedef struct rie_font_face_s  rie_font_face_t;
+
+/* loaded face, shared by all skins which ask for the same font */
+struct rie_font_face_s {
+    char               *name;       /* as specified in skin */
+    cairo_font_face_t  *ff;         /* referenced */
+    uint32_t            users;      /* skin fonts referring to the face */
+    rie_font_face_t    *next;
+};
+
+/* lives as long as the process, reloads reuse it */
 struct rie_font_ctx_s {
-    FcConfig        *fontconf;
-    FT_Library       ft_library;
+    FcConfig          *fontconf;
+    FT_Library         ft_library;
+    rie_font_face_t   *faces;
 };
 
 
@@ -44,6 +56,8 @@ rie_font_ctx_new()
         return NULL;
     }
 
+    rie_memzero(font_ctx, sizeof(rie_font_ctx_t));
+
     font_ctx->fontconf = FcInitLoadConfigAndFonts();
     if (font_ctx->fontconf == NULL) {
         rie_log_error0(0, "FcInitLoadConfigAndFonts() failed");
@@ -62,11 +76,50 @@ rie_font_ctx_new()
 void
 rie_font_ctx_cleanup(rie_font_ctx_t *font_ctx)
 {
+    if (font_ctx == NULL) {
+        return;
+    }
+
+    rie_font_ctx_sweep(font_ctx, 1);
+
     FcConfigDestroy(font_ctx->fontconf);
     free(font_ctx);
 }
 
 
+/*
+ * drops faces not used by any skin, or all of them; reference count of
+ * a face cannot tell this, as scaled fonts cached by cairo refer to it
+ */
+void
+rie_font_ctx_sweep(rie_font_ctx_t *font_ctx, int all)
+{
+    rie_font_face_t  *face, **prev;
+
+    if (font_ctx == NULL) {
+        return;
+    }
+
+    prev = &font_ctx->faces;
+
+    while ((face = *prev)) {
+
+        if (!all && face->users) {
+            prev = &face->next;
+            continue;
+        }
+
+        *prev = face->next;
+
+        rie_debug("font \"%s\" unloaded", face->name);
+
+        cairo_font_face_destroy(face->ff);
+        free(face->name);
+        free(face);
+    }
+}
+
+
 int
 rie_font_init(rie_font_ctx_t* font_ctx, rie_fc_t *fc)
 {
@@ -78,6 +131,16 @@ rie_font_init(rie_font_ctx_t* font_ctx, rie_fc_t *fc)
 
     cairo_status_t      cs;
     cairo_font_face_t  *ff;
+    rie_font_face_t    *face;
+
+    for (face = font_ctx->faces; face; face = face->next) {
+        if (strcmp(face->name, fc->face) == 0) {
+            rie_debug("font \"%s\" is already loaded", fc->face);
+            fc->font = (rie_font_t *) cairo_font_face_reference(face->ff);
+            face->users++;
+            return RIE_OK;
+        }
+    }
 
     pat = FcNameParse((const FcChar8*)(fc->face));
     if (pat == NULL) {
@@ -139,12 +202,46 @@ rie_font_init(rie_font_ctx_t* font_ctx, rie_fc_t *fc)
 
     fc->font = (rie_font_t *) ff;
 
+    face = malloc(sizeof(rie_font_face_t));
+    if (face == NULL) {
+        rie_log_error0(errno, "malloc()");
+        /* still usable, just not shared */
+        return RIE_OK;
+    }
+
+    face->name = strdup(fc->face);
+    if (face->name == NULL) {
+        rie_log_error0(errno, "strdup()");
+        free(face);
+        return RIE_OK;
+    }
+
+    face->ff = cairo_font_face_reference(ff);
+    face->users = 1;
+
+    face->next = font_ctx->faces;
+    font_ctx->faces = face;
+
     return RIE_OK;
 }
 
 
 void
-rie_font_cleanup(rie_font_t *font)
+rie_font_cleanup(rie_font_ctx_t *font_ctx, rie_fc_t *fc)
 {
-    cairo_font_face_destroy((cairo_font_face_t*)font);
+    rie_font_face_t  *face;
+
+    if (fc->font == NULL) {
+        return;
+    }
+
+    for (face = font_ctx->faces; face; face = face->next) {
+        if (face->ff == (cairo_font_face_t *) fc->font) {
+            face->users--;
+            break;
+        }
+    }
+
+    cairo_font_face_destroy((cairo_font_face_t *) fc->font);
+    fc->font = NULL;
 }
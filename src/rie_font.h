@@ -37,7 +37,8 @@ typedef struct {
 
 rie_font_ctx_t *rie_font_ctx_new();
 void rie_font_ctx_cleanup(rie_font_ctx_t *font_ctx);
+void rie_font_ctx_sweep(rie_font_ctx_t *font_ctx, int all);
 int rie_font_init(rie_font_ctx_t* font_ctx, rie_fc_t *fc);
-void rie_font_cleanup(rie_font_t *font);
+void rie_font_cleanup(rie_font_ctx_t *font_ctx, rie_fc_t *fc);
 
 #endif
@@ -39,6 +39,8 @@ typedef struct {
 
 typedef struct rie_clip_s  rie_clip_t;
 
+typedef void (*rie_gfx_release_pt)(void *data);
+
 struct rie_clip_s {
     rie_rect_t     *box;
     rie_clip_t     *parent;
@@ -64,14 +66,23 @@ void rie_gfx_resize(rie_gfx_t *gc, int w, int h);
 
 void rie_gfx_render_start(rie_gfx_t *gc);
 void rie_gfx_render_done(rie_gfx_t *gc);
+void rie_gfx_invalidate(rie_gfx_t *gc);
+rie_rect_t rie_gfx_repainted(rie_gfx_t *gc);
+int rie_gfx_expose(rie_gfx_t *gc, rie_rect_t *box);
+
+int rie_gfx_layer_begin(rie_gfx_t *gc, int w, int h);
+rie_surface_t *rie_gfx_layer_end(rie_gfx_t *gc);
 
 int rie_gfx_render_patch(rie_gfx_t *gc, rie_texture_t *tspec, rie_rect_t *dst,
     rie_rect_t *src, rie_clip_t *clip);
 int rie_gfx_render_texture(rie_gfx_t *gc, rie_texture_t *tspec, rie_rect_t *dst,
     rie_clip_t *clip);
+int rie_gfx_render_surface(rie_gfx_t *gc, rie_surface_t *surface,
+    rie_rect_t *dst, rie_clip_t *clip);
 int rie_gfx_draw_text(rie_gfx_t *gc, rie_fc_t *fc, char *text, rie_rect_t *box,
     rie_clip_t *clip);
 rie_rect_t rie_gfx_text_bounding_box(rie_gfx_t *gc, rie_fc_t *fc, char *text);
+size_t rie_gfx_text_cached(rie_gfx_t *gc);
 
 rie_surface_t *rie_gfx_surface_from_png(char *filename, int *w, int *h);
 rie_surface_t *rie_gfx_surface_from_clip(rie_surface_t *surface, int x, int y,
@@ -80,9 +91,24 @@ rie_surface_t *rie_gfx_surface_from_icon(rie_gfx_t *gc, void *data,
     int w, int h);
 rie_surface_t *rie_gfx_surface_from_zpixmap(rie_gfx_t *gc, uint32_t *data,
     int w, int h);
+rie_surface_t *rie_gfx_surface_from_data(void *data, int w, int h,
+    rie_gfx_release_pt release);
+rie_surface_t *rie_gfx_surface_from_drawable(rie_xcb_t *xcb, uint32_t drawable,
+    uint32_t visual, int w, int h);
+int rie_gfx_surface_on_release(rie_surface_t *surface, void *data,
+    rie_gfx_release_pt release);
+rie_surface_t *rie_gfx_surface_scale(rie_surface_t *surface, int w, int h,
+    double alpha);
+rie_surface_t *rie_gfx_surface_scale_box(rie_surface_t *surface,
+    rie_rect_t *src, int w, int h, double alpha);
+rie_surface_t *rie_gfx_surface_scale_for(rie_gfx_t *gc,
+    rie_surface_t *surface, rie_rect_t *src, int w, int h);
+rie_surface_t *rie_gfx_surface_ref(rie_surface_t *surface);
+unsigned int rie_gfx_surface_refcount(rie_surface_t *surface);
 void rie_gfx_surface_free(rie_surface_t *surface);
 
 rie_pattern_t *rie_gfx_pattern_from_surface(rie_surface_t *surface);
+rie_pattern_t *rie_gfx_pattern_ref(rie_pattern_t *pat);
 void rie_gfx_pattern_free(rie_pattern_t *pat);
 
 #endif
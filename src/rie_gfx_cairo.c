@@ -30,277 +30,1384 @@
 
 #define CS(x) ((cairo_surface_t*) (x))
 
+#define RIE_GFX_LIST_MIN  64
+
+/* power of two */
+#define RIE_GFX_TEXT_BUCKETS  64
+
+/* entries not used in current frame are dropped above this */
+#define RIE_GFX_TEXT_MAX      256
+
+
+typedef struct rie_gfx_text_s  rie_gfx_text_t;
+
+/*
+ * string shaped with some font: glyphs are positioned relative to the
+ * origin, and are valid while the scaled font is alive
+ */
+struct rie_gfx_text_s {
+    uint64_t               hash;
+    rie_font_t            *font;
+    int                    points;
+    char                  *text;
+    cairo_scaled_font_t   *sfont;     /* referenced */
+    cairo_glyph_t         *glyphs;
+    int                    nglyphs;
+    cairo_text_extents_t   te;
+    uintptr_t              serial;    /* unlike address, never reused */
+    uint64_t               frame;     /* last frame the text was used in */
+    rie_gfx_text_t        *next;
+};
+
+
+typedef enum {
+    RIE_GFX_OP_PATCH,
+    RIE_GFX_OP_TEXTURE,
+    RIE_GFX_OP_SURFACE,
+    RIE_GFX_OP_TEXT
+} rie_gfx_op_type_e;
+
+
+/*
+ * recorded drawing operation: enough to replay it during the frame, and
+ * to compare with the same operation of the next frame after that
+ */
+typedef struct {
+    rie_gfx_op_type_e   type;
+    rie_rect_t          bbox;        /* affected pixels */
+    rie_rect_t          dst;
+    rie_rect_t          src;         /* if has_src */
+    rie_rect_t          clip;        /* if clipped, chain is flattened */
+    uint8_t             has_src;
+    uint8_t             clipped;
+    rie_texture_t       tspec;       /* copy, for patch/texture */
+    cairo_surface_t    *surface;     /* referenced until replayed */
+    cairo_pattern_t    *pattern;     /* referenced until replayed */
+    uintptr_t           serial;      /* identity of surface/pattern */
+    rie_fc_t           *fc;
+    rie_gfx_text_t     *run;         /* valid until end of frame */
+    double              x;           /* text origin */
+    double              y;
+} rie_gfx_op_t;
+
+
+typedef struct {
+    rie_gfx_op_t       *ops;
+    size_t              nops;
+    size_t              size;
+} rie_gfx_list_t;
+
 
 struct rie_gfx_s {
-    cairo_t          *cr;
-    cairo_surface_t  *surface;
+    cairo_t            *cr;
+    cairo_surface_t    *surface;     /* back buffer */
+    rie_xcb_t          *xcb;
+    xcb_visualtype_t   *visual;
+    uint32_t            pixmap;      /* back buffer, server side */
+    rie_rect_t          box;         /* back buffer size */
+    uint8_t             ready;       /* back buffer holds complete frame */
+    rie_gfx_list_t      lists[2];    /* current and previous frames */
+    int                 cur;
+    uint8_t             recording;
+    uint8_t             full;        /* previous frame cannot be reused */
+    rie_rect_t          repainted;   /* extents of last non-empty repaint */
+
+    cairo_t            *window_cr;   /* saved while drawing into layer */
+    uint8_t             window_recording;
+
+    rie_gfx_text_t     *texts[RIE_GFX_TEXT_BUCKETS];
+    size_t              ntexts;
+    uint64_t            frame;
 };
 
 
+static int rie_gfx_exec_patch(rie_gfx_t *gc, rie_texture_t *tspec,
+    rie_rect_t *dst, rie_rect_t *src, rie_clip_t *clip);
+static int rie_gfx_exec_texture(rie_gfx_t *gc, rie_texture_t *tspec,
+    rie_rect_t *dst, rie_clip_t *clip);
+static int rie_gfx_exec_surface(rie_gfx_t *gc, cairo_surface_t *surface,
+    rie_rect_t *dst, rie_clip_t *clip);
+static int rie_gfx_exec_text(rie_gfx_t *gc, rie_fc_t *fc, rie_gfx_text_t *run,
+    double x, double y, rie_clip_t *clip);
+static rie_gfx_text_t *rie_gfx_text_get(rie_gfx_t *gc, rie_fc_t *fc,
+    char *text);
+static void rie_gfx_text_sweep(rie_gfx_t *gc, int all);
+static void rie_gfx_exec_op(rie_gfx_t *gc, rie_gfx_op_t *op);
+static int rie_gfx_back_buffer(rie_gfx_t *gc, int w, int h);
+
+static int rie_gfx_op_bbox(rie_rect_t *dst, rie_clip_t *clip,
+    rie_rect_t *bbox, rie_rect_t *cbox);
+static int rie_gfx_op_add(rie_gfx_t *gc, rie_gfx_op_type_e type,
+    rie_rect_t *dst, rie_clip_t *clip, rie_gfx_op_t **opp);
+static int rie_gfx_op_equal(rie_gfx_op_t *a, rie_gfx_op_t *b);
+static uintptr_t rie_gfx_surface_serial(cairo_surface_t *surface);
+static uintptr_t rie_gfx_pattern_serial(cairo_pattern_t *pattern);
+static void rie_gfx_list_release(rie_gfx_list_t *list);
+static void rie_gfx_list_clear(rie_gfx_list_t *list);
+static cairo_region_t *rie_gfx_damage(rie_gfx_t *gc);
+static cairo_surface_t *rie_gfx_scale(cairo_surface_t *like,
+    cairo_surface_t *surface, rie_rect_t *src, int w, int h, double alpha);
+
+static cairo_user_data_key_t  rie_gfx_serial_key;
+static uintptr_t              rie_gfx_serial;
+
+
 rie_gfx_t *
 rie_gfx_new(rie_xcb_t *xcb)
 {
     rie_gfx_t  *gc;
 
-    xcb_window_t       win;
-    xcb_visualtype_t  *visual;
+    gc = malloc(sizeof(rie_gfx_t));
+    if (gc == NULL) {
+        rie_log_error0(errno, "malloc");
+        return NULL;
+    }
+
+    rie_memzero(gc, sizeof(rie_gfx_t));
+
+    /* nothing is drawn yet */
+    gc->full = 1;
+
+    gc->xcb = xcb;
+
+    gc->visual = rie_xcb_root_visual(xcb);
+    if (gc->visual == NULL) {
+        return NULL;
+    }
+
+    /* real size is known after pager geometry is calculated */
+    if (rie_gfx_back_buffer(gc, 1, 1) != RIE_OK) {
+        return NULL;
+    }
+
+    return gc;
+}
+
+
+/*
+ * Frames are rendered into a pixmap of window size, and copied into
+ * the window when done; exposed parts of the window are restored from
+ * it without rendering.
+ */
+static int
+rie_gfx_back_buffer(rie_gfx_t *gc, int w, int h)
+{
+    cairo_t           *cr;
+    uint32_t           pixmap;
+    cairo_status_t     cs;
+    cairo_surface_t   *surface;
     xcb_connection_t  *c;
 
-    cairo_status_t  cs;
+    pixmap = rie_xcb_create_pixmap(gc->xcb, w, h);
+    if (pixmap == 0) {
+        return RIE_ERROR;
+    }
+
+    c = rie_xcb_get_connection(gc->xcb);
+
+    surface = cairo_xcb_surface_create(c, pixmap, gc->visual, w, h);
+
+    cs = cairo_surface_status(surface);
+    if (cs != CAIRO_STATUS_SUCCESS) {
+        rie_log_str_error0(cairo_status_to_string(cs),
+                          "cairo_xcb_surface_create()");
+        rie_xcb_free_pixmap(gc->xcb, pixmap);
+        return RIE_ERROR;
+    }
+
+    cr = cairo_create(surface);
+
+    /* referenced by cairo context, no need to maintain separately */
+    cairo_surface_destroy(surface);
+
+    cs = cairo_status(cr);
+    if (cs != CAIRO_STATUS_SUCCESS) {
+        rie_log_str_error0(cairo_status_to_string(cs), "cairo_create()");
+        cairo_destroy(cr);
+        rie_xcb_free_pixmap(gc->xcb, pixmap);
+        return RIE_ERROR;
+    }
+
+    if (gc->cr) {
+        cairo_destroy(gc->cr);
+        rie_xcb_free_pixmap(gc->xcb, gc->pixmap);
+    }
+
+    gc->cr = cr;
+    gc->surface = surface;
+    gc->pixmap = pixmap;
+
+    gc->box.w = w;
+    gc->box.h = h;
+
+    /* new pixmap contents is undefined */
+    gc->ready = 0;
+    gc->full = 1;
+
+    return RIE_OK;
+}
+
+
+void
+rie_gfx_delete(rie_gfx_t *gc)
+{
+    int  i;
+
+    for (i = 0; i < 2; i++) {
+        rie_gfx_list_clear(&gc->lists[i]);
+        free(gc->lists[i].ops);
+    }
+
+    rie_gfx_text_sweep(gc, 1);
+
+    cairo_destroy(gc->cr);
+    rie_xcb_free_pixmap(gc->xcb, gc->pixmap);
+
+    free(gc);
+}
+
+
+/*
+ * Frame is recorded as a display list instead of being drawn immediately.
+ * When done, the list is compared to the previous one, and only areas
+ * touched by changed operations are repainted.
+ */
+void
+rie_gfx_render_start(rie_gfx_t *gc)
+{
+    gc->cur ^= 1;
+
+    rie_gfx_list_clear(&gc->lists[gc->cur]);
+
+    gc->recording = 1;
+}
+
+
+void
+rie_gfx_render_done(rie_gfx_t *gc)
+{
+    int                     i, n;
+    size_t                  k;
+    rie_rect_t              box;
+    rie_gfx_op_t           *op;
+    rie_gfx_list_t         *list;
+    cairo_region_t         *damage;
+    cairo_rectangle_int_t   r;
+
+    gc->recording = 0;
+
+    list = &gc->lists[gc->cur];
+
+    damage = rie_gfx_damage(gc);
+
+    if (damage && cairo_region_is_empty(damage)) {
+        /* frame is identical to the previous one */
+        goto done;
+    }
+
+    cairo_save(gc->cr);
+
+    if (damage) {
+        n = cairo_region_num_rectangles(damage);
+
+        for (i = 0; i < n; i++) {
+            cairo_region_get_rectangle(damage, i, &r);
+            cairo_rectangle(gc->cr, r.x, r.y, r.width, r.height);
+        }
+
+        cairo_clip(gc->cr);
+    }
+
+    /* back buffer is not visible, no need for intermediate group */
+
+    for (k = 0; k < list->nops; k++) {
+
+        op = &list->ops[k];
+
+        if (damage) {
+            r.x = op->bbox.x;
+            r.y = op->bbox.y;
+            r.width = op->bbox.w;
+            r.height = op->bbox.h;
+
+            if (cairo_region_contains_rectangle(damage, &r)
+                == CAIRO_REGION_OVERLAP_OUT)
+            {
+                continue;
+            }
+        }
+
+        rie_gfx_exec_op(gc, op);
+    }
+
+    cairo_restore(gc->cr);
+
+    cairo_surface_flush(gc->surface);
+
+    if (damage == NULL) {
+        gc->ready = 1;
+        gc->repainted = gc->box;
+
+        (void) rie_xcb_copy_to_window(gc->xcb, gc->pixmap, &gc->box);
+
+    } else {
+        cairo_region_get_extents(damage, &r);
+
+        gc->repainted.x = r.x;
+        gc->repainted.y = r.y;
+        gc->repainted.w = r.width;
+        gc->repainted.h = r.height;
+
+        n = cairo_region_num_rectangles(damage);
+
+        for (i = 0; i < n; i++) {
+            cairo_region_get_rectangle(damage, i, &r);
+
+            box.x = r.x;
+            box.y = r.y;
+            box.w = r.width;
+            box.h = r.height;
+
+            (void) rie_xcb_copy_to_window(gc->xcb, gc->pixmap, &box);
+        }
+    }
+
+done:
+
+    if (damage) {
+        cairo_region_destroy(damage);
+    }
+
+    /* only kept for comparison with the next frame */
+    rie_gfx_list_release(list);
+
+    gc->frame++;
+}
+
+
+/* area updated by the last frame that changed anything */
+rie_rect_t
+rie_gfx_repainted(rie_gfx_t *gc)
+{
+    return gc->repainted;
+}
+
+
+/* next frame is drawn in full */
+void
+rie_gfx_invalidate(rie_gfx_t *gc)
+{
+    gc->full = 1;
+}
+
+
+/* restores exposed part of the window, if the last frame is available */
+int
+rie_gfx_expose(rie_gfx_t *gc, rie_rect_t *box)
+{
+    if (!gc->ready) {
+        return RIE_NOTFOUND;
+    }
+
+    return rie_xcb_copy_to_window(gc->xcb, gc->pixmap, box);
+}
+
+
+/*
+ * drawing calls between layer_begin() and layer_end() go to a new offscreen
+ * surface immediately, bypassing the frame recording
+ */
+int
+rie_gfx_layer_begin(rie_gfx_t *gc, int w, int h)
+{
+    cairo_t          *cr;
+    cairo_status_t    cs;
+    cairo_surface_t  *layer;
+
+    layer = cairo_surface_create_similar(gc->surface, CAIRO_CONTENT_COLOR_ALPHA,
+                                         w, h);
+    cs = cairo_surface_status(layer);
+    if (cs != CAIRO_STATUS_SUCCESS) {
+        rie_log_str_error0(cairo_status_to_string(cs),
+                           "cairo_surface_create_similar()");
+        return RIE_ERROR;
+    }
+
+    cr = cairo_create(layer);
+
+    /* referenced by context */
+    cairo_surface_destroy(layer);
+
+    cs = cairo_status(cr);
+    if (cs != CAIRO_STATUS_SUCCESS) {
+        rie_log_str_error0(cairo_status_to_string(cs), "cairo_create()");
+        cairo_destroy(cr);
+        return RIE_ERROR;
+    }
+
+    gc->window_cr = gc->cr;
+    gc->window_recording = gc->recording;
+
+    gc->cr = cr;
+    gc->recording = 0;
+
+    return RIE_OK;
+}
+
+
+rie_surface_t *
+rie_gfx_layer_end(rie_gfx_t *gc)
+{
+    cairo_status_t    cs;
+    cairo_surface_t  *layer;
+
+    cs = cairo_status(gc->cr);
+
+    layer = cairo_surface_reference(cairo_get_target(gc->cr));
+
+    cairo_destroy(gc->cr);
+
+    gc->cr = gc->window_cr;
+    gc->recording = gc->window_recording;
+    gc->window_cr = NULL;
+
+    if (cs != CAIRO_STATUS_SUCCESS) {
+        rie_log_str_error0(cairo_status_to_string(cs), "cairo_paint()");
+        cairo_surface_destroy(layer);
+        return NULL;
+    }
+
+    cairo_surface_flush(layer);
+
+    return (rie_surface_t *) layer;
+}
+
+
+void
+rie_gfx_resize(rie_gfx_t *gc, int w, int h)
+{
+    if (w == gc->box.w && h == gc->box.h) {
+        gc->full = 1;
+        return;
+    }
+
+    /* old buffer is kept on failure, frames are just clipped */
+    (void) rie_gfx_back_buffer(gc, w, h);
+}
+
+
+/* returns union of areas changed since previous frame, NULL if everything */
+static cairo_region_t *
+rie_gfx_damage(rie_gfx_t *gc)
+{
+    size_t                  i, n;
+    rie_gfx_op_t           *op;
+    rie_gfx_list_t         *cur, *prev;
+    cairo_region_t         *damage;
+    cairo_rectangle_int_t   r;
+
+    if (gc->full) {
+        gc->full = 0;
+        return NULL;
+    }
+
+    cur = &gc->lists[gc->cur];
+    prev = &gc->lists[gc->cur ^ 1];
+
+    damage = cairo_region_create();
+    if (cairo_region_status(damage) != CAIRO_STATUS_SUCCESS) {
+        cairo_region_destroy(damage);
+        return NULL;
+    }
+
+    n = rie_max(cur->nops, prev->nops);
+
+    for (i = 0; i < n; i++) {
+
+        if (i < cur->nops && i < prev->nops
+            && rie_gfx_op_equal(&cur->ops[i], &prev->ops[i]))
+        {
+            continue;
+        }
+
+        /* both old and new placement are damaged */
+
+        if (i < prev->nops) {
+            op = &prev->ops[i];
+
+            r.x = op->bbox.x;
+            r.y = op->bbox.y;
+            r.width = op->bbox.w;
+            r.height = op->bbox.h;
+
+            cairo_region_union_rectangle(damage, &r);
+        }
+
+        if (i < cur->nops) {
+            op = &cur->ops[i];
+
+            r.x = op->bbox.x;
+            r.y = op->bbox.y;
+            r.width = op->bbox.w;
+            r.height = op->bbox.h;
+
+            cairo_region_union_rectangle(damage, &r);
+        }
+    }
+
+    if (cairo_region_status(damage) != CAIRO_STATUS_SUCCESS) {
+        cairo_region_destroy(damage);
+        return NULL;
+    }
+
+    return damage;
+}
+
+/*
+ * creates a copy of the surface scaled to w x h with alpha applied,
+ * same as rie_gfx_render_texture() does while drawing
+ */
+rie_surface_t *
+rie_gfx_surface_scale(rie_surface_t *surface, int w, int h, double alpha)
+{
+    rie_rect_t  src;
+
+    src.x = 0;
+    src.y = 0;
+    src.w = cairo_image_surface_get_width(CS(surface));
+    src.h = cairo_image_surface_get_height(CS(surface));
+
+    return rie_gfx_surface_scale_box(surface, &src, w, h, alpha);
+}
+
+
+/*
+ * same as rie_gfx_surface_scale(), for surfaces of any type with known size;
+ * result is created where the source lives, i.e. X server-side surfaces
+ * are scaled by the server
+ */
+rie_surface_t *
+rie_gfx_surface_scale_box(rie_surface_t *surface, rie_rect_t *src, int w, int h,
+    double alpha)
+{
+    return (rie_surface_t *) rie_gfx_scale(CS(surface), CS(surface), src,
+                                           w, h, alpha);
+}
+
+
+/*
+ * scaled copy is created like the back buffer, not like the source:
+ * a drawable of foreign visual may not be directly usable as a target
+ */
+rie_surface_t *
+rie_gfx_surface_scale_for(rie_gfx_t *gc, rie_surface_t *surface,
+    rie_rect_t *src, int w, int h)
+{
+    cairo_surface_t  *like;
+
+    /* no back buffer before the first frame */
+    like = gc->surface ? gc->surface : CS(surface);
+
+    return (rie_surface_t *) rie_gfx_scale(like, CS(surface), src, w, h, 1.0);
+}
+
+
+static cairo_surface_t *
+rie_gfx_scale(cairo_surface_t *like, cairo_surface_t *surface, rie_rect_t *src,
+    int w, int h, double alpha)
+{
+    cairo_t          *cr;
+    cairo_status_t    cs;
+    cairo_surface_t  *res;
+
+    res = cairo_surface_create_similar(like, CAIRO_CONTENT_COLOR_ALPHA, w, h);
+    cs = cairo_surface_status(res);
+    if (cs != CAIRO_STATUS_SUCCESS) {
+        rie_log_str_error0(cairo_status_to_string(cs),
+                           "cairo_surface_create_similar()");
+        cairo_surface_destroy(res);
+        return NULL;
+    }
+
+    cr = cairo_create(res);
+
+    cairo_scale(cr, (double) w / src->w, (double) h / src->h);
+    cairo_set_source_surface(cr, surface, 0, 0);
+    cairo_paint_with_alpha(cr, alpha);
+
+    cs = cairo_status(cr);
+
+    cairo_destroy(cr);
+
+    if (cs != CAIRO_STATUS_SUCCESS) {
+        rie_log_str_error0(cairo_status_to_string(cs), "cairo_paint()");
+        cairo_surface_destroy(res);
+        return NULL;
+    }
+
+    cairo_surface_flush(res);
+
+    return res;
+}
+
+
+rie_surface_t *
+rie_gfx_surface_ref(rie_surface_t *surface)
+{
+    return (rie_surface_t *) cairo_surface_reference(CS(surface));
+}
+
+
+unsigned int
+rie_gfx_surface_refcount(rie_surface_t *surface)
+{
+    return cairo_surface_get_reference_count(CS(surface));
+}
+
+
+void
+rie_gfx_surface_free(rie_surface_t *surface)
+{
+    cairo_surface_destroy((cairo_surface_t*)surface);
+}
+
+
+int
+rie_gfx_render_patch(rie_gfx_t *gc, rie_texture_t *tspec, rie_rect_t *dst,
+    rie_rect_t *src, rie_clip_t *clip)
+{
+    int            rc;
+    rie_gfx_op_t  *op;
+
+    if (tspec->type == RIE_TX_TYPE_NONE) {
+        return RIE_OK;
+    }
+
+    if (dst->w == 0 || dst->h == 0) {
+        /* do not try to render invisible items */
+        return RIE_OK;
+    }
+
+    if (!gc->recording) {
+        return rie_gfx_exec_patch(gc, tspec, dst, src, clip);
+    }
+
+    rc = rie_gfx_op_add(gc, RIE_GFX_OP_PATCH, dst, clip, &op);
+    if (rc != RIE_OK) {
+        /* RIE_NOTFOUND if clipped out */
+        return rc == RIE_ERROR ? RIE_ERROR : RIE_OK;
+    }
+
+    op->tspec = *tspec;
+
+    if (src) {
+        op->src = *src;
+        op->has_src = 1;
+    }
+
+    op->surface = cairo_surface_reference(CS(tspec->tx));
+    op->serial = rie_gfx_surface_serial(op->surface);
+
+    return RIE_OK;
+}
+
+
+static int
+rie_gfx_exec_patch(rie_gfx_t *gc, rie_texture_t *tspec, rie_rect_t *dst,
+    rie_rect_t *src, rie_clip_t *clip)
+{
+    rie_pattern_t  *pat;
+
+    cairo_save(gc->cr);
+
+    while (clip) {
+        cairo_rectangle(gc->cr, clip->box->x, clip->box->y,
+                                clip->box->w, clip->box->h);
+        cairo_clip(gc->cr);
+        clip = clip->parent;
+    }
+
+    if (src) {
+        /* root background, must be tiled and shifted */
+
+        pat = rie_gfx_pattern_from_surface(tspec->tx);
+        if (pat == NULL) {
+            cairo_restore(gc->cr);
+            return RIE_ERROR;
+        }
+
+        cairo_rectangle(gc->cr, dst->x, dst->y, dst->w, dst->h);
+        cairo_translate(gc->cr, -src->x, -src->y);
+
+        cairo_set_source(gc->cr, (cairo_pattern_t *) pat);
+
+        /* referenced by context */
+        rie_gfx_pattern_free(pat);
+
+    } else {
+
+        cairo_set_source_surface(gc->cr, CS(tspec->tx), dst->x, dst->y);
+
+        cairo_rectangle(gc->cr, 0, 0, dst->w, dst->h);
+    }
+
+    cairo_clip(gc->cr);
+
+    cairo_paint_with_alpha(gc->cr, tspec->alpha);
+
+    cairo_restore(gc->cr);
+
+    return RIE_OK;
+}
+
+
+int
+rie_gfx_render_texture(rie_gfx_t *gc, rie_texture_t *tspec, rie_rect_t *dst,
+    rie_clip_t *clip)
+{
+    int            rc;
+    rie_gfx_op_t  *op;
+
+    if (tspec->type == RIE_TX_TYPE_NONE) {
+        return RIE_OK;
+    }
+
+    if (dst->w == 0 || dst->h == 0) {
+        /* do not try to render invisible items */
+        return RIE_OK;
+    }
+
+    if (!gc->recording) {
+        return rie_gfx_exec_texture(gc, tspec, dst, clip);
+    }
+
+    rc = rie_gfx_op_add(gc, RIE_GFX_OP_TEXTURE, dst, clip, &op);
+    if (rc != RIE_OK) {
+        /* RIE_NOTFOUND if clipped out */
+        return rc == RIE_ERROR ? RIE_ERROR : RIE_OK;
+    }
+
+    op->tspec = *tspec;
+
+    if (tspec->type == RIE_TX_TYPE_PATTERN) {
+        op->pattern = cairo_pattern_reference((cairo_pattern_t *) tspec->pat);
+        op->serial = rie_gfx_pattern_serial(op->pattern);
+
+    } else if (tspec->type == RIE_TX_TYPE_TEXTURE) {
+        op->surface = cairo_surface_reference(CS(tspec->tx));
+        op->serial = rie_gfx_surface_serial(op->surface);
+    }
+
+    return RIE_OK;
+}
+
+
+static int
+rie_gfx_exec_texture(rie_gfx_t *gc, rie_texture_t *tspec, rie_rect_t *dst,
+    rie_clip_t *clip)
+{
+    double  dx, dy;
+
+    cairo_save(gc->cr);
+
+    while (clip) {
+        cairo_rectangle(gc->cr, clip->box->x, clip->box->y,
+                                clip->box->w, clip->box->h);
+        cairo_clip(gc->cr);
+        clip = clip->parent;
+    }
+
+    if (tspec->type == RIE_TX_TYPE_COLOR) {
+
+        rie_gfx_set_source_rgba(gc->cr, &tspec->color, tspec->alpha);
+        cairo_rectangle(gc->cr, dst->x, dst->y, dst->w, dst->h);
+        cairo_fill(gc->cr);
+
+
+    } else if (tspec->type == RIE_TX_TYPE_PATTERN) {
+        cairo_translate(gc->cr, dst->x, dst->y);
+        cairo_rectangle(gc->cr, 0, 0, dst->w, dst->h);
+
+        cairo_set_source(gc->cr, (cairo_pattern_t *) tspec->pat);
+
+        cairo_clip(gc->cr);
+        cairo_paint_with_alpha(gc->cr, tspec->alpha);
+
+    } else {
+
+        /* RIE_TX_TYPE_TEXTURE */
+
+        dx = cairo_image_surface_get_width(CS(tspec->tx));
+        dy = cairo_image_surface_get_height(CS(tspec->tx));
+
+        dx = ((double)dst->w)/dx;
+        dy = ((double)dst->h)/dy;
+
+        if (dx == 0 || dy == 0) {
+            /* cairo_scale() will reject such values and put context
+             * into an error state, preventing further drawing
+             */
+            cairo_restore(gc->cr);
+            return RIE_OK;
+        }
+
+        cairo_push_group(gc->cr);
+
+        cairo_translate(gc->cr, dst->x, dst->y);
+        cairo_rectangle(gc->cr, 0, 0, dst->w, dst->h);
+        cairo_scale(gc->cr, dx, dy);
+        cairo_set_source_surface(gc->cr, CS(tspec->tx), 0, 0);
+
+        cairo_fill(gc->cr);
+
+        cairo_pop_group_to_source(gc->cr);
+
+        cairo_paint_with_alpha(gc->cr, tspec->alpha);
+    }
+
+    cairo_restore(gc->cr);
+
+    return RIE_OK;
+}
+
+
+/* draws surface unscaled, i.e. prepared with rie_gfx_surface_scale() */
+int
+rie_gfx_render_surface(rie_gfx_t *gc, rie_surface_t *surface, rie_rect_t *dst,
+    rie_clip_t *clip)
+{
+    int            rc;
+    rie_gfx_op_t  *op;
+
+    if (!gc->recording) {
+        return rie_gfx_exec_surface(gc, CS(surface), dst, clip);
+    }
+
+    rc = rie_gfx_op_add(gc, RIE_GFX_OP_SURFACE, dst, clip, &op);
+    if (rc != RIE_OK) {
+        /* RIE_NOTFOUND if clipped out */
+        return rc == RIE_ERROR ? RIE_ERROR : RIE_OK;
+    }
+
+    op->surface = cairo_surface_reference(CS(surface));
+    op->serial = rie_gfx_surface_serial(op->surface);
+
+    return RIE_OK;
+}
+
+
+static int
+rie_gfx_exec_surface(rie_gfx_t *gc, cairo_surface_t *surface, rie_rect_t *dst,
+    rie_clip_t *clip)
+{
+    cairo_save(gc->cr);
+
+    while (clip) {
+        cairo_rectangle(gc->cr, clip->box->x, clip->box->y,
+                                clip->box->w, clip->box->h);
+        cairo_clip(gc->cr);
+        clip = clip->parent;
+    }
+
+    cairo_set_source_surface(gc->cr, surface, dst->x, dst->y);
+    cairo_rectangle(gc->cr, dst->x, dst->y, dst->w, dst->h);
+    cairo_fill(gc->cr);
+
+    cairo_restore(gc->cr);
+
+    return RIE_OK;
+}
+
+
+int
+rie_gfx_draw_text(rie_gfx_t *gc, rie_fc_t *fc, char *text, rie_rect_t *box,
+    rie_clip_t *clip)
+{
+    int              rc;
+    double           x, y;
+    rie_rect_t       ink;
+    rie_gfx_op_t    *op;
+    rie_gfx_text_t  *run;
+
+    run = rie_gfx_text_get(gc, fc, text);
+    if (run == NULL) {
+        return RIE_ERROR;
+    }
+
+    x = box->x - run->te.x_bearing;
+    y = box->y - run->te.y_bearing;
+
+    if (!gc->recording) {
+        return rie_gfx_exec_text(gc, fc, run, x, y, clip);
+    }
+
+    /* antialiasing may touch a pixel around the ink */
+    ink.x = box->x - 1;
+    ink.y = box->y - 1;
+    ink.w = run->te.width + 3;
+    ink.h = run->te.height + 3;
+
+    rc = rie_gfx_op_add(gc, RIE_GFX_OP_TEXT, &ink, clip, &op);
+    if (rc != RIE_OK) {
+        /* RIE_NOTFOUND if clipped out */
+        return rc == RIE_ERROR ? RIE_ERROR : RIE_OK;
+    }
+
+    op->fc = fc;
+    op->run = run;
+    op->serial = run->serial;
+    op->x = x;
+    op->y = y;
+
+    return RIE_OK;
+}
+
+
+static int
+rie_gfx_exec_text(rie_gfx_t *gc, rie_fc_t *fc, rie_gfx_text_t *run, double x,
+    double y, rie_clip_t *clip)
+{
+    cairo_save(gc->cr);
+
+    while (clip) {
+        cairo_rectangle(gc->cr, clip->box->x, clip->box->y,
+                                clip->box->w, clip->box->h);
+        cairo_clip(gc->cr);
+        clip = clip->parent;
+    }
+
+    cairo_set_scaled_font(gc->cr, run->sfont);
+    rie_gfx_set_source_rgba(gc->cr, &fc->color, fc->alpha);
+
+    /* glyphs are already shaped, relative to origin */
+    cairo_translate(gc->cr, x, y);
+    cairo_show_glyphs(gc->cr, run->glyphs, run->nglyphs);
+    cairo_restore(gc->cr);
+
+    return RIE_OK;
+}
+
+
+/*
+ * returns text shaped and measured with given font; the result is cached
+ * and stays valid until the end of the current frame at least
+ */
+static rie_gfx_text_t *
+rie_gfx_text_get(rie_gfx_t *gc, rie_fc_t *fc, char *text)
+{
+    char                  *p;
+    uint64_t               hash;
+    cairo_status_t         cs;
+    rie_gfx_text_t        *run, **bucket;
+    cairo_scaled_font_t   *sfont;
+
+    /* FNV-1a */
+    hash = 0xcbf29ce484222325ULL;
+
+    for (p = text; *p; p++) {
+        hash ^= (unsigned char) *p;
+        hash *= 0x100000001b3ULL;
+    }
+
+    bucket = &gc->texts[hash & (RIE_GFX_TEXT_BUCKETS - 1)];
+
+    for (run = *bucket; run; run = run->next) {
+        if (run->hash == hash && run->font == fc->font
+            && run->points == fc->points && strcmp(run->text, text) == 0)
+        {
+            run->frame = gc->frame;
+            return run;
+        }
+    }
+
+    if (gc->ntexts >= RIE_GFX_TEXT_MAX) {
+        rie_gfx_text_sweep(gc, 0);
+    }
 
-    gc = malloc(sizeof(rie_gfx_t));
-    if (gc == NULL) {
+    run = malloc(sizeof(rie_gfx_text_t));
+    if (run == NULL) {
         rie_log_error0(errno, "malloc");
         return NULL;
     }
 
-    visual = rie_xcb_root_visual(xcb);
-    if (visual == NULL) {
+    rie_memzero(run, sizeof(rie_gfx_text_t));
+
+    run->text = strdup(text);
+    if (run->text == NULL) {
+        rie_log_error0(errno, "strdup");
+        free(run);
         return NULL;
     }
 
-    c = rie_xcb_get_connection(xcb);
-    win = rie_xcb_get_window(xcb);
-
-    gc->surface = cairo_xcb_surface_create(c, win, visual, 1, 1);
+    cairo_save(gc->cr);
+    cairo_identity_matrix(gc->cr);
+    cairo_set_font_face(gc->cr, (cairo_font_face_t *) fc->font);
+    cairo_set_font_size(gc->cr, fc->points);
+    sfont = cairo_scaled_font_reference(cairo_get_scaled_font(gc->cr));
+    cairo_restore(gc->cr);
 
-    cs = cairo_surface_status(gc->surface);
+    cs = cairo_scaled_font_text_to_glyphs(sfont, 0, 0, text, -1,
+                                          &run->glyphs, &run->nglyphs,
+                                          NULL, NULL, NULL);
     if (cs != CAIRO_STATUS_SUCCESS) {
         rie_log_str_error0(cairo_status_to_string(cs),
-                          "cairo_xcb_surface_create()");
+                           "cairo_scaled_font_text_to_glyphs()");
+        cairo_scaled_font_destroy(sfont);
+        free(run->text);
+        free(run);
         return NULL;
     }
 
-    gc->cr = cairo_create(gc->surface);
+    cairo_scaled_font_glyph_extents(sfont, run->glyphs, run->nglyphs,
+                                    &run->te);
 
-    cs = cairo_status(gc->cr);
-    if (cs != CAIRO_STATUS_SUCCESS) {
-        rie_log_str_error0(cairo_status_to_string(cs), "cairo_create()");
-        return NULL;
-    }
+    run->hash = hash;
+    run->font = fc->font;
+    run->points = fc->points;
+    run->sfont = sfont;
+    run->serial = ++rie_gfx_serial;
+    run->frame = gc->frame;
 
-    /* referenced by cairo context, no need to maintain separately */
-    cairo_surface_destroy(gc->surface);
+    run->next = *bucket;
+    *bucket = run;
 
-    return gc;
+    gc->ntexts++;
+
+    return run;
 }
 
 
-void
-rie_gfx_delete(rie_gfx_t *gc)
+/* drops texts not used in the current frame, or all of them */
+static void
+rie_gfx_text_sweep(rie_gfx_t *gc, int all)
 {
-    cairo_destroy(gc->cr);
-    free(gc);
-}
+    int              i;
+    rie_gfx_text_t  *run, **prev;
 
+    for (i = 0; i < RIE_GFX_TEXT_BUCKETS; i++) {
 
-void
-rie_gfx_render_start(rie_gfx_t *gc)
-{
-    cairo_push_group(gc->cr);
-}
+        prev = &gc->texts[i];
 
-void
-rie_gfx_render_done(rie_gfx_t *gc)
-{
-    cairo_pop_group_to_source(gc->cr);
+        while ((run = *prev)) {
 
-    cairo_paint(gc->cr);
-    cairo_surface_flush(gc->surface);
-}
+            if (!all && run->frame == gc->frame) {
+                prev = &run->next;
+                continue;
+            }
 
-void
-rie_gfx_resize(rie_gfx_t *gc, int w, int h)
-{
-    cairo_xcb_surface_set_size(gc->surface, w, h);
+            *prev = run->next;
+
+            cairo_glyph_free(run->glyphs);
+            cairo_scaled_font_destroy(run->sfont);
+            free(run->text);
+            free(run);
+
+            gc->ntexts--;
+        }
+    }
 }
 
-void
-rie_gfx_surface_free(rie_surface_t *surface)
+
+static void
+rie_gfx_exec_op(rie_gfx_t *gc, rie_gfx_op_t *op)
 {
-    cairo_surface_destroy((cairo_surface_t*)surface);
+    rie_clip_t  clip, *cp;
+
+    if (op->clipped) {
+        clip.box = &op->clip;
+        clip.parent = NULL;
+        cp = &clip;
+
+    } else {
+        cp = NULL;
+    }
+
+    /* errors are not fatal for the rest of the frame */
+
+    switch (op->type) {
+    case RIE_GFX_OP_PATCH:
+        (void) rie_gfx_exec_patch(gc, &op->tspec, &op->dst,
+                                  op->has_src ? &op->src : NULL, cp);
+        break;
+
+    case RIE_GFX_OP_TEXTURE:
+        (void) rie_gfx_exec_texture(gc, &op->tspec, &op->dst, cp);
+        break;
+
+    case RIE_GFX_OP_SURFACE:
+        (void) rie_gfx_exec_surface(gc, op->surface, &op->dst, cp);
+        break;
+
+    case RIE_GFX_OP_TEXT:
+        (void) rie_gfx_exec_text(gc, op->fc, op->run, op->x, op->y, cp);
+        break;
+    }
 }
 
 
-int
-rie_gfx_render_patch(rie_gfx_t *gc, rie_texture_t *tspec, rie_rect_t *dst,
-    rie_rect_t *src, rie_clip_t *clip)
+/*
+ * computes area affected by drawing into dst under the clip chain,
+ * and the chain itself reduced to a single rectangle;
+ * returns 0 if nothing is visible
+ */
+static int
+rie_gfx_op_bbox(rie_rect_t *dst, rie_clip_t *clip, rie_rect_t *bbox,
+    rie_rect_t *cbox)
 {
-    rie_pattern_t  *pat;
+    int32_t  x1, y1, x2, y2, cx1, cy1, cx2, cy2;
+
+    x1 = dst->x;
+    y1 = dst->y;
+    x2 = dst->x + (int32_t) dst->w;
+    y2 = dst->y + (int32_t) dst->h;
+
+    if (clip) {
+        cx1 = clip->box->x;
+        cy1 = clip->box->y;
+        cx2 = clip->box->x + (int32_t) clip->box->w;
+        cy2 = clip->box->y + (int32_t) clip->box->h;
+
+        for (clip = clip->parent; clip; clip = clip->parent) {
+            cx1 = rie_max(cx1, clip->box->x);
+            cy1 = rie_max(cy1, clip->box->y);
+            cx2 = rie_min(cx2, clip->box->x + (int32_t) clip->box->w);
+            cy2 = rie_min(cy2, clip->box->y + (int32_t) clip->box->h);
+        }
 
-    if (tspec->type == RIE_TX_TYPE_NONE) {
-        return RIE_OK;
+        if (cx2 <= cx1 || cy2 <= cy1) {
+            return 0;
+        }
+
+        cbox->x = cx1;
+        cbox->y = cy1;
+        cbox->w = cx2 - cx1;
+        cbox->h = cy2 - cy1;
+
+        x1 = rie_max(x1, cx1);
+        y1 = rie_max(y1, cy1);
+        x2 = rie_min(x2, cx2);
+        y2 = rie_min(y2, cy2);
     }
 
-    if (dst->w == 0 || dst->h == 0) {
-        /* do not try to render invisible items */
-        return RIE_OK;
+    if (x2 <= x1 || y2 <= y1) {
+        return 0;
     }
 
-    cairo_save(gc->cr);
+    bbox->x = x1;
+    bbox->y = y1;
+    bbox->w = x2 - x1;
+    bbox->h = y2 - y1;
 
-    while (clip) {
-        cairo_rectangle(gc->cr, clip->box->x, clip->box->y,
-                                clip->box->w, clip->box->h);
-        cairo_clip(gc->cr);
-        clip = clip->parent;
-    }
+    return 1;
+}
 
-    if (src) {
-        /* root background, must be tiled and shifted */
 
-        pat = rie_gfx_pattern_from_surface(tspec->tx);
+/*
+ * appends new operation to the current list;
+ * RIE_NOTFOUND is returned if it is clipped out and need not be recorded
+ */
+static int
+rie_gfx_op_add(rie_gfx_t *gc, rie_gfx_op_type_e type, rie_rect_t *dst,
+    rie_clip_t *clip, rie_gfx_op_t **opp)
+{
+    size_t           size;
+    rie_rect_t       bbox, cbox;
+    rie_gfx_op_t    *op, *ops;
+    rie_gfx_list_t  *list;
 
-        cairo_rectangle(gc->cr, dst->x, dst->y, dst->w, dst->h);
-        cairo_translate(gc->cr, -src->x, -src->y);
+    if (!rie_gfx_op_bbox(dst, clip, &bbox, &cbox)) {
+        return RIE_NOTFOUND;
+    }
 
-        cairo_set_source(gc->cr, (cairo_pattern_t *) pat);
+    list = &gc->lists[gc->cur];
 
-    } else {
+    if (list->nops == list->size) {
+        size = list->size ? list->size * 2 : RIE_GFX_LIST_MIN;
 
-        cairo_set_source_surface(gc->cr, CS(tspec->tx), dst->x, dst->y);
+        ops = realloc(list->ops, size * sizeof(rie_gfx_op_t));
+        if (ops == NULL) {
+            rie_log_error0(errno, "realloc");
+            return RIE_ERROR;
+        }
 
-        cairo_rectangle(gc->cr, 0, 0, dst->w, dst->h);
+        list->ops = ops;
+        list->size = size;
     }
 
-    cairo_clip(gc->cr);
+    op = &list->ops[list->nops++];
 
-    cairo_paint_with_alpha(gc->cr, tspec->alpha);
+    rie_memzero(op, sizeof(rie_gfx_op_t));
 
-    cairo_restore(gc->cr);
+    op->type = type;
+    op->bbox = bbox;
+    op->dst = *dst;
+
+    if (clip) {
+        op->clip = cbox;
+        op->clipped = 1;
+    }
+
+    *opp = op;
 
     return RIE_OK;
 }
 
 
-int
-rie_gfx_render_texture(rie_gfx_t *gc, rie_texture_t *tspec, rie_rect_t *dst,
-    rie_clip_t *clip)
+/* same operation, drawing the same pixels into the same place */
+static int
+rie_gfx_op_equal(rie_gfx_op_t *a, rie_gfx_op_t *b)
 {
-    double  dx, dy;
-
-    if (tspec->type == RIE_TX_TYPE_NONE) {
-        return RIE_OK;
+    if (a->type != b->type
+        || a->serial != b->serial
+        || a->clipped != b->clipped
+        || a->has_src != b->has_src
+        || memcmp(&a->bbox, &b->bbox, sizeof(rie_rect_t)) != 0
+        || memcmp(&a->dst, &b->dst, sizeof(rie_rect_t)) != 0)
+    {
+        return 0;
     }
 
-    if (dst->w == 0 || dst->h == 0) {
-        /* do not try to render invisible items */
-        return RIE_OK;
+    if (a->clipped && memcmp(&a->clip, &b->clip, sizeof(rie_rect_t)) != 0) {
+        return 0;
     }
 
-    cairo_save(gc->cr);
-
-    while (clip) {
-        cairo_rectangle(gc->cr, clip->box->x, clip->box->y,
-                                clip->box->w, clip->box->h);
-        cairo_clip(gc->cr);
-        clip = clip->parent;
+    if (a->has_src && memcmp(&a->src, &b->src, sizeof(rie_rect_t)) != 0) {
+        return 0;
     }
 
-    if (tspec->type == RIE_TX_TYPE_COLOR) {
+    switch (a->type) {
+    case RIE_GFX_OP_PATCH:
+    case RIE_GFX_OP_TEXTURE:
 
-        rie_gfx_set_source_rgba(gc->cr, &tspec->color, tspec->alpha);
-        cairo_rectangle(gc->cr, dst->x, dst->y, dst->w, dst->h);
-        cairo_fill(gc->cr);
+        if (a->tspec.type != b->tspec.type || a->tspec.alpha != b->tspec.alpha) {
+            return 0;
+        }
 
+        if (a->tspec.type == RIE_TX_TYPE_COLOR
+            && memcmp(&a->tspec.color, &b->tspec.color, sizeof(rie_color_t)))
+        {
+            return 0;
+        }
 
-    } else if (tspec->type == RIE_TX_TYPE_PATTERN) {
-        cairo_translate(gc->cr, dst->x, dst->y);
-        cairo_rectangle(gc->cr, 0, 0, dst->w, dst->h);
+        return 1;
 
-        cairo_set_source(gc->cr, (cairo_pattern_t *) tspec->pat);
+    case RIE_GFX_OP_SURFACE:
+        return 1;
 
-        cairo_clip(gc->cr);
-        cairo_paint_with_alpha(gc->cr, tspec->alpha);
+    case RIE_GFX_OP_TEXT:
+        /* same text and font is the same serial */
+        return a->fc == b->fc && a->x == b->x && a->y == b->y;
+    }
 
-    } else {
+    return 0;
+}
 
-        /* RIE_TX_TYPE_TEXTURE */
 
-        dx = cairo_image_surface_get_width(CS(tspec->tx));
-        dy = cairo_image_surface_get_height(CS(tspec->tx));
+/*
+ * surfaces and patterns are compared by serial numbers, assigned on first
+ * use: unlike addresses, they are never reused by new objects
+ */
+static uintptr_t
+rie_gfx_surface_serial(cairo_surface_t *surface)
+{
+    void  *serial;
 
-        dx = ((double)dst->w)/dx;
-        dy = ((double)dst->h)/dy;
+    serial = cairo_surface_get_user_data(surface, &rie_gfx_serial_key);
 
-        if (dx == 0 || dy == 0) {
-            /* cairo_scale() will reject such values and put context
-             * into an error state, preventing further drawing
-             */
-            cairo_restore(gc->cr);
-            return RIE_OK;
-        }
+    if (serial == NULL) {
+        serial = (void *) ++rie_gfx_serial;
+        (void) cairo_surface_set_user_data(surface, &rie_gfx_serial_key,
+                                           serial, NULL);
+    }
 
-        cairo_push_group(gc->cr);
+    return (uintptr_t) serial;
+}
 
-        cairo_translate(gc->cr, dst->x, dst->y);
-        cairo_rectangle(gc->cr, 0, 0, dst->w, dst->h);
-        cairo_scale(gc->cr, dx, dy);
-        cairo_set_source_surface(gc->cr, CS(tspec->tx), 0, 0);
 
-        cairo_fill(gc->cr);
+static uintptr_t
+rie_gfx_pattern_serial(cairo_pattern_t *pattern)
+{
+    void  *serial;
 
-        cairo_pop_group_to_source(gc->cr);
+    serial = cairo_pattern_get_user_data(pattern, &rie_gfx_serial_key);
 
-        cairo_paint_with_alpha(gc->cr, tspec->alpha);
+    if (serial == NULL) {
+        serial = (void *) ++rie_gfx_serial;
+        (void) cairo_pattern_set_user_data(pattern, &rie_gfx_serial_key,
+                                           serial, NULL);
     }
 
-    cairo_restore(gc->cr);
-
-    return RIE_OK;
+    return (uintptr_t) serial;
 }
 
 
-int
-rie_gfx_draw_text(rie_gfx_t *gc, rie_fc_t *fc, char *text, rie_rect_t *box,
-    rie_clip_t *clip)
+/* drops references to drawn objects, keeps the rest for comparison */
+static void
+rie_gfx_list_release(rie_gfx_list_t *list)
 {
-    cairo_text_extents_t  te;
+    size_t         i;
+    rie_gfx_op_t  *op;
 
-    cairo_save(gc->cr);
+    for (i = 0; i < list->nops; i++) {
 
-    while (clip) {
-        cairo_rectangle(gc->cr, clip->box->x, clip->box->y,
-                                clip->box->w, clip->box->h);
-        cairo_clip(gc->cr);
-        clip = clip->parent;
-    }
+        op = &list->ops[i];
 
-    cairo_set_font_face(gc->cr, (cairo_font_face_t *) fc->font);
-    cairo_set_font_size(gc->cr, fc->points);
-    cairo_text_extents(gc->cr, text, &te);
-    rie_gfx_set_source_rgba(gc->cr, &fc->color, fc->alpha);
+        if (op->surface) {
+            cairo_surface_destroy(op->surface);
+            op->surface = NULL;
+        }
+
+        if (op->pattern) {
+            cairo_pattern_destroy(op->pattern);
+            op->pattern = NULL;
+        }
 
+        op->tspec.tx = NULL;
+        op->tspec.pat = NULL;
+        op->run = NULL;
+    }
+}
 
-    cairo_move_to(gc->cr, box->x - te.x_bearing, box->y - te.y_bearing);
-    cairo_show_text(gc->cr, text);
-    cairo_restore(gc->cr);
 
-    return RIE_OK;
+static void
+rie_gfx_list_clear(rie_gfx_list_t *list)
+{
+    rie_gfx_list_release(list);
+
+    list->nops = 0;
 }
 
 
 rie_rect_t
 rie_gfx_text_bounding_box(rie_gfx_t *gc, rie_fc_t *fc, char *text)
 {
-    rie_rect_t            res;
-    cairo_text_extents_t  bb;
+    rie_rect_t       res;
+    rie_gfx_text_t  *run;
 
-    cairo_save(gc->cr);
-    cairo_set_font_face(gc->cr, (cairo_font_face_t *) fc->font);
-    cairo_set_font_size(gc->cr, fc->points);
-    cairo_text_extents(gc->cr, text, &bb);
-    cairo_restore(gc->cr);
+    rie_memzero(&res, sizeof(rie_rect_t));
 
-    res.w = bb.width;
-    res.h = bb.height;
-    res.x = bb.x_bearing;
-    res.y = bb.y_bearing;
+    run = rie_gfx_text_get(gc, fc, text);
+    if (run == NULL) {
+        return res;
+    }
+
+    res.w = run->te.width;
+    res.h = run->te.height;
+    res.x = run->te.x_bearing;
+    res.y = run->te.y_bearing;
 
     return res;
 }
 
 
+/* number of strings kept shaped */
+size_t
+rie_gfx_text_cached(rie_gfx_t *gc)
+{
+    return gc->ntexts;
+}
+
+
 static void
 rie_gfx_pre_multiply_alpha(uint32_t *pixels, size_t size)
 {
@@ -399,6 +1506,93 @@ rie_gfx_surface_from_zpixmap(rie_gfx_t *gc, uint32_t *data, int w, int h)
 }
 
 
+/*
+ * refers to X11 drawable in place, no pixels are copied; the drawable
+ * must outlive the surface; zero visual means root window visual
+ */
+rie_surface_t *
+rie_gfx_surface_from_drawable(rie_xcb_t *xcb, uint32_t drawable,
+    uint32_t visual, int w, int h)
+{
+    cairo_status_t     cs;
+    cairo_surface_t   *surface;
+    xcb_visualtype_t  *vt;
+
+    vt = visual ? rie_xcb_visual(xcb, visual) : rie_xcb_root_visual(xcb);
+    if (vt == NULL) {
+        return NULL;
+    }
+
+    surface = cairo_xcb_surface_create(rie_xcb_get_connection(xcb), drawable,
+                                       vt, w, h);
+
+    cs = cairo_surface_status(surface);
+    if (cs != CAIRO_STATUS_SUCCESS) {
+        rie_log_str_error0(cairo_status_to_string(cs),
+                          "cairo_xcb_surface_create()");
+        return NULL;
+    }
+
+    return (rie_surface_t *) surface;
+}
+
+
+/* release() is invoked with data once the surface is destroyed */
+int
+rie_gfx_surface_on_release(rie_surface_t *surface, void *data,
+    rie_gfx_release_pt release)
+{
+    cairo_status_t  cs;
+
+    static cairo_user_data_key_t  key;
+
+    cs = cairo_surface_set_user_data((cairo_surface_t *) surface, &key, data,
+                                     release);
+    if (cs != CAIRO_STATUS_SUCCESS) {
+        rie_log_str_error0(cairo_status_to_string(cs),
+                           "cairo_surface_set_user_data()");
+        return RIE_ERROR;
+    }
+
+    return RIE_OK;
+}
+
+
+/*
+ * wraps existing 24-bit RGB pixels (4 bytes per pixel, no padding) without
+ * copying; release() is invoked with data once the surface is destroyed
+ */
+rie_surface_t *
+rie_gfx_surface_from_data(void *data, int w, int h, rie_gfx_release_pt release)
+{
+    cairo_status_t    cs;
+    cairo_surface_t  *surface;
+
+    static cairo_user_data_key_t  key;
+
+    surface = cairo_image_surface_create_for_data(data, CAIRO_FORMAT_RGB24,
+                                                  w, h, w * sizeof(uint32_t));
+
+    cs = cairo_surface_status(surface);
+    if (cs != CAIRO_STATUS_SUCCESS) {
+        rie_log_str_error0(cairo_status_to_string(cs),
+                           "cairo_image_surface_create_for_data()");
+        cairo_surface_destroy(surface);
+        return NULL;
+    }
+
+    cs = cairo_surface_set_user_data(surface, &key, data, release);
+    if (cs != CAIRO_STATUS_SUCCESS) {
+        rie_log_str_error0(cairo_status_to_string(cs),
+                           "cairo_surface_set_user_data()");
+        cairo_surface_destroy(surface);
+        return NULL;
+    }
+
+    return (rie_surface_t *) surface;
+}
+
+
 rie_surface_t *
 rie_gfx_surface_from_png(char *fname, int *w, int *h)
 {
@@ -466,6 +1660,13 @@ rie_gfx_pattern_from_surface(rie_surface_t *surface)
 }
 
 
+rie_pattern_t *
+rie_gfx_pattern_ref(rie_pattern_t *pat)
+{
+    return (rie_pattern_t *) cairo_pattern_reference((cairo_pattern_t *) pat);
+}
+
+
 void
 rie_gfx_pattern_free(rie_pattern_t *pat)
 {
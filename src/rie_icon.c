@@ -0,0 +1,346 @@
+
+/*
+ * Copyright (C) 2017-2025 Vladimir Homutov
+ */
+
+/*
+ * This file is part of Rieman.
+ *
+ * Rieman is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Rieman is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ */
+
+#include "rieman.h"
+
+#include <stdlib.h>
+
+
+/* power of two */
+#define RIE_ICON_CACHE_BUCKETS  64
+
+/* unused entries are dropped when cache grows above this */
+#define RIE_ICON_CACHE_MAX      128
+
+typedef struct rie_icon_entry_s  rie_icon_entry_t;
+typedef struct rie_icon_scaled_s rie_icon_scaled_t;
+
+/*
+ * decoded icon is shared by all windows with identical _NET_WM_ICON image;
+ * each window holds own surface reference, the cache holds one more
+ */
+struct rie_icon_entry_s {
+    uint64_t             hash;      /* of raw ARGB data */
+    uint32_t             w;
+    uint32_t             h;
+    char                *wclass;    /* WM_CLASS of the first owner */
+    rie_surface_t       *tx;
+    rie_icon_entry_t    *next;
+};
+
+/* icon as it was drawn last time: scaled to window box, alpha applied */
+struct rie_icon_scaled_s {
+    rie_surface_t       *src;       /* referenced, so address is not reused */
+    uint32_t             w;
+    uint32_t             h;
+    double               alpha;
+    rie_surface_t       *tx;
+    uint64_t             frame;     /* last frame the icon was drawn in */
+    rie_icon_scaled_t   *next;
+};
+
+struct rie_icon_cache_s {
+    rie_icon_entry_t    *buckets[RIE_ICON_CACHE_BUCKETS];
+    size_t               nentries;
+    uint64_t             hits;
+    uint64_t             misses;
+
+    rie_icon_scaled_t   *scaled[RIE_ICON_CACHE_BUCKETS];
+    size_t               scaled_size;  /* bytes */
+    size_t               budget;       /* bytes, 0 - disabled */
+    uint64_t             frame;
+};
+
+
+static uint64_t rie_icon_hash(uint32_t *argb, size_t n);
+static void rie_icon_cache_sweep(rie_icon_cache_t *cache, int all);
+static void rie_icon_cache_evict(rie_icon_cache_t *cache, int all);
+
+
+rie_icon_cache_t *
+rie_icon_cache_new(void)
+{
+    rie_icon_cache_t  *cache;
+
+    cache = malloc(sizeof(rie_icon_cache_t));
+    if (cache == NULL) {
+        rie_log_error0(errno, "malloc");
+        return NULL;
+    }
+
+    rie_memzero(cache, sizeof(rie_icon_cache_t));
+
+    return cache;
+}
+
+
+void
+rie_icon_cache_delete(rie_icon_cache_t *cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+
+    rie_debug("icon cache: %lu hits, %lu misses",
+              (unsigned long) cache->hits, (unsigned long) cache->misses);
+
+    rie_icon_cache_evict(cache, 1);
+    rie_icon_cache_sweep(cache, 1);
+
+    free(cache);
+}
+
+
+/* returns new reference to decoded icon, to be freed by the caller */
+rie_surface_t *
+rie_icon_cache_get(rie_icon_cache_t *cache, rie_gfx_t *gc, uint32_t *argb,
+    int w, int h, char *wclass)
+{
+    uint64_t           hash;
+    rie_surface_t     *tx;
+    rie_icon_entry_t  *entry, **bucket;
+
+    if (wclass == NULL) {
+        wclass = "";
+    }
+
+    hash = rie_icon_hash(argb, w * h);
+
+    bucket = &cache->buckets[hash & (RIE_ICON_CACHE_BUCKETS - 1)];
+
+    /* pixels decide, windows of different classes may share an icon */
+    for (entry = *bucket; entry; entry = entry->next) {
+
+        if (entry->hash == hash && entry->w == w && entry->h == h) {
+
+            if (strcmp(entry->wclass, wclass) != 0) {
+                rie_debug("icon of \"%s\" shared with \"%s\"",
+                          wclass, entry->wclass);
+            }
+
+            cache->hits++;
+            return rie_gfx_surface_ref(entry->tx);
+        }
+    }
+
+    cache->misses++;
+
+    tx = rie_gfx_surface_from_icon(gc, argb, w, h);
+    if (tx == NULL) {
+        return NULL;
+    }
+
+    if (cache->nentries >= RIE_ICON_CACHE_MAX) {
+        rie_icon_cache_sweep(cache, 0);
+    }
+
+    entry = malloc(sizeof(rie_icon_entry_t));
+    if (entry == NULL) {
+        rie_log_error0(errno, "malloc");
+        /* still usable, just not shared */
+        return tx;
+    }
+
+    entry->wclass = strdup(wclass);
+    if (entry->wclass == NULL) {
+        rie_log_error0(errno, "strdup");
+        free(entry);
+        return tx;
+    }
+
+    entry->hash = hash;
+    entry->w = w;
+    entry->h = h;
+    entry->tx = rie_gfx_surface_ref(tx);
+
+    entry->next = *bucket;
+    *bucket = entry;
+
+    cache->nentries++;
+
+    return tx;
+}
+
+
+void
+rie_icon_cache_set_budget(rie_icon_cache_t *cache, size_t bytes)
+{
+    cache->budget = bytes;
+
+    if (cache->scaled_size > bytes) {
+        rie_icon_cache_evict(cache, 1);
+    }
+}
+
+
+/*
+ * returns icon prepared for drawing into w x h box with given alpha;
+ * the surface is owned by the cache and is valid until end of the frame;
+ * NULL means the icon is to be drawn by usual means
+ */
+rie_surface_t *
+rie_icon_cache_scaled(rie_icon_cache_t *cache, rie_surface_t *src, int w,
+    int h, double alpha)
+{
+    size_t              size;
+    rie_surface_t      *tx;
+    rie_icon_scaled_t  *entry, **bucket;
+
+    if (w <= 0 || h <= 0 || cache->budget == 0) {
+        return NULL;
+    }
+
+    bucket = &cache->scaled[((uintptr_t) src >> 4)
+                            & (RIE_ICON_CACHE_BUCKETS - 1)];
+
+    for (entry = *bucket; entry; entry = entry->next) {
+        if (entry->src == src && entry->w == w && entry->h == h
+            && entry->alpha == alpha)
+        {
+            entry->frame = cache->frame;
+            return entry->tx;
+        }
+    }
+
+    size = (size_t) w * h * sizeof(uint32_t);
+
+    if (cache->scaled_size + size > cache->budget) {
+        return NULL;
+    }
+
+    tx = rie_gfx_surface_scale(src, w, h, alpha);
+    if (tx == NULL) {
+        return NULL;
+    }
+
+    entry = malloc(sizeof(rie_icon_scaled_t));
+    if (entry == NULL) {
+        rie_log_error0(errno, "malloc");
+        rie_gfx_surface_free(tx);
+        return NULL;
+    }
+
+    entry->src = rie_gfx_surface_ref(src);
+    entry->w = w;
+    entry->h = h;
+    entry->alpha = alpha;
+    entry->tx = tx;
+    entry->frame = cache->frame;
+
+    entry->next = *bucket;
+    *bucket = entry;
+
+    cache->scaled_size += size;
+
+    return tx;
+}
+
+
+/* icons not drawn in this frame belong to dead or resized windows */
+void
+rie_icon_cache_frame_done(rie_icon_cache_t *cache)
+{
+    rie_icon_cache_evict(cache, 0);
+
+    cache->frame++;
+}
+
+
+/* FNV-1a */
+static uint64_t
+rie_icon_hash(uint32_t *argb, size_t n)
+{
+    size_t    i;
+    uint64_t  hash;
+
+    hash = 0xcbf29ce484222325ULL;
+
+    for (i = 0; i < n; i++) {
+        hash ^= argb[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+
+/* drops entries no longer used by any window, or all of them */
+static void
+rie_icon_cache_sweep(rie_icon_cache_t *cache, int all)
+{
+    int                i;
+    rie_icon_entry_t  *entry, **prev;
+
+    for (i = 0; i < RIE_ICON_CACHE_BUCKETS; i++) {
+
+        prev = &cache->buckets[i];
+
+        while ((entry = *prev)) {
+
+            if (!all && rie_gfx_surface_refcount(entry->tx) > 1) {
+                prev = &entry->next;
+                continue;
+            }
+
+            *prev = entry->next;
+
+            rie_gfx_surface_free(entry->tx);
+            free(entry->wclass);
+            free(entry);
+
+            cache->nentries--;
+        }
+    }
+
+    rie_debug("icon cache: %lu entries after sweep, %lu hits, %lu misses",
+              (unsigned long) cache->nentries, (unsigned long) cache->hits,
+              (unsigned long) cache->misses);
+}
+
+
+static void
+rie_icon_cache_evict(rie_icon_cache_t *cache, int all)
+{
+    int                 i;
+    rie_icon_scaled_t  *entry, **prev;
+
+    for (i = 0; i < RIE_ICON_CACHE_BUCKETS; i++) {
+
+        prev = &cache->scaled[i];
+
+        while ((entry = *prev)) {
+
+            if (!all && entry->frame == cache->frame) {
+                prev = &entry->next;
+                continue;
+            }
+
+            *prev = entry->next;
+
+            cache->scaled_size -= (size_t) entry->w * entry->h
+                                  * sizeof(uint32_t);
+
+            rie_gfx_surface_free(entry->tx);
+            rie_gfx_surface_free(entry->src);
+            free(entry);
+        }
+    }
+}
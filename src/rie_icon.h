@@ -0,0 +1,38 @@
+
+/*
+ * Copyright (C) 2017-2025 Vladimir Homutov
+ */
+
+/*
+ * This file is part of Rieman.
+ *
+ * Rieman is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Rieman is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ */
+
+#ifndef __RIE_ICON_H__
+#define __RIE_ICON_H__
+
+typedef struct rie_icon_cache_s  rie_icon_cache_t;
+
+rie_icon_cache_t *rie_icon_cache_new(void);
+void rie_icon_cache_delete(rie_icon_cache_t *cache);
+
+rie_surface_t *rie_icon_cache_get(rie_icon_cache_t *cache, rie_gfx_t *gc,
+    uint32_t *argb, int w, int h, char *wclass);
+
+void rie_icon_cache_set_budget(rie_icon_cache_t *cache, size_t bytes);
+rie_surface_t *rie_icon_cache_scaled(rie_icon_cache_t *cache,
+    rie_surface_t *src, int w, int h, double alpha);
+void rie_icon_cache_frame_done(rie_icon_cache_t *cache);
+
+#endif
@@ -20,7 +20,6 @@
  */
 
 #include "rieman.h"
-#include "rie_external.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -149,19 +148,23 @@ rie_log_dump()
 }
 
 
+/*
+ * skin is loaded by a separate thread at startup; the file is locked
+ * while a message is written, so that lines do not interleave
+ */
 static inline void
 rie_log_time_prefix(FILE *out)
 {
     int         err;
     time_t      tm;
-    struct tm  *ti;
+    struct tm   ti;
 
     char buf[80];
 
     tm = time(NULL);
-    ti = localtime(&tm);
+    (void) localtime_r(&tm, &ti);
 
-    if (strftime(buf, sizeof(buf), "[%F %H:%M:%S %Z]", ti) == 0) {
+    if (strftime(buf, sizeof(buf), "[%F %H:%M:%S %Z]", &ti) == 0) {
         err = errno;
         fprintf(rie_logp->file, "[time fail: strftime(): %s]", strerror(err));
         return;
@@ -176,6 +179,8 @@ rie_log_sys_error_real(char *file, int line, int err, char *fmt, ...)
 {
     va_list  ap;
 
+    flockfile(rie_logp->file);
+
     rie_log_time_prefix(rie_logp->file);
 
     fprintf(rie_logp->file, " -err- ");
@@ -194,12 +199,15 @@ rie_log_sys_error_real(char *file, int line, int err, char *fmt, ...)
     (void) rie_backtrace_save(&rie_logp->backtrace);
 #endif
 
+    funlockfile(rie_logp->file);
 }
 
 void
 rie_log_str_error_real_v(char *file, int line, const char *err, char *fmt,
     va_list ap)
 {
+    flockfile(rie_logp->file);
+
     rie_log_time_prefix(rie_logp->file);
 
     fprintf(rie_logp->file, " -err- ");
@@ -211,6 +219,8 @@ rie_log_str_error_real_v(char *file, int line, const char *err, char *fmt,
 #if defined (RIE_DEBUG)
     (void) rie_backtrace_save(&rie_logp->backtrace);
 #endif
+
+    funlockfile(rie_logp->file);
 }
 
 
@@ -231,6 +241,8 @@ rie_debug_real(char *fmt, ...)
 {
     va_list  ap;
 
+    flockfile(rie_logp->file);
+
     rie_log_time_prefix(rie_logp->file);
 
     fprintf(rie_logp->file, " -dbg- ");
@@ -240,6 +252,8 @@ rie_debug_real(char *fmt, ...)
     va_end(ap);
 
     fprintf(rie_logp->file, "\n");
+
+    funlockfile(rie_logp->file);
 }
 
 
@@ -248,6 +262,8 @@ rie_log(char *fmt, ...)
 {
     va_list  ap;
 
+    flockfile(rie_logp->file);
+
     rie_log_time_prefix(rie_logp->file);
 
     fprintf(rie_logp->file, " -log- ");
@@ -257,6 +273,8 @@ rie_log(char *fmt, ...)
     va_end(ap);
 
     fprintf(rie_logp->file, "\n");
+
+    funlockfile(rie_logp->file);
 }
 
 
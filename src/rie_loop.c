@@ -0,0 +1,629 @@
+
+/*
+ * Copyright (C) 2017-2025 Vladimir Homutov
+ */
+
+/*
+ * This file is part of Rieman.
+ *
+ * Rieman is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Rieman is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ */
+
+#include "rieman.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/inotify.h>
+
+
+#define RIE_LOOP_NEVENTS  16
+
+/* directory entry is written, replaced, created or has attributes changed */
+#define RIE_LOOP_WATCH_MASK                                                   \
+    (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ATTRIB)
+
+typedef enum {
+    RIE_LOOP_FD,
+    RIE_LOOP_SIGNALS,
+    RIE_LOOP_TIMER,
+    RIE_LOOP_IDLE,
+    RIE_LOOP_FILES
+} rie_loop_source_type_e;
+
+typedef struct rie_loop_watch_s  rie_loop_watch_t;
+
+struct rie_loop_watch_s {
+    int                      wd;      /* inotify watch descriptor */
+    uint32_t                 arg;     /* passed to handler on change */
+    char                    *name;    /* entry in directory, NULL if any */
+    rie_loop_watch_t        *next;
+};
+
+struct rie_loop_source_s {
+    rie_loop_source_type_e   type;
+    int                      fd;      /* -1 for idle sources */
+    rie_loop_handler_pt      handler;
+    void                    *data;
+    uint8_t                  armed;   /* timers only */
+    uint8_t                  removed; /* freed after dispatch is done */
+    rie_loop_watch_t        *watches; /* files sources only */
+    rie_loop_source_t       *next;
+};
+
+struct rie_loop_s {
+    int                      epfd;
+    uint8_t                  stop;
+    rie_loop_source_t       *sources;
+};
+
+
+static rie_loop_source_t *rie_loop_add(rie_loop_t *loop,
+    rie_loop_source_type_e type, int fd, rie_loop_handler_pt handler,
+    void *data);
+static int rie_loop_dispatch(rie_loop_source_t *src);
+static int rie_loop_read_files(rie_loop_source_t *src);
+static int rie_loop_run_idle(rie_loop_t *loop);
+static void rie_loop_sweep(rie_loop_t *loop);
+
+
+rie_loop_t *
+rie_loop_new(void)
+{
+    rie_loop_t  *loop;
+
+    loop = malloc(sizeof(rie_loop_t));
+    if (loop == NULL) {
+        rie_log_error0(errno, "malloc");
+        return NULL;
+    }
+
+    rie_memzero(loop, sizeof(rie_loop_t));
+
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd == -1) {
+        rie_log_error0(errno, "epoll_create1()");
+        free(loop);
+        return NULL;
+    }
+
+    return loop;
+}
+
+
+void
+rie_loop_delete(rie_loop_t *loop)
+{
+    rie_loop_source_t  *src;
+
+    if (loop == NULL) {
+        return;
+    }
+
+    for (src = loop->sources; src; src = src->next) {
+        rie_loop_remove(loop, src);
+    }
+
+    rie_loop_sweep(loop);
+
+    (void) close(loop->epfd);
+
+    free(loop);
+}
+
+
+static rie_loop_source_t *
+rie_loop_add(rie_loop_t *loop, rie_loop_source_type_e type, int fd,
+    rie_loop_handler_pt handler, void *data)
+{
+    rie_loop_source_t   *src;
+    struct epoll_event   ee;
+
+    src = malloc(sizeof(rie_loop_source_t));
+    if (src == NULL) {
+        rie_log_error0(errno, "malloc");
+        return NULL;
+    }
+
+    rie_memzero(src, sizeof(rie_loop_source_t));
+
+    src->type = type;
+    src->fd = fd;
+    src->handler = handler;
+    src->data = data;
+
+    if (fd != -1) {
+        rie_memzero(&ee, sizeof(struct epoll_event));
+
+        ee.events = EPOLLIN;
+        ee.data.ptr = src;
+
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ee) == -1) {
+            rie_log_error0(errno, "epoll_ctl(ADD)");
+            free(src);
+            return NULL;
+        }
+    }
+
+    src->next = loop->sources;
+    loop->sources = src;
+
+    return src;
+}
+
+
+rie_loop_source_t *
+rie_loop_add_fd(rie_loop_t *loop, int fd, rie_loop_handler_pt handler,
+    void *data)
+{
+    return rie_loop_add(loop, RIE_LOOP_FD, fd, handler, data);
+}
+
+
+rie_loop_source_t *
+rie_loop_add_signals(rie_loop_t *loop, sigset_t *mask,
+    rie_loop_handler_pt handler, void *data)
+{
+    int                 fd;
+    rie_loop_source_t  *src;
+
+    /* signals must be blocked, otherwise they are delivered as usual */
+    fd = signalfd(-1, mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd == -1) {
+        rie_log_error0(errno, "signalfd()");
+        return NULL;
+    }
+
+    src = rie_loop_add(loop, RIE_LOOP_SIGNALS, fd, handler, data);
+    if (src == NULL) {
+        (void) close(fd);
+    }
+
+    return src;
+}
+
+
+rie_loop_source_t *
+rie_loop_add_timer(rie_loop_t *loop, rie_loop_handler_pt handler, void *data)
+{
+    int                 fd;
+    rie_loop_source_t  *src;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) {
+        rie_log_error0(errno, "timerfd_create()");
+        return NULL;
+    }
+
+    src = rie_loop_add(loop, RIE_LOOP_TIMER, fd, handler, data);
+    if (src == NULL) {
+        (void) close(fd);
+    }
+
+    return src;
+}
+
+
+/*
+ * changes of watched files are reported to the handler, with args
+ * of all matching watches combined into one
+ */
+rie_loop_source_t *
+rie_loop_add_files(rie_loop_t *loop, rie_loop_handler_pt handler, void *data)
+{
+    int                 fd;
+    rie_loop_source_t  *src;
+
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd == -1) {
+        rie_log_error0(errno, "inotify_init1()");
+        return NULL;
+    }
+
+    src = rie_loop_add(loop, RIE_LOOP_FILES, fd, handler, data);
+    if (src == NULL) {
+        (void) close(fd);
+    }
+
+    return src;
+}
+
+
+/*
+ * directory is watched instead of the file itself: editors often save
+ * by writing a new file and renaming it over the old one
+ */
+int
+rie_loop_watch(rie_loop_source_t *src, char *dir, char *name, uint32_t arg)
+{
+    int                wd;
+    rie_loop_watch_t  *watch;
+
+    watch = malloc(sizeof(rie_loop_watch_t));
+    if (watch == NULL) {
+        rie_log_error0(errno, "malloc");
+        return RIE_ERROR;
+    }
+
+    rie_memzero(watch, sizeof(rie_loop_watch_t));
+
+    if (name) {
+        watch->name = strdup(name);
+        if (watch->name == NULL) {
+            rie_log_error0(errno, "strdup");
+            free(watch);
+            return RIE_ERROR;
+        }
+    }
+
+    wd = inotify_add_watch(src->fd, dir, RIE_LOOP_WATCH_MASK);
+    if (wd == -1) {
+        rie_log_error(errno, "inotify_add_watch(\"%s\")", dir);
+        free(watch->name);
+        free(watch);
+        return RIE_ERROR;
+    }
+
+    watch->wd = wd;
+    watch->arg = arg;
+
+    watch->next = src->watches;
+    src->watches = watch;
+
+    return RIE_OK;
+}
+
+
+void
+rie_loop_unwatch_all(rie_loop_source_t *src)
+{
+    rie_loop_watch_t  *watch, *next;
+
+    for (watch = src->watches; watch; watch = next) {
+        next = watch->next;
+
+        if (src->fd != -1) {
+            /* same directory may be watched twice, errors are expected */
+            (void) inotify_rm_watch(src->fd, watch->wd);
+        }
+
+        free(watch->name);
+        free(watch);
+    }
+
+    src->watches = NULL;
+}
+
+
+/* idle sources are invoked each time before the loop is going to sleep */
+rie_loop_source_t *
+rie_loop_add_idle(rie_loop_t *loop, rie_loop_handler_pt handler, void *data)
+{
+    return rie_loop_add(loop, RIE_LOOP_IDLE, -1, handler, data);
+}
+
+
+/*
+ * source may be removed from any handler, including its own: it is
+ * only marked, and memory is released when all ready sources are handled
+ */
+void
+rie_loop_remove(rie_loop_t *loop, rie_loop_source_t *src)
+{
+    if (src == NULL || src->removed) {
+        return;
+    }
+
+    if (src->fd != -1) {
+        (void) epoll_ctl(loop->epfd, EPOLL_CTL_DEL, src->fd, NULL);
+
+        if (src->type != RIE_LOOP_FD) {
+            /* descriptor was created by the loop */
+            (void) close(src->fd);
+        }
+
+        src->fd = -1;
+    }
+
+    src->removed = 1;
+}
+
+
+/* arms one-shot timer; zero timeout fires on the next loop iteration */
+int
+rie_loop_timer_set(rie_loop_source_t *timer, uint64_t msec)
+{
+    struct itimerspec  its;
+
+    rie_memzero(&its, sizeof(struct itimerspec));
+
+    if (msec) {
+        its.it_value.tv_sec = msec / 1000;
+        its.it_value.tv_nsec = (msec % 1000) * 1000000;
+
+    } else {
+        its.it_value.tv_nsec = 1;
+    }
+
+    if (timerfd_settime(timer->fd, 0, &its, NULL) == -1) {
+        rie_log_error0(errno, "timerfd_settime()");
+        return RIE_ERROR;
+    }
+
+    timer->armed = 1;
+
+    return RIE_OK;
+}
+
+
+int
+rie_loop_timer_stop(rie_loop_source_t *timer)
+{
+    struct itimerspec  its;
+
+    if (!timer->armed) {
+        return RIE_OK;
+    }
+
+    rie_memzero(&its, sizeof(struct itimerspec));
+
+    if (timerfd_settime(timer->fd, 0, &its, NULL) == -1) {
+        rie_log_error0(errno, "timerfd_settime()");
+        return RIE_ERROR;
+    }
+
+    timer->armed = 0;
+
+    return RIE_OK;
+}
+
+
+int
+rie_loop_timer_armed(rie_loop_source_t *timer)
+{
+    return timer->armed;
+}
+
+
+int
+rie_loop_run(rie_loop_t *loop)
+{
+    int  i, n;
+
+    struct epoll_event  events[RIE_LOOP_NEVENTS];
+
+    loop->stop = 0;
+
+    while (1) {
+
+        if (rie_loop_run_idle(loop) != RIE_OK) {
+            return RIE_ERROR;
+        }
+
+        if (loop->stop) {
+            break;
+        }
+
+        n = epoll_wait(loop->epfd, events, RIE_LOOP_NEVENTS, -1);
+
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            rie_log_error0(errno, "epoll_wait()");
+            return RIE_ERROR;
+        }
+
+        for (i = 0; i < n; i++) {
+            if (rie_loop_dispatch(events[i].data.ptr) != RIE_OK) {
+                return RIE_ERROR;
+            }
+        }
+
+        rie_loop_sweep(loop);
+
+        if (loop->stop) {
+            break;
+        }
+    }
+
+    return RIE_OK;
+}
+
+
+void
+rie_loop_stop(rie_loop_t *loop)
+{
+    loop->stop = 1;
+}
+
+
+uint64_t
+rie_loop_msec(void)
+{
+    struct timespec  ts;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+static int
+rie_loop_dispatch(rie_loop_source_t *src)
+{
+    ssize_t   n;
+    uint64_t  expirations;
+
+    struct signalfd_siginfo  si;
+
+    if (src->removed) {
+        return RIE_OK;
+    }
+
+    switch (src->type) {
+
+    case RIE_LOOP_SIGNALS:
+
+        while (!src->removed) {
+            n = read(src->fd, &si, sizeof(struct signalfd_siginfo));
+            if (n == -1) {
+                if (errno == EAGAIN) {
+                    break;
+                }
+
+                rie_log_error0(errno, "read() on signalfd failed");
+                return RIE_ERROR;
+            }
+
+            if (src->handler(src->data, si.ssi_signo) != RIE_OK) {
+                return RIE_ERROR;
+            }
+        }
+
+        return RIE_OK;
+
+    case RIE_LOOP_TIMER:
+
+        n = read(src->fd, &expirations, sizeof(uint64_t));
+        if (n == -1) {
+            if (errno == EAGAIN) {
+                /* timer was re-armed after it fired */
+                return RIE_OK;
+            }
+
+            rie_log_error0(errno, "read() on timerfd failed");
+            return RIE_ERROR;
+        }
+
+        src->armed = 0;
+
+        return src->handler(src->data, (uint32_t) expirations);
+
+    case RIE_LOOP_FILES:
+        return rie_loop_read_files(src);
+
+    default:
+        return src->handler(src->data, 0);
+    }
+}
+
+
+static int
+rie_loop_run_idle(rie_loop_t *loop)
+{
+    rie_loop_source_t  *src;
+
+    for (src = loop->sources; src; src = src->next) {
+
+        if (src->type != RIE_LOOP_IDLE || src->removed) {
+            continue;
+        }
+
+        if (src->handler(src->data, 0) != RIE_OK) {
+            return RIE_ERROR;
+        }
+    }
+
+    return RIE_OK;
+}
+
+
+static void
+rie_loop_sweep(rie_loop_t *loop)
+{
+    rie_loop_source_t  *src, **prev;
+
+    prev = &loop->sources;
+
+    while ((src = *prev)) {
+
+        if (src->removed) {
+            *prev = src->next;
+            rie_loop_unwatch_all(src);
+            free(src);
+            continue;
+        }
+
+        prev = &src->next;
+    }
+}
+
+
+static int
+rie_loop_read_files(rie_loop_source_t *src)
+{
+    char                  *p;
+    ssize_t                n;
+    uint32_t               arg;
+    rie_loop_watch_t      *watch;
+    struct inotify_event  *ev;
+
+    union {                                 /* aligned for events */
+        struct inotify_event  ev;
+        char                  data[4096];
+    } buf;
+
+    arg = 0;
+
+    while (1) {
+        n = read(src->fd, buf.data, sizeof(buf.data));
+        if (n == -1) {
+            if (errno == EAGAIN) {
+                break;
+            }
+
+            rie_log_error0(errno, "read() on inotify descriptor failed");
+            return RIE_ERROR;
+        }
+
+        for (p = buf.data;
+             p < buf.data + n;
+             p += sizeof(struct inotify_event) + ev->len)
+        {
+            ev = (struct inotify_event *) p;
+
+            for (watch = src->watches; watch; watch = watch->next) {
+
+                if (ev->mask & IN_Q_OVERFLOW) {
+                    /* events were lost, anything may have changed */
+                    arg |= watch->arg;
+                    continue;
+                }
+
+                if (watch->wd != ev->wd) {
+                    continue;
+                }
+
+                if (watch->name
+                    && (ev->len == 0 || strcmp(watch->name, ev->name) != 0))
+                {
+                    continue;
+                }
+
+                arg |= watch->arg;
+            }
+        }
+    }
+
+    if (arg == 0) {
+        return RIE_OK;
+    }
+
+    return src->handler(src->data, arg);
+}
@@ -0,0 +1,61 @@
+
+/*
+ * Copyright (C) 2017-2025 Vladimir Homutov
+ */
+
+/*
+ * This file is part of Rieman.
+ *
+ * Rieman is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Rieman is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ */
+
+#ifndef __RIE_LOOP_H__
+#define __RIE_LOOP_H__
+
+#include <signal.h>
+
+/*
+ * arg is a signal number for signal sources, and a number of expirations
+ * for timers; zero for others
+ */
+typedef int (*rie_loop_handler_pt)(void *data, uint32_t arg);
+
+rie_loop_t *rie_loop_new(void);
+void rie_loop_delete(rie_loop_t *loop);
+
+rie_loop_source_t *rie_loop_add_fd(rie_loop_t *loop, int fd,
+    rie_loop_handler_pt handler, void *data);
+rie_loop_source_t *rie_loop_add_signals(rie_loop_t *loop, sigset_t *mask,
+    rie_loop_handler_pt handler, void *data);
+rie_loop_source_t *rie_loop_add_timer(rie_loop_t *loop,
+    rie_loop_handler_pt handler, void *data);
+rie_loop_source_t *rie_loop_add_idle(rie_loop_t *loop,
+    rie_loop_handler_pt handler, void *data);
+rie_loop_source_t *rie_loop_add_files(rie_loop_t *loop,
+    rie_loop_handler_pt handler, void *data);
+void rie_loop_remove(rie_loop_t *loop, rie_loop_source_t *src);
+
+int rie_loop_timer_set(rie_loop_source_t *timer, uint64_t msec);
+int rie_loop_timer_stop(rie_loop_source_t *timer);
+int rie_loop_timer_armed(rie_loop_source_t *timer);
+
+int rie_loop_watch(rie_loop_source_t *src, char *dir, char *name,
+    uint32_t arg);
+void rie_loop_unwatch_all(rie_loop_source_t *src);
+
+int rie_loop_run(rie_loop_t *loop);
+void rie_loop_stop(rie_loop_t *loop);
+
+uint64_t rie_loop_msec(void);
+
+#endif
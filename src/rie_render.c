@@ -22,6 +22,8 @@
 #include "rieman.h"
 #include "rie_xcb.h"
 #include "rie_skin.h"
+#include "rie_render.h"
+#include "rie_thumb.h"
 
 #include <math.h>
 #include <stdio.h>
@@ -56,13 +58,25 @@ static inline rie_rect_t rie_scale_to_desktop(rie_t *pager, rie_desktop_t *desk,
 
 static int rie_init_vdesktops(rie_t *pager);
 static void rie_count_hidden_windows(rie_t *pager);
-static int rie_draw_desktops(rie_t *pager);
+static int rie_render_layout(rie_t *pager, rie_rect_t *wbox);
+static int rie_draw_desktops(rie_t *pager, rie_rect_t *wbox);
 static int rie_desktop_in_subset(rie_t *pager, int dnum);
 static int rie_draw_windows(rie_t *pager);
 static int rie_set_pager_geometry(rie_t *pager, rie_rect_t *win);
 
-static int rie_draw_pager_background(rie_t *pager, rie_rect_t win);
-static int rie_draw_desktop(rie_t *pager, rie_desktop_t *desk, int row, int col,
+static int rie_root_keep_full(rie_t *pager);
+static int rie_root_shrink(rie_t *pager);
+static int rie_root_fit(rie_t *pager);
+static rie_surface_t *rie_root_desktop_patch(rie_t *pager, int current,
+    double alpha);
+
+static int rie_draw_static_layer(rie_t *pager, rie_rect_t *win);
+static int rie_draw_static(rie_t *pager, rie_rect_t win);
+static int rie_draw_pager_background(rie_t *pager, rie_rect_t win,
+    rie_rect_t *part);
+static int rie_draw_desktop_background(rie_t *pager, rie_desktop_t *desk,
+    int current);
+static int rie_draw_desktop(rie_t *pager, rie_desktop_t *desk, rie_rect_t *win,
     int active);
 static int rie_draw_desktop_border(rie_t *pager, rie_desktop_t *box,
     int active);
@@ -86,18 +100,26 @@ static int rie_draw_desktop_text(rie_t *pager, rie_rect_t desk, int dnum);
 int
 rie_render(rie_t *pager)
 {
-    int  rc;
+    int         rc;
+    rie_rect_t  wbox;
 
     if (rie_init_vdesktops(pager) != RIE_OK) {
         return RIE_ERROR;
     }
 
+    if (rie_render_layout(pager, &wbox) != RIE_OK) {
+        return RIE_ERROR;
+    }
+
     rie_gfx_render_start(pager->gfx);
 
-    rc = rie_draw_desktops(pager);
+    rc = rie_draw_desktops(pager, &wbox);
 
     rie_gfx_render_done(pager->gfx);
 
+    rie_icon_cache_frame_done(pager->icons);
+    rie_thumb_frame_done(pager);
+
     rie_xcb_flush(pager->xcb);
 
     return rc;
@@ -370,27 +392,43 @@ rie_count_hidden_windows(rie_t *pager)
 }
 
 
+/*
+ * geometry is settled before the frame is drawn: whatever depends on it
+ * and needs X server round-trips is fetched here, not while drawing
+ */
 static int
-rie_draw_desktops(rie_t *pager)
+rie_render_layout(rie_t *pager, rie_rect_t *wbox)
 {
-    int  i, row, col, wrap, m_desk;
-
-    rie_rect_t      wbox;
-    rie_desktop_t  *desk;
-
     /* calculate single desktop size and thus window size */
-    if (rie_set_pager_geometry(pager, &wbox) != RIE_OK) {
+    if (rie_set_pager_geometry(pager, wbox) != RIE_OK) {
         return RIE_ERROR;
     }
 
-    /* desktop under the mouse pointer */
-    m_desk = pager->m_in ? pager->selected_desktop : - 1;
+    if (rie_root_fit(pager) != RIE_OK) {
+        /* desktops are drawn without root background */
+        rie_log("WARNING: can't get root window pixmap,"
+                " continuing with color background");
+    }
 
-    /* render window background */
-    if (rie_draw_pager_background(pager, wbox) != RIE_OK) {
-        return RIE_ERROR;
+    /* new layout or settings may require icons of another size */
+    if (rie_render_icon_size(pager) != pager->icon_size) {
+        (void) rie_window_update_icons(pager);
     }
 
+    return RIE_OK;
+}
+
+
+static int
+rie_draw_desktops(rie_t *pager, rie_rect_t *wbox)
+{
+    int  i, row, col, wrap, m_desk;
+
+    rie_desktop_t  *desk;
+
+    /* desktop under the mouse pointer */
+    m_desk = pager->m_in ? pager->selected_desktop : - 1;
+
     /* row or column where to wrap in order to create 2D grid */
     wrap = (pager->cfg->desktop.orientation == XCB_EWMH_WM_ORIENTATION_HORZ)
             ? pager->ncols
@@ -398,7 +436,7 @@ rie_draw_desktops(rie_t *pager)
 
     rie_count_hidden_windows(pager);
 
-    /* draw all desktops in a 2D grid */
+    /* place all desktops in a 2D grid */
     for (i = 0, col = 0, row = 0; i < pager->vdesktops.nitems; i++, col++) {
 
         if (i % wrap == 0) {
@@ -408,9 +446,19 @@ rie_draw_desktops(rie_t *pager)
 
         desk = rie_nth_vdesktop(pager, i);
 
-        if (rie_draw_desktop(pager, desk, row - 1, col, m_desk == i)
-            != RIE_OK)
-        {
+        rie_set_desktop_geometry(pager, desk, row - 1, col);
+    }
+
+    /* window background and desktops grid, as rendered before */
+    if (rie_draw_static_layer(pager, wbox) != RIE_OK) {
+        return RIE_ERROR;
+    }
+
+    for (i = 0; i < pager->vdesktops.nitems; i++) {
+
+        desk = rie_nth_vdesktop(pager, i);
+
+        if (rie_draw_desktop(pager, desk, wbox, m_desk == i) != RIE_OK) {
             return RIE_ERROR;
         }
     }
@@ -651,8 +699,112 @@ rie_set_pager_geometry(rie_t *pager, rie_rect_t *win)
 }
 
 
+/*
+ * Parts of the picture that only depend on geometry, skin and root
+ * background are drawn once into an offscreen layer, and each frame
+ * starts with a copy of it.
+ */
+static int
+rie_draw_static_layer(rie_t *pager, rie_rect_t *win)
+{
+    int               rc;
+    rie_rect_t        box;
+    rie_layer_key_t   key;
+
+    rie_memzero(&key, sizeof(rie_layer_key_t));
+
+    key.win = *win;
+    key.cell = pager->template.cell;
+    key.nrows = pager->nrows;
+    key.ncols = pager->ncols;
+    key.first = pager->vdesktops.nitems ? rie_nth_vdesktop(pager, 0)->num : 0;
+    key.ndesktops = pager->vdesktops.nitems;
+
+    if (pager->layer.tx == NULL
+        || memcmp(&key, &pager->layer_key, sizeof(rie_layer_key_t)) != 0)
+    {
+        rie_render_layer_reset(pager);
+
+        if (rie_gfx_layer_begin(pager->gfx, win->w, win->h) == RIE_OK) {
+
+            rc = rie_draw_static(pager, *win);
+
+            pager->layer.tx = rie_gfx_layer_end(pager->gfx);
+
+            if (rc != RIE_OK) {
+                rie_render_layer_reset(pager);
+                return RIE_ERROR;
+            }
+
+            pager->layer.box.w = win->w;
+            pager->layer.box.h = win->h;
+            pager->layer_key = key;
+        }
+    }
+
+    if (pager->layer.tx == NULL) {
+        /* no offscreen surface, draw as is */
+        return rie_draw_static(pager, *win);
+    }
+
+    box = pager->layer.box;
+
+    return rie_gfx_render_surface(pager->gfx, pager->layer.tx, &box, NULL);
+}
+
+
+/* desktops are drawn as not current, the frame takes care of current */
 static int
-rie_draw_pager_background(rie_t *pager, rie_rect_t win)
+rie_draw_static(rie_t *pager, rie_rect_t win)
+{
+    int             i;
+    rie_desktop_t  *desk;
+    rie_texture_t  *tspec;
+
+    if (rie_draw_pager_background(pager, win, NULL) != RIE_OK) {
+        return RIE_ERROR;
+    }
+
+    tspec = rie_skin_texture(pager->skin, RIE_TX_DESKTOP_NAME_BG);
+
+    for (i = 0; i < pager->vdesktops.nitems; i++) {
+
+        desk = rie_nth_vdesktop(pager, i);
+
+        if (rie_draw_desktop_background(pager, desk, 0) != RIE_OK) {
+            return RIE_ERROR;
+        }
+
+        if (rie_draw_desktop_border(pager, desk, 0) != RIE_OK) {
+            return RIE_ERROR;
+        }
+
+        if (pager->cfg->show_pad) {
+            if (rie_gfx_render_texture(pager->gfx, tspec, &desk->pad, NULL)
+                != RIE_OK)
+            {
+                return RIE_ERROR;
+            }
+        }
+    }
+
+    return RIE_OK;
+}
+
+
+void
+rie_render_layer_reset(rie_t *pager)
+{
+    if (pager->layer.tx) {
+        rie_gfx_surface_free(pager->layer.tx);
+        pager->layer.tx = NULL;
+    }
+}
+
+
+/* draws the whole window background, or its part only */
+static int
+rie_draw_pager_background(rie_t *pager, rie_rect_t win, rie_rect_t *part)
 {
     rie_rect_t      box;
     rie_texture_t  *tspec, root;
@@ -661,6 +813,14 @@ rie_draw_pager_background(rie_t *pager, rie_rect_t win)
     box.x = 0;
     box.y = 0;
 
+    if (part) {
+        box = *part;
+
+        /* source offset follows the part inside window */
+        win.x += part->x;
+        win.y += part->y;
+    }
+
     tspec = rie_skin_texture(pager->skin, RIE_TX_BACKGROUND);
 
     if (tspec->img_is_root) {
@@ -1124,24 +1284,65 @@ rie_draw_viewports(rie_t *pager, rie_desktop_t *desk)
 
 
 static int
-rie_draw_desktop(rie_t *pager, rie_desktop_t *desk, int row, int col,
+rie_draw_desktop(rie_t *pager, rie_desktop_t *desk, rie_rect_t *win,
     int active)
 {
-    rie_texture_t  *tspec, root;
+    int  current;
+
+    current = (desk->num == pager->current_desktop || active);
+
+    if (current) {
+        /* static layer has it drawn as other desktops; start from scratch */
+
+        if (rie_draw_pager_background(pager, *win, &desk->dbox) != RIE_OK) {
+            return RIE_ERROR;
+        }
+
+        if (rie_draw_desktop_background(pager, desk, 1) != RIE_OK) {
+            return RIE_ERROR;
+        }
+    }
+
+    if (pager->cfg->show_viewports) {
+        if (rie_draw_viewports(pager, desk) != RIE_OK) {
+            return RIE_ERROR;
+        }
+    }
+
+    if (pager->cfg->show_pad) {
+        rie_draw_desktop_label(pager, desk->pad, desk->num);
+    }
+
+    if (pager->cfg->show_text) {
+        rie_draw_desktop_text(pager, desk->dbox, desk->num + 1);
+    }
+
+    return RIE_OK;
+}
 
-    rie_set_desktop_geometry(pager, desk, row, col);
 
-    if (desk->num == pager->current_desktop || active) {
+static int
+rie_draw_desktop_background(rie_t *pager, rie_desktop_t *desk, int current)
+{
+    int             rc;
+    rie_surface_t  *patch;
+    rie_texture_t  *tspec, root;
+
+    if (current) {
         tspec = rie_skin_texture(pager->skin, RIE_TX_CURRENT_DESKTOP);
 
     } else {
         tspec = rie_skin_texture(pager->skin, RIE_TX_DESKTOP);
     }
 
+    patch = NULL;
+
     if (tspec->img_is_root) {
 
+        patch = rie_root_desktop_patch(pager, current, tspec->alpha);
+
         /* we failed to get root image from X11, fallback to color */
-        if (pager->root_bg.tx == NULL) {
+        if (patch == NULL) {
 
             root = *tspec;
 
@@ -1154,35 +1355,17 @@ rie_draw_desktop(rie_t *pager, rie_desktop_t *desk, int row, int col,
             root.alpha = 1.0;
 
             tspec = &root;
-
-        } else {
-            tspec->tx = pager->root_bg.tx;
-        }
-    }
-
-    if (rie_gfx_render_texture(pager->gfx, tspec, &desk->dbox, NULL) != RIE_OK) {
-        return RIE_ERROR;
-    }
-
-    if (pager->cfg->show_viewports) {
-        if (rie_draw_viewports(pager, desk) != RIE_OK) {
-            return RIE_ERROR;
         }
     }
 
-    if (rie_draw_desktop_border(pager, desk, active) != RIE_OK) {
-        return RIE_ERROR;
-    }
-
-    if (pager->cfg->show_pad) {
-        rie_draw_desktop_label(pager, desk->pad, desk->num);
-    }
+    if (patch) {
+        rc = rie_gfx_render_surface(pager->gfx, patch, &desk->dbox, NULL);
 
-    if (pager->cfg->show_text) {
-        rie_draw_desktop_text(pager, desk->dbox, desk->num + 1);
+    } else {
+        rc = rie_gfx_render_texture(pager->gfx, tspec, &desk->dbox, NULL);
     }
 
-    return RIE_OK;
+    return rc;
 }
 
 
@@ -1294,6 +1477,225 @@ rie_set_desktop_geometry(rie_t *pager, rie_desktop_t *desk, int row, int col)
 /* bounding box of an icon: x times smaller than surrounding window */
 #define ICON_BB_SCALE  1.5
 
+
+/*
+ * fetches root background and keeps it only at the size really needed:
+ * pseudo-transparent pager background shows it 1:1, while desktops
+ * only need it fitted into the desktop box
+ */
+int
+rie_render_root_background(rie_t *pager)
+{
+    int  rc, desk, bg;
+
+    rie_render_root_reset(pager);
+
+    bg = rie_skin_texture(pager->skin, RIE_TX_BACKGROUND)->img_is_root;
+    desk = rie_skin_texture(pager->skin, RIE_TX_DESKTOP)->img_is_root
+           || rie_skin_texture(pager->skin, RIE_TX_CURRENT_DESKTOP)->img_is_root;
+
+    if (!desk && !bg) {
+        /* skin does not show root background at all */
+        if (pager->root_bg.tx) {
+            rie_gfx_surface_free(pager->root_bg.tx);
+            pager->root_bg.tx = NULL;
+        }
+        return RIE_OK;
+    }
+
+    if (pager->cfg->root_mode == RIE_ROOT_SERVER) {
+        rc = rie_xcb_wrap_root_pixmap(pager->xcb, &pager->root_bg);
+
+    } else {
+        rc = rie_xcb_get_root_pixmap(pager->xcb, pager->gfx, &pager->root_bg);
+    }
+
+    if (rc != RIE_OK) {
+        if (pager->root_bg.tx) {
+            rie_gfx_surface_free(pager->root_bg.tx);
+            pager->root_bg.tx = NULL;
+        }
+        return RIE_ERROR;
+    }
+
+    pager->root_bg_scaled = 0;
+
+    if (rie_root_keep_full(pager) || pager->template.dbox.w == 0) {
+        /* needed as is, or pager geometry is not yet calculated */
+        return RIE_OK;
+    }
+
+    return rie_root_shrink(pager);
+}
+
+
+void
+rie_render_root_reset(rie_t *pager)
+{
+    int  i;
+
+    /* static layer shows root background */
+    rie_render_layer_reset(pager);
+
+    for (i = 0; i < 2; i++) {
+        if (pager->root_desk[i].tx) {
+            rie_gfx_surface_free(pager->root_desk[i].tx);
+            pager->root_desk[i].tx = NULL;
+        }
+    }
+}
+
+
+/*
+ * full-size image is needed for pseudo-transparent pager background;
+ * root pixmap used in place costs nothing on client and is never reduced
+ */
+static int
+rie_root_keep_full(rie_t *pager)
+{
+    return pager->cfg->root_mode == RIE_ROOT_SERVER
+           || rie_skin_texture(pager->skin, RIE_TX_BACKGROUND)->img_is_root;
+}
+
+
+/* replaces full-size root image with a copy fitted into desktop box */
+static int
+rie_root_shrink(rie_t *pager)
+{
+    rie_rect_t     *dbox;
+    rie_surface_t  *scaled;
+
+    dbox = &pager->template.dbox;
+
+    scaled = rie_gfx_surface_scale_box(pager->root_bg.tx, &pager->root_bg.box,
+                                       dbox->w, dbox->h, 1.0);
+    if (scaled == NULL) {
+        return RIE_ERROR;
+    }
+
+    rie_gfx_surface_free(pager->root_bg.tx);
+
+    pager->root_bg.tx = scaled;
+    pager->root_bg.box.w = dbox->w;
+    pager->root_bg.box.h = dbox->h;
+
+    pager->root_bg_scaled = 1;
+
+    return RIE_OK;
+}
+
+
+/* brings reduced root image in line with the desktop box of new layout */
+static int
+rie_root_fit(rie_t *pager)
+{
+    rie_rect_t  *dbox;
+
+    dbox = &pager->template.dbox;
+
+    if (pager->root_bg.tx == NULL) {
+        return RIE_OK;
+    }
+
+    if (pager->root_bg_scaled) {
+
+        if (pager->root_bg.box.w != dbox->w || pager->root_bg.box.h != dbox->h)
+        {
+            /* reduced copy does not fit new layout, fetch it again */
+            return rie_render_root_background(pager);
+        }
+
+    } else if (!rie_root_keep_full(pager)) {
+        /* root was fetched before pager geometry was known */
+        if (rie_root_shrink(pager) != RIE_OK) {
+            /* full-size image still does, it is just scaled each time */
+            return RIE_OK;
+        }
+    }
+
+    return RIE_OK;
+}
+
+
+/*
+ * root background as shown on the desktop of a given kind (current or not),
+ * scaled and blended once, and reused until geometry or wallpaper changes;
+ * root image itself is already fitted to layout by rie_root_fit()
+ */
+static rie_surface_t *
+rie_root_desktop_patch(rie_t *pager, int current, double alpha)
+{
+    rie_rect_t   *dbox;
+    rie_image_t  *patch;
+
+    dbox = &pager->template.dbox;
+    patch = &pager->root_desk[current ? 1 : 0];
+
+    if (patch->tx) {
+        if (patch->box.w == dbox->w && patch->box.h == dbox->h) {
+            return patch->tx;
+        }
+
+        /* desktop size changed, all patches are stale */
+        rie_render_root_reset(pager);
+    }
+
+    if (pager->root_bg.tx == NULL) {
+        return NULL;
+    }
+
+    if (pager->root_bg_scaled && alpha == 1.0) {
+        /* reduced copy is exactly what is needed */
+        patch->tx = rie_gfx_surface_ref(pager->root_bg.tx);
+
+    } else {
+        /* root pixmap used in place is scaled by X server */
+        patch->tx = rie_gfx_surface_scale_box(pager->root_bg.tx,
+                                              &pager->root_bg.box,
+                                              dbox->w, dbox->h, alpha);
+    }
+
+    if (patch->tx == NULL) {
+        return NULL;
+    }
+
+    patch->box = *dbox;
+
+    return patch->tx;
+}
+
+
+/* largest icon dimension that may be drawn, 0 if icons are not shown */
+uint32_t
+rie_render_icon_size(rie_t *pager)
+{
+    uint32_t     dim;
+    rie_rect_t  *dbox;
+
+    if (!pager->cfg->show_window_icons) {
+
+        if (!pager->cfg->show_pad || !pager->cfg->show_minitray) {
+            return 0;
+        }
+
+        /* minitray icons are squares of pad height */
+        if (pager->template.pad.h) {
+            return pager->template.pad.h;
+        }
+    }
+
+    dbox = &pager->template.dbox;
+
+    dim = rie_max(dbox->w, dbox->h);
+
+    if (dim == 0) {
+        /* pager geometry is not yet calculated */
+        dim = rie_max(pager->cfg->desktop.w, pager->cfg->desktop.h);
+    }
+
+    return rie_max(1, dim / ICON_BB_SCALE);
+}
+
 /* finds the icon best suitable to fit into the box */
 rie_image_t *
 rie_render_select_icon(rie_array_t *icons, rie_rect_t box)
@@ -1369,9 +1771,11 @@ rie_draw_window_border(rie_t *pager, rie_texture_t *tspec, rie_rect_t *box,
 static int
 rie_draw_window(rie_t *pager, rie_window_t *win)
 {
+    int             rc;
     rie_rect_t      scaled, hidbox;
     rie_clip_t      wclip, iclip;
     rie_image_t    *icon;
+    rie_surface_t  *thumb;
     rie_texture_t  *tspec;
     rie_desktop_t  *desk;
 
@@ -1470,7 +1874,16 @@ rie_draw_window(rie_t *pager, rie_window_t *win)
     wclip.box = &desk->dbox;
     wclip.parent = NULL;
 
-    if (rie_gfx_render_texture(pager->gfx, tspec, &scaled, &wclip) != RIE_OK) {
+    thumb = rie_thumb_get(pager, win, &scaled);
+
+    if (thumb) {
+        rc = rie_gfx_render_surface(pager->gfx, thumb, &scaled, &wclip);
+
+    } else {
+        rc = rie_gfx_render_texture(pager->gfx, tspec, &scaled, &wclip);
+    }
+
+    if (rc != RIE_OK) {
         return RIE_ERROR;
     }
 
@@ -1500,8 +1913,9 @@ static int
 rie_render_icon(rie_t *pager, rie_image_t *image, rie_rect_t wbox,
     rie_clip_t *clip)
 {
-    rie_rect_t     ibox;
-    rie_texture_t  tspec;
+    rie_rect_t      ibox;
+    rie_surface_t  *scaled;
+    rie_texture_t   tspec;
 
     rie_memzero(&tspec, sizeof(rie_texture_t));
 
@@ -1520,6 +1934,15 @@ rie_render_icon(rie_t *pager, rie_image_t *image, rie_rect_t wbox,
     }
 
     tspec.alpha = rie_skin_icon_alpha(pager->skin);
+
+    scaled = rie_icon_cache_scaled(pager->icons, image->tx, ibox.w, ibox.h,
+                                   tspec.alpha);
+    if (scaled) {
+        return rie_gfx_render_surface(pager->gfx, scaled, &ibox, clip);
+    }
+
+    /* cache budget is exhausted */
+
     tspec.tx = image->tx;
     tspec.tag = "icon";
     tspec.type = RIE_TX_TYPE_TEXTURE;
@@ -1558,7 +1981,6 @@ rie_draw_desktop_label(rie_t *pager, rie_rect_t pad, int dnum)
     rie_fc_t       *fc;
     rie_clip_t      clip;
     rie_rect_t      label;
-    rie_texture_t  *tspec;
 
     dnames = (char **) pager->desktop_names.data;
 
@@ -1577,11 +1999,7 @@ rie_draw_desktop_label(rie_t *pager, rie_rect_t pad, int dnum)
         fc = rie_skin_font(pager->skin, RIE_FONT_DESKTOP_NAME);
     }
 
-    tspec = rie_skin_texture(pager->skin, RIE_TX_DESKTOP_NAME_BG);
-
-    if (rie_gfx_render_texture(pager->gfx, tspec, &pad, NULL) != RIE_OK) {
-        return RIE_ERROR;
-    }
+    /* pad background is a part of static layer */
 
     label = rie_gfx_text_bounding_box(pager->gfx, fc, dname);
 
@@ -23,6 +23,10 @@
 #define __RIE_RENDER_H__
 
 int rie_render(rie_t *pager);
+uint32_t rie_render_icon_size(rie_t *pager);
+int rie_render_root_background(rie_t *pager);
+void rie_render_root_reset(rie_t *pager);
+void rie_render_layer_reset(rie_t *pager);
 int rie_desktop_by_coords(rie_t *pager, int x, int y);
 int rie_viewport_by_coords(rie_t *pager, int x, int y, int *new_x, int *new_y);
 
@@ -28,21 +28,59 @@
 #include <libgen.h> /* for dirname */
 #include <string.h>
 #include <stddef.h>
+#include <sys/stat.h>
+
+
+typedef struct rie_skin_asset_s  rie_skin_asset_t;
+
+/* decoded image file, or border tiles cut from it */
+struct rie_skin_asset_s {
+    char               *path;
+    dev_t               dev;
+    ino_t               ino;
+    struct timespec     mtime;      /* same second edits are caught, too */
+    off_t               size;
+    uint32_t            tile_w;     /* 0 for plain image */
+    rie_surface_t      *tx;
+    rie_tile_t          tiles[RIE_GRID_LAST];
+    uint64_t            gen;        /* last skin load which used it */
+    rie_skin_asset_t   *next;
+};
+
+/*
+ * shared by skins of all pagers created on reload: files which have
+ * not changed since they were decoded last time are not loaded again
+ */
+struct rie_skin_cache_s {
+    rie_skin_asset_t   *assets;
+    uint64_t            gen;
+    uint64_t            hits;
+    uint64_t            misses;
+};
 
 
 struct rie_skin_s {
     rie_conf_meta_t  meta;
-    rie_font_ctx_t  *font_ctx;
 
     rie_texture_t    textures[RIE_TX_LAST];
     rie_border_t     borders[RIE_BORDER_LAST];
     rie_fc_t         fonts[RIE_FONT_LAST];
+    rie_font_ctx_t  *font_ctx;              /* faces of fonts are shared */
 
     double           icon_alpha;
 };
 
 static int rie_skin_hex_to_rgb(rie_conf_item_t *spec, void *value, void *res,
     char *key);
+static rie_skin_asset_t *rie_skin_cache_lookup(rie_skin_cache_t *cache,
+    char *path, uint32_t tile_w, struct stat *st);
+static rie_skin_asset_t *rie_skin_cache_add(rie_skin_cache_t *cache,
+    char *path, uint32_t tile_w, struct stat *st);
+static void rie_skin_asset_free(rie_skin_asset_t *asset);
+static rie_surface_t *rie_skin_load_image(rie_skin_cache_t *cache, char *path);
+static int rie_skin_load_border(rie_skin_cache_t *cache, char *skin_dir,
+    rie_border_t *bspec);
+static void rie_skin_border_tiles_ref(rie_tile_t *dst, rie_tile_t *src);
 
 
 static rie_conf_map_t rie_texture_types[] = {
@@ -278,90 +316,153 @@ rie_skin_icon_alpha(rie_skin_t *skin)
 
 
 static int
-rie_skin_load_border(char *skin_dir, rie_border_t *bspec)
+rie_skin_load_border(rie_skin_cache_t *cache, char *skin_dir,
+    rie_border_t *bspec)
 {
     int    w, h;
     int    i, j, n;
     char  *p;
 
-    rie_surface_t  *surface, *tx;
-    rie_pattern_t *pat;
+    struct stat        st;
+    rie_surface_t     *surface, *tx;
+    rie_pattern_t     *pat;
+    rie_skin_asset_t  *asset;
 
-    if (bspec->type == RIE_TX_TYPE_TEXTURE) {
-
-        p = rie_mkpath(skin_dir, bspec->tile_src, NULL);
-        if (p == NULL) {
-            return RIE_ERROR;
-        }
+    if (bspec->type != RIE_TX_TYPE_TEXTURE) {
+        return RIE_OK;
+    }
 
-        surface = rie_gfx_surface_from_png(p, &w, &h);
+    p = rie_mkpath(skin_dir, bspec->tile_src, NULL);
+    if (p == NULL) {
+        return RIE_ERROR;
+    }
 
+    if (stat(p, &st) == -1) {
+        rie_log_error(errno, "stat(\"%s\") failed", p);
         free(p);
+        return RIE_ERROR;
+    }
 
-        if (surface == NULL) {
-            return RIE_ERROR;
-        }
+    asset = rie_skin_cache_lookup(cache, p, bspec->w, &st);
+    if (asset) {
+        free(p);
+        rie_skin_border_tiles_ref(bspec->tiles, asset->tiles);
+        return RIE_OK;
+    }
 
-        if (w < bspec->w * 4) {
-            rie_log_error(0, "'%s' tiles are too small: expected width "
-                          "is 4 x border_width(%d) = %d, real %d",
-                          bspec->tile_src, bspec->w, 4 * bspec->w, w);
-            return RIE_ERROR;
-        }
+    surface = rie_gfx_surface_from_png(p, &w, &h);
+    if (surface == NULL) {
+        free(p);
+        return RIE_ERROR;
+    }
 
-        if (h < bspec->w * 3) {
-            rie_log_error(0, "'%s' tiles are too small: expected width "
-                          "is 4 x border_width(%d) = %d, real %d",
-                          bspec->tile_src, bspec->w, 3 * bspec->w, h);
-            return RIE_ERROR;
-        }
+    if (w < bspec->w * 4) {
+        rie_log_error(0, "'%s' tiles are too small: expected width "
+                      "is 4 x border_width(%d) = %d, real %d",
+                      bspec->tile_src, bspec->w, 4 * bspec->w, w);
+        goto failed;
+    }
 
-        bspec->tx = surface;
+    if (h < bspec->w * 3) {
+        rie_log_error(0, "'%s' tiles are too small: expected width "
+                      "is 4 x border_width(%d) = %d, real %d",
+                      bspec->tile_src, bspec->w, 3 * bspec->w, h);
+        goto failed;
+    }
 
-        for (n = 0, i = 0; i < 4; i++) {
-            for (j = 0; j < 4 && n < RIE_GRID_LAST; j++, n++) {
+    for (n = 0, i = 0; i < 4; i++) {
+        for (j = 0; j < 4 && n < RIE_GRID_LAST; j++, n++) {
 
-                tx = rie_gfx_surface_from_clip(surface,
-                                               j * bspec->w,
-                                               i * bspec->w,
-                                               bspec->w, bspec->w);
-                if (tx == NULL) {
-                    return RIE_ERROR;
-                }
+            tx = rie_gfx_surface_from_clip(surface,
+                                           j * bspec->w,
+                                           i * bspec->w,
+                                           bspec->w, bspec->w);
+            if (tx == NULL) {
+                goto failed;
+            }
 
-                switch (n) {
-                case RIE_GRID_HORIZONTAL_TOP:
-                case RIE_GRID_VERTICAL_LEFT:
-                case RIE_GRID_HORIZONTAL_BOTTOM:
-                case RIE_GRID_VERTICAL_RIGHT:
+            switch (n) {
+            case RIE_GRID_HORIZONTAL_TOP:
+            case RIE_GRID_VERTICAL_LEFT:
+            case RIE_GRID_HORIZONTAL_BOTTOM:
+            case RIE_GRID_VERTICAL_RIGHT:
 
-                    pat = rie_gfx_pattern_from_surface(tx);
+                pat = rie_gfx_pattern_from_surface(tx);
 
-                    rie_gfx_surface_free(tx);
+                rie_gfx_surface_free(tx);
 
-                    if (pat == NULL) {
-                        return RIE_ERROR;
-                    }
+                if (pat == NULL) {
+                    goto failed;
+                }
 
-                    bspec->tiles[n].pat = pat;
+                bspec->tiles[n].pat = pat;
 
-                    break;
+                break;
 
-                default:
-                    bspec->tiles[n].surf = tx;
-                    break;
-                }
+            default:
+                bspec->tiles[n].surf = tx;
+                break;
             }
         }
-        rie_gfx_surface_free(surface);
     }
 
+    rie_gfx_surface_free(surface);
+
+    asset = rie_skin_cache_add(cache, p, bspec->w, &st);
+    if (asset) {
+        rie_skin_border_tiles_ref(asset->tiles, bspec->tiles);
+    }
+
+    free(p);
+
     return RIE_OK;
+
+failed:
+
+    rie_gfx_surface_free(surface);
+    free(p);
+
+    return RIE_ERROR;
 }
 
 
+static rie_surface_t *
+rie_skin_load_image(rie_skin_cache_t *cache, char *path)
+{
+    struct stat        st;
+    rie_surface_t     *surface;
+    rie_skin_asset_t  *asset;
+
+    if (stat(path, &st) == -1) {
+        rie_log_error(errno, "stat(\"%s\") failed", path);
+        return NULL;
+    }
+
+    asset = rie_skin_cache_lookup(cache, path, 0, &st);
+    if (asset) {
+        return rie_gfx_surface_ref(asset->tx);
+    }
+
+    surface = rie_gfx_surface_from_png(path, NULL, NULL);
+    if (surface == NULL) {
+        return NULL;
+    }
+
+    asset = rie_skin_cache_add(cache, path, 0, &st);
+    if (asset) {
+        asset->tx = rie_gfx_surface_ref(surface);
+    }
+
+    return surface;
+}
+
+
+/*
+ * skin is loaded from files only and does not need X server connection;
+ * at startup this is done by a separate thread
+ */
 rie_skin_t *
-rie_skin_new(char *name, rie_gfx_t *gc)
+rie_skin_new(char *name, rie_font_ctx_t *font_ctx, rie_skin_cache_t *cache)
 {
     int    i;
     char  *p, *skin_dir;
@@ -391,6 +492,8 @@ rie_skin_new(char *name, rie_gfx_t *gc)
 
     rie_memzero(skin, sizeof(struct rie_skin_s));
 
+    skin->font_ctx = font_ctx;
+
     skin->meta.version_min = 11;
     skin->meta.version_max = 11;
     skin->meta.spec = rie_skin_conf;
@@ -405,6 +508,9 @@ rie_skin_new(char *name, rie_gfx_t *gc)
 
     skin_dir = dirname(conf_file);
 
+    /* assets used by this skin are marked with new generation */
+    cache->gen++;
+
     /* load all images and convert them to textures */
     for (i = 0; i < RIE_TX_LAST; i++) {
 
@@ -431,7 +537,7 @@ rie_skin_new(char *name, rie_gfx_t *gc)
                     goto failed;
                 }
 
-                surface = rie_gfx_surface_from_png(p, NULL, NULL);
+                surface = rie_skin_load_image(cache, p);
 
                 free(p);
 
@@ -459,7 +565,7 @@ rie_skin_new(char *name, rie_gfx_t *gc)
 
 
     for (i = 0; i < RIE_BORDER_LAST; i++) {
-        if (rie_skin_load_border(skin_dir, &skin->borders[i])
+        if (rie_skin_load_border(cache, skin_dir, &skin->borders[i])
             != RIE_OK)
         {
             goto failed;
@@ -472,13 +578,8 @@ rie_skin_new(char *name, rie_gfx_t *gc)
     skin->textures[RIE_TX_WINDOW_ATTENTION].border =
                                    &skin->borders[RIE_BORDER_WINDOW_ATTENTION];
 
-    skin->font_ctx = rie_font_ctx_new();
-    if (skin->font_ctx == NULL) {
-        goto failed;
-    }
-
     for (i = 0; i < RIE_FONT_LAST; i++) {
-        if (rie_font_init(skin->font_ctx, &skin->fonts[i]) != RIE_OK) {
+        if (rie_font_init(font_ctx, &skin->fonts[i]) != RIE_OK) {
             goto failed;
         }
     }
@@ -544,15 +645,197 @@ rie_skin_delete(rie_skin_t *skin)
     }
 
     for (i = 0; i < RIE_FONT_LAST; i++) {
-        rie_font_cleanup(skin->fonts[i].font);
-    }
-
-    if (skin->font_ctx) {
-        rie_font_ctx_cleanup(skin->font_ctx);
-        skin->font_ctx = NULL;
+        rie_font_cleanup(skin->font_ctx, &skin->fonts[i]);
     }
 
     rie_conf_cleanup(&skin->meta, skin);
 
     free(skin);
 }
+
+
+rie_skin_cache_t *
+rie_skin_cache_new(void)
+{
+    rie_skin_cache_t  *cache;
+
+    cache = malloc(sizeof(rie_skin_cache_t));
+    if (cache == NULL) {
+        rie_log_error0(errno, "malloc");
+        return NULL;
+    }
+
+    rie_memzero(cache, sizeof(rie_skin_cache_t));
+
+    return cache;
+}
+
+
+void
+rie_skin_cache_delete(rie_skin_cache_t *cache)
+{
+    rie_skin_asset_t  *asset, *next;
+
+    if (cache == NULL) {
+        return;
+    }
+
+    rie_debug("skin cache: %lu hits, %lu misses",
+              (unsigned long) cache->hits, (unsigned long) cache->misses);
+
+    for (asset = cache->assets; asset; asset = next) {
+        next = asset->next;
+        rie_skin_asset_free(asset);
+    }
+
+    free(cache);
+}
+
+
+void
+rie_skin_cache_stats(rie_skin_cache_t *cache, uint64_t *hits,
+    uint64_t *misses)
+{
+    *hits = cache->hits;
+    *misses = cache->misses;
+}
+
+
+/* drops assets not used by the most recently loaded skin */
+void
+rie_skin_cache_sweep(rie_skin_cache_t *cache)
+{
+    rie_skin_asset_t  *asset, **prev;
+
+    if (cache == NULL) {
+        return;
+    }
+
+    prev = &cache->assets;
+
+    while ((asset = *prev)) {
+
+        if (asset->gen == cache->gen) {
+            prev = &asset->next;
+            continue;
+        }
+
+        *prev = asset->next;
+
+        rie_skin_asset_free(asset);
+    }
+}
+
+
+/* returns asset if the file did not change since it was loaded */
+static rie_skin_asset_t *
+rie_skin_cache_lookup(rie_skin_cache_t *cache, char *path, uint32_t tile_w,
+    struct stat *st)
+{
+    rie_skin_asset_t  *asset, **prev;
+
+    for (prev = &cache->assets; (asset = *prev); prev = &asset->next) {
+
+        if (asset->tile_w != tile_w || strcmp(asset->path, path) != 0) {
+            continue;
+        }
+
+        if (asset->dev == st->st_dev && asset->ino == st->st_ino
+            && asset->mtime.tv_sec == st->st_mtim.tv_sec
+            && asset->mtime.tv_nsec == st->st_mtim.tv_nsec
+            && asset->size == st->st_size)
+        {
+            cache->hits++;
+            asset->gen = cache->gen;
+            return asset;
+        }
+
+        rie_debug("skin asset \"%s\" was modified", path);
+
+        *prev = asset->next;
+        rie_skin_asset_free(asset);
+        break;
+    }
+
+    cache->misses++;
+
+    return NULL;
+}
+
+
+static rie_skin_asset_t *
+rie_skin_cache_add(rie_skin_cache_t *cache, char *path, uint32_t tile_w,
+    struct stat *st)
+{
+    rie_skin_asset_t  *asset;
+
+    asset = malloc(sizeof(rie_skin_asset_t));
+    if (asset == NULL) {
+        rie_log_error0(errno, "malloc");
+        /* still usable, just not cached */
+        return NULL;
+    }
+
+    rie_memzero(asset, sizeof(rie_skin_asset_t));
+
+    asset->path = strdup(path);
+    if (asset->path == NULL) {
+        rie_log_error0(errno, "strdup");
+        free(asset);
+        return NULL;
+    }
+
+    asset->dev = st->st_dev;
+    asset->ino = st->st_ino;
+    asset->mtime = st->st_mtim;
+    asset->size = st->st_size;
+    asset->tile_w = tile_w;
+    asset->gen = cache->gen;
+
+    asset->next = cache->assets;
+    cache->assets = asset;
+
+    return asset;
+}
+
+
+static void
+rie_skin_asset_free(rie_skin_asset_t *asset)
+{
+    rie_border_t  tmp;
+
+    if (asset->tx) {
+        rie_gfx_surface_free(asset->tx);
+    }
+
+    if (asset->tile_w) {
+        memcpy(tmp.tiles, asset->tiles, sizeof(asset->tiles));
+        rie_skin_border_free(&tmp);
+    }
+
+    free(asset->path);
+    free(asset);
+}
+
+
+static void
+rie_skin_border_tiles_ref(rie_tile_t *dst, rie_tile_t *src)
+{
+    int  n;
+
+    for (n = 0; n < RIE_GRID_LAST; n++) {
+
+        switch (n) {
+        case RIE_GRID_HORIZONTAL_TOP:
+        case RIE_GRID_VERTICAL_LEFT:
+        case RIE_GRID_HORIZONTAL_BOTTOM:
+        case RIE_GRID_VERTICAL_RIGHT:
+            dst[n].pat = src[n].pat ? rie_gfx_pattern_ref(src[n].pat) : NULL;
+            break;
+
+        default:
+            dst[n].surf = src[n].surf ? rie_gfx_surface_ref(src[n].surf)
+                                      : NULL;
+        }
+    }
+}
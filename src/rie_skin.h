@@ -140,7 +140,8 @@ struct rie_texture_s {
 };
 
 
-rie_skin_t *rie_skin_new(char *name, rie_gfx_t *gc);
+rie_skin_t *rie_skin_new(char *name, rie_font_ctx_t *font_ctx,
+    rie_skin_cache_t *cache);
 void rie_skin_delete(rie_skin_t *skin);
 
 rie_texture_t *rie_skin_texture(rie_skin_t *skin, rie_skin_texture_t elem);
@@ -148,4 +149,10 @@ rie_border_t  *rie_skin_border(rie_skin_t *skin, rie_skin_border_t elem);
 rie_fc_t      *rie_skin_font(rie_skin_t *skin, rie_skin_font_t elem);
 double         rie_skin_icon_alpha(rie_skin_t *skin);
 
+rie_skin_cache_t *rie_skin_cache_new(void);
+void rie_skin_cache_delete(rie_skin_cache_t *cache);
+void rie_skin_cache_sweep(rie_skin_cache_t *cache);
+void rie_skin_cache_stats(rie_skin_cache_t *cache, uint64_t *hits,
+    uint64_t *misses);
+
 #endif
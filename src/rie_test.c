@@ -22,6 +22,7 @@
 #include "rieman.h"
 #include "rie_xcb.h"
 #include "rie_event.h"
+#include "rie_skin.h"
 
 #include <stdio.h>
 #include <stdarg.h>
@@ -87,6 +88,13 @@ static void *rie_testing_thread(void *data);
 
 /* Helper functions */
 static int rie_test_exec(char *fmt, ...);
+static int rie_test_app_windows(rie_t *pager, uint32_t *ids, int n);
+static int rie_test_index_valid(rie_t *pager);
+static int rie_test_set_icon(rie_t *pager, uint32_t winid, uint32_t size,
+    uint32_t argb);
+static uint32_t rie_test_icon_width(rie_t *pager, uint32_t winid);
+static int rie_test_send_configure(rie_t *pager, uint32_t winid,
+    rie_rect_t *box);
 
 /* Testcases */
 static int rie_testcase_ndesktops(rie_t *pager, rie_testcase_t *tc);
@@ -97,6 +105,17 @@ static int rie_testcase_desktop_name_change(rie_t *pager, rie_testcase_t *tc);
 static int rie_testcase_window_states(rie_t *pager, rie_testcase_t *tc);
 static int rie_testcase_geometry_fallback(rie_t *pager, rie_testcase_t *tc);
 static int rie_testcase_window_change_desktop(rie_t *pager, rie_testcase_t *tc);
+static int rie_testcase_window_index(rie_t *pager, rie_testcase_t *tc);
+static int rie_testcase_configure_burst(rie_t *pager, rie_testcase_t *tc);
+static int rie_testcase_configure_mixed(rie_t *pager, rie_testcase_t *tc);
+static int rie_testcase_loop(rie_t *pager, rie_testcase_t *tc);
+static int rie_testcase_shared_icons(rie_t *pager, rie_testcase_t *tc);
+static int rie_testcase_partial_repaint(rie_t *pager, rie_testcase_t *tc);
+static int rie_testcase_text_cache(rie_t *pager, rie_testcase_t *tc);
+static int rie_testcase_skin_cache(rie_t *pager, rie_testcase_t *tc);
+static int rie_testcase_reload_icons(rie_t *pager, rie_testcase_t *tc);
+static int rie_testcase_transplant(rie_t *pager, rie_testcase_t *tc);
+static int rie_testcase_root_geometry(rie_t *pager, rie_testcase_t *tc);
 
 static rie_testcase_t rie_testcases[] = {
     { "desktops number changes", rie_testcase_ndesktops, },
@@ -107,6 +126,17 @@ static rie_testcase_t rie_testcases[] = {
     { "minimized window", rie_testcase_window_states, },
     { "geometry fallback", rie_testcase_geometry_fallback, },
     { "window desktop change", rie_testcase_window_change_desktop, },
+    { "window index", rie_testcase_window_index, },
+    { "window move burst", rie_testcase_configure_burst, },
+    { "synthetic configure burst", rie_testcase_configure_mixed, },
+    { "event loop", rie_testcase_loop, },
+    { "shared window icons", rie_testcase_shared_icons, },
+    { "partial repaint", rie_testcase_partial_repaint, },
+    { "text cache", rie_testcase_text_cache, },
+    { "skin cache", rie_testcase_skin_cache, },
+    { "reload toggles icons", rie_testcase_reload_icons, },
+    { "reload moves state", rie_testcase_transplant, },
+    { "root geometry fallback", rie_testcase_root_geometry, },
     { NULL, NULL, }
 };
 
@@ -166,6 +196,9 @@ rie_testing_thread(void *data)
 
     for (tc = rie_testcases; tc->name; tc++) {
 
+        /* reload may replace pager with a new one */
+        ctx->pager = *ctx->pagerp;
+
         if (tc->run(ctx->pager, tc) != RIE_OK) {
             tc->completed = 0;
 
@@ -904,3 +937,1062 @@ restore:
 
     return rc;
 }
+
+
+/* finds up to n running test application windows, returns their number */
+static int
+rie_test_app_windows(rie_t *pager, uint32_t *ids, int n)
+{
+    int            i, k;
+    rie_window_t  *win;
+
+    win = pager->windows.data;
+
+    for (i = 0, k = 0; i < pager->windows.nitems && k < n; i++) {
+        if (!win[i].dead && win[i].name
+            && strcmp(win[i].name, TEST_APP) == 0)
+        {
+            ids[k++] = win[i].winid;
+        }
+    }
+
+    return k;
+}
+
+
+/* every known window is found by its id in the window index */
+static int
+rie_test_index_valid(rie_t *pager)
+{
+    int            i;
+    rie_window_t  *win, *found;
+
+    win = pager->windows.data;
+
+    for (i = 0; i < pager->windows.nitems; i++) {
+
+        if (win[i].dead) {
+            continue;
+        }
+
+        found = rie_window_lookup(pager, win[i].winid);
+        if (found == NULL || found->winid != win[i].winid) {
+            rie_log_error(0, "window 0x%x is not indexed", win[i].winid);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+/* windows added, restacked and removed are found by id */
+static int
+rie_testcase_window_index(rie_t *pager, rie_testcase_t *tc)
+{
+    int       rc;
+    uint32_t  ids[2];
+
+    if (rie_test_exec(TEST_APP" & "TEST_APP" &") != RIE_OK) {
+        return RIE_ERROR;
+    }
+
+    rie_test_poll_cond(tc, rie_test_app_windows(pager, ids, 2) != 2, 2000);
+    if (rie_test_app_windows(pager, ids, 2) != 2) {
+        rie_log_error0(0, "executed "TEST_APP" windows not found");
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    if (!rie_test_index_valid(pager)) {
+        rie_tc_failed(tc);
+        rc = RIE_OK;
+        goto restore;
+    }
+
+    /* stacking order changes, list is reordered in place */
+    if (rie_test_exec("xdotool windowraise %u", ids[0]) != RIE_OK) {
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    sleep(1);
+
+    if (!rie_test_index_valid(pager)) {
+        rie_tc_failed(tc);
+        rc = RIE_OK;
+        goto restore;
+    }
+
+    if (rie_test_exec("xdotool windowkill %u", ids[1]) != RIE_OK) {
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    rie_test_poll_cond(tc, rie_window_lookup(pager, ids[1]) != NULL, 1000);
+    if (rie_window_lookup(pager, ids[1]) != NULL
+        || rie_window_lookup(pager, ids[0]) == NULL
+        || !rie_test_index_valid(pager))
+    {
+        rie_tc_failed(tc);
+        rc = RIE_OK;
+        goto restore;
+    }
+
+    tc->passed = 1;
+    rc = RIE_OK;
+
+restore:
+
+    (void) rie_test_exec("killall "TEST_APP);
+
+    return rc;
+}
+
+
+/* only the last of many queued ConfigureNotify events matters */
+static int
+rie_testcase_configure_burst(rie_t *pager, rie_testcase_t *tc)
+{
+    int            rc;
+    uint32_t       id;
+    rie_rect_t     real, *viewport;
+    xcb_window_t  *vroot;
+    rie_window_t  *win;
+
+    if (rie_test_exec(TEST_APP" &") != RIE_OK) {
+        return RIE_ERROR;
+    }
+
+    rie_test_poll_cond(tc, rie_test_app_windows(pager, &id, 1) != 1, 2000);
+    if (rie_test_app_windows(pager, &id, 1) != 1) {
+        rie_log_error0(0, "executed "TEST_APP" window not found");
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    if (rie_test_exec("for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16; do "
+                      "xdotool windowmove %u $((i * 10)) $((i * 5)); done",
+                      id)
+        != RIE_OK)
+    {
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    /* let window manager settle */
+    sleep(1);
+
+    win = rie_window_lookup(pager, id);
+    if (win == NULL) {
+        rie_tc_failed(tc);
+        rc = RIE_OK;
+        goto restore;
+    }
+
+    viewport = rie_array_get(&pager->viewports, win->desktop, rie_rect_t);
+    vroot = rie_array_get(&pager->virtual_roots, win->desktop, xcb_window_t);
+
+    if (rie_xcb_get_window_geometry(pager->xcb, &id, vroot, &real, viewport)
+        != RIE_OK)
+    {
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    rie_test_poll_cond(tc, (win = rie_window_lookup(pager, id)) == NULL
+                           || win->box.x != real.x || win->box.y != real.y,
+                       1000);
+
+    if (win == NULL || win->box.x != real.x || win->box.y != real.y) {
+        rie_tc_failed(tc);
+        rc = RIE_OK;
+        goto restore;
+    }
+
+    tc->passed = 1;
+    rc = RIE_OK;
+
+restore:
+
+    (void) rie_test_exec("killall "TEST_APP);
+
+    return rc;
+}
+
+
+/* sends ConfigureNotify with root position of window, as reparenting WM does */
+static int
+rie_test_send_configure(rie_t *pager, uint32_t winid, rie_rect_t *box)
+{
+    xcb_connection_t              *xc;
+    xcb_configure_notify_event_t   ev;
+
+    rie_memzero(&ev, sizeof(xcb_configure_notify_event_t));
+
+    ev.response_type = XCB_CONFIGURE_NOTIFY;
+    ev.event = winid;
+    ev.window = winid;
+    ev.above_sibling = XCB_NONE;
+    ev.x = box->x;
+    ev.y = box->y;
+    ev.width = box->w;
+    ev.height = box->h;
+
+    xc = rie_xcb_get_connection(pager->xcb);
+
+    /* not flushed: may be followed by requests in the same batch */
+    (void) xcb_send_event(xc, 0, winid, XCB_EVENT_MASK_STRUCTURE_NOTIFY,
+                          (const char *) &ev);
+
+    return RIE_OK;
+}
+
+
+/*
+ * synthetic ConfigureNotify followed by a real one: the former moves
+ * the frame, the latter is relative to it; neither may be dropped
+ */
+static int
+rie_testcase_configure_mixed(rie_t *pager, rie_testcase_t *tc)
+{
+    int                rc;
+    uint32_t           id, size[2];
+    rie_rect_t         real, fake, *viewport;
+    xcb_window_t      *vroot;
+    rie_window_t      *win;
+    xcb_connection_t  *xc;
+
+    if (rie_test_exec(TEST_APP" &") != RIE_OK) {
+        return RIE_ERROR;
+    }
+
+    rie_test_poll_cond(tc, rie_test_app_windows(pager, &id, 1) != 1, 2000);
+    if (rie_test_app_windows(pager, &id, 1) != 1) {
+        rie_log_error0(0, "executed "TEST_APP" window not found");
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    /* let window manager settle */
+    sleep(1);
+
+    win = rie_window_lookup(pager, id);
+    if (win == NULL) {
+        rie_tc_failed(tc);
+        rc = RIE_OK;
+        goto restore;
+    }
+
+    viewport = rie_array_get(&pager->viewports, win->desktop, rie_rect_t);
+    vroot = rie_array_get(&pager->virtual_roots, win->desktop, xcb_window_t);
+
+    if (rie_xcb_get_window_geometry(pager->xcb, &id, vroot, &real, viewport)
+        != RIE_OK)
+    {
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    /* event coordinates are relative to root, not to the viewport */
+    fake = real;
+    fake.x -= viewport ? viewport->x : 0;
+    fake.y -= viewport ? viewport->y : 0;
+
+    /* pager now believes the frame was moved away */
+    fake.x += 50;
+    fake.y += 50;
+
+    xc = rie_xcb_get_connection(pager->xcb);
+
+    (void) rie_test_send_configure(pager, id, &fake);
+    xcb_flush(xc);
+
+    sleep(1);
+
+    /* the frame is back, and the client is resized inside it */
+    fake.x -= 50;
+    fake.y -= 50;
+
+    (void) rie_test_send_configure(pager, id, &fake);
+
+    size[0] = real.w + 10;
+    size[1] = real.h + 10;
+
+    (void) xcb_configure_window(xc, id, XCB_CONFIG_WINDOW_WIDTH
+                                        | XCB_CONFIG_WINDOW_HEIGHT, size);
+    xcb_flush(xc);
+
+    /* let window manager settle */
+    sleep(1);
+
+    if (rie_xcb_get_window_geometry(pager->xcb, &id, vroot, &real, viewport)
+        != RIE_OK)
+    {
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    rie_test_poll_cond(tc, (win = rie_window_lookup(pager, id)) == NULL
+                           || win->box.x != real.x || win->box.y != real.y,
+                       1000);
+
+    if (win == NULL || win->box.x != real.x || win->box.y != real.y) {
+        rie_log_error(0, "window at %d:%d, expected %d:%d",
+                      win ? win->box.x : 0, win ? win->box.y : 0,
+                      real.x, real.y);
+        rie_tc_failed(tc);
+        rc = RIE_OK;
+        goto restore;
+    }
+
+    tc->passed = 1;
+    rc = RIE_OK;
+
+restore:
+
+    (void) rie_test_exec("killall "TEST_APP);
+
+    return rc;
+}
+
+
+typedef struct {
+    rie_loop_t         *loop;
+    rie_loop_source_t  *timer;
+    int                 fds[2];
+    uint32_t            expirations;
+    uint32_t            reads;
+    uint64_t            fired;
+} rie_test_loop_t;
+
+
+static int
+rie_test_loop_timer(void *data, uint32_t arg)
+{
+    rie_test_loop_t  *tl = data;
+
+    tl->expirations += arg;
+    tl->fired = rie_loop_msec();
+
+    /* wakes up the fd source */
+    if (write(tl->fds[1], "x", 1) != 1) {
+        rie_log_error0(errno, "write()");
+        return RIE_ERROR;
+    }
+
+    /* source removed while being dispatched */
+    rie_loop_remove(tl->loop, tl->timer);
+    tl->timer = NULL;
+
+    return RIE_OK;
+}
+
+
+static int
+rie_test_loop_fd(void *data, uint32_t arg)
+{
+    char              c;
+    rie_test_loop_t  *tl = data;
+
+    if (read(tl->fds[0], &c, 1) == 1) {
+        tl->reads++;
+    }
+
+    rie_loop_stop(tl->loop);
+
+    return RIE_OK;
+}
+
+
+/* private loop: timer fires once and wakes up descriptor source */
+static int
+rie_testcase_loop(rie_t *pager, rie_testcase_t *tc)
+{
+    int               rc;
+    uint64_t          start;
+    rie_test_loop_t   tl;
+
+    rie_memzero(&tl, sizeof(rie_test_loop_t));
+
+    if (pipe(tl.fds) == -1) {
+        rie_log_error0(errno, "pipe()");
+        return RIE_ERROR;
+    }
+
+    rc = RIE_ERROR;
+
+    tl.loop = rie_loop_new();
+    if (tl.loop == NULL) {
+        goto done;
+    }
+
+    tl.timer = rie_loop_add_timer(tl.loop, rie_test_loop_timer, &tl);
+    if (tl.timer == NULL) {
+        goto done;
+    }
+
+    if (rie_loop_add_fd(tl.loop, tl.fds[0], rie_test_loop_fd, &tl) == NULL) {
+        goto done;
+    }
+
+    start = rie_loop_msec();
+
+    if (rie_loop_timer_set(tl.timer, 50) != RIE_OK) {
+        goto done;
+    }
+
+    if (rie_loop_run(tl.loop) != RIE_OK) {
+        goto done;
+    }
+
+    rc = RIE_OK;
+
+    if (tl.expirations != 1 || tl.reads != 1 || tl.timer != NULL
+        || tl.fired - start < 50)
+    {
+        rie_tc_failed(tc);
+        goto done;
+    }
+
+    tc->passed = 1;
+
+done:
+
+    rie_loop_delete(tl.loop);
+
+    (void) close(tl.fds[0]);
+    (void) close(tl.fds[1]);
+
+    return rc;
+}
+
+
+/* sets _NET_WM_ICON of a window to a single square image of given size */
+static int
+rie_test_set_icon(rie_t *pager, uint32_t winid, uint32_t size, uint32_t argb)
+{
+    int          rc;
+    uint32_t    *data, i;
+    rie_array_t  icon;
+
+    if (rie_array_init(&icon, 2 + size * size, sizeof(uint32_t), NULL)
+        != RIE_OK)
+    {
+        return RIE_ERROR;
+    }
+
+    data = icon.data;
+
+    data[0] = size;
+    data[1] = size;
+
+    for (i = 0; i < size * size; i++) {
+        data[2 + i] = argb;
+    }
+
+    rc = rie_xcb_property_set_array(pager->xcb, winid,
+                                    rie_xcb_atom(pager->xcb, RIE_NET_WM_ICON),
+                                    XCB_ATOM_CARDINAL, &icon);
+    rie_array_wipe(&icon);
+
+    return rc;
+}
+
+
+/* width of the first fetched icon of the window, 0 if none */
+static uint32_t
+rie_test_icon_width(rie_t *pager, uint32_t winid)
+{
+    rie_image_t   *img;
+    rie_window_t  *win;
+
+    win = rie_window_lookup(pager, winid);
+    if (win == NULL || win->icons == NULL || win->icons->nitems == 0) {
+        return 0;
+    }
+
+    img = win->icons->data;
+
+    return img[0].box.w;
+}
+
+
+/* identical icons of windows of different classes are decoded once */
+static int
+rie_testcase_shared_icons(rie_t *pager, rie_testcase_t *tc)
+{
+    int            i, rc;
+    uint32_t       ids[2];
+    rie_image_t   *img[2];
+    rie_window_t  *win;
+
+    if (pager->icon_size == 0) {
+        rie_log_error0(0, "window icons are not shown");
+        return RIE_ERROR;
+    }
+
+    if (rie_test_exec(TEST_APP" & "TEST_APP" &") != RIE_OK) {
+        return RIE_ERROR;
+    }
+
+    rie_test_poll_cond(tc, rie_test_app_windows(pager, ids, 2) != 2, 2000);
+    if (rie_test_app_windows(pager, ids, 2) != 2) {
+        rie_log_error0(0, "executed "TEST_APP" windows not found");
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    /* icon is shared by pixels, class does not matter */
+    if (rie_test_exec("xdotool set_window --classname rie-test %u", ids[1])
+        != RIE_OK)
+    {
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    rie_test_poll_cond(tc, (win = rie_window_lookup(pager, ids[1])) == NULL
+                           || win->name == NULL
+                           || strcmp(win->name, "rie-test") != 0,
+                       1000);
+
+    for (i = 0; i < 2; i++) {
+        if (rie_test_set_icon(pager, ids[i], 24, 0xFF00FF00) != RIE_OK) {
+            rc = RIE_ERROR;
+            goto restore;
+        }
+    }
+
+    rie_test_poll_cond(tc, rie_test_icon_width(pager, ids[0]) != 24
+                           || rie_test_icon_width(pager, ids[1]) != 24,
+                       1000);
+
+    for (i = 0; i < 2; i++) {
+
+        if (rie_test_icon_width(pager, ids[i]) != 24) {
+            rie_tc_failed(tc);
+            rc = RIE_OK;
+            goto restore;
+        }
+
+        win = rie_window_lookup(pager, ids[i]);
+        img[i] = win->icons->data;
+    }
+
+    if (img[0]->tx != img[1]->tx) {
+        rie_tc_failed(tc);
+        rc = RIE_OK;
+        goto restore;
+    }
+
+    tc->passed = 1;
+    rc = RIE_OK;
+
+restore:
+
+    (void) rie_test_exec("killall "TEST_APP);
+
+    return rc;
+}
+
+
+/* moving a window repaints only the part of pager where it is shown */
+static int
+rie_testcase_partial_repaint(rie_t *pager, rie_testcase_t *tc)
+{
+    int         rc;
+    uint32_t    id;
+    rie_rect_t  wbox, r;
+
+    if (rie_test_exec(TEST_APP" &") != RIE_OK) {
+        return RIE_ERROR;
+    }
+
+    rie_test_poll_cond(tc, rie_test_app_windows(pager, &id, 1) != 1, 2000);
+    if (rie_test_app_windows(pager, &id, 1) != 1) {
+        rie_log_error0(0, "executed "TEST_APP" window not found");
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    /* let the pager draw new window */
+    sleep(1);
+
+    if (rie_test_exec("xdotool windowmove %u 0 0 windowmove %u 200 100",
+                      id, id)
+        != RIE_OK)
+    {
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    sleep(1);
+
+    if (rie_xcb_get_window_geometry(pager->xcb, NULL, NULL, &wbox, NULL)
+        != RIE_OK)
+    {
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    r = rie_gfx_repainted(pager->gfx);
+
+    if (r.w == 0 || r.h == 0 || r.w * r.h >= wbox.w * wbox.h) {
+        rie_log_error(0, "repainted %dx%d of %dx%d", r.w, r.h,
+                      wbox.w, wbox.h);
+        rie_tc_failed(tc);
+        rc = RIE_OK;
+        goto restore;
+    }
+
+    tc->passed = 1;
+    rc = RIE_OK;
+
+restore:
+
+    (void) rie_test_exec("killall "TEST_APP);
+
+    return rc;
+}
+
+
+/* text is shaped once per font and size, and measured from the cache */
+static int
+rie_testcase_text_cache(rie_t *pager, rie_testcase_t *tc)
+{
+    rie_fc_t     fc, big;
+    rie_gfx_t   *gc;
+    rie_rect_t   a, b, c;
+
+    /* private context: the pager one is used by the main thread */
+    gc = rie_gfx_new(pager->xcb);
+    if (gc == NULL) {
+        return RIE_ERROR;
+    }
+
+    fc = *rie_skin_font(pager->skin, RIE_FONT_DESKTOP_NAME);
+
+    big = fc;
+    big.points *= 2;
+
+    a = rie_gfx_text_bounding_box(gc, &fc, "Rieman text cache");
+    b = rie_gfx_text_bounding_box(gc, &fc, "Rieman text cache");
+
+    if (rie_gfx_text_cached(gc) != 1 || a.w == 0
+        || a.x != b.x || a.y != b.y || a.w != b.w || a.h != b.h)
+    {
+        rie_tc_failed(tc);
+        goto done;
+    }
+
+    /* same string with another size is shaped anew */
+    c = rie_gfx_text_bounding_box(gc, &big, "Rieman text cache");
+
+    if (rie_gfx_text_cached(gc) != 2 || c.w <= a.w) {
+        rie_tc_failed(tc);
+        goto done;
+    }
+
+    (void) rie_gfx_text_bounding_box(gc, &fc, "Rieman text cache, again");
+
+    if (rie_gfx_text_cached(gc) != 3) {
+        rie_tc_failed(tc);
+        goto done;
+    }
+
+    tc->passed = 1;
+
+done:
+
+    rie_gfx_delete(gc);
+
+    return RIE_OK;
+}
+
+
+/* skin files unchanged since last load are not decoded again */
+static int
+rie_testcase_skin_cache(rie_t *pager, rie_testcase_t *tc)
+{
+    int                i, rc;
+    uint64_t           hits, misses, h, m;
+    rie_skin_t        *skin[4];
+    rie_font_ctx_t    *fonts;
+    rie_skin_cache_t  *cache;
+
+    /* skin directory is looked up as ./skins/<name> */
+    static char  *dir = "./tests/skins/skin-cache";
+    static char  *name = "../tests/skins/skin-cache";
+
+    if (rie_test_exec("rm -rf %s && cp -r ./tests/skins/skin-1 %s", dir, dir)
+        != RIE_OK)
+    {
+        return RIE_ERROR;
+    }
+
+    rie_memzero(skin, sizeof(skin));
+
+    rc = RIE_ERROR;
+
+    fonts = rie_font_ctx_new();
+    cache = rie_skin_cache_new();
+
+    if (fonts == NULL || cache == NULL) {
+        goto done;
+    }
+
+    skin[0] = rie_skin_new(name, fonts, cache);
+    if (skin[0] == NULL) {
+        goto done;
+    }
+
+    rie_skin_cache_stats(cache, &hits, &misses);
+
+    skin[1] = rie_skin_new(name, fonts, cache);
+    if (skin[1] == NULL) {
+        goto done;
+    }
+
+    rie_skin_cache_stats(cache, &h, &m);
+
+    rc = RIE_OK;
+
+    if (m != misses || h <= hits) {
+        rie_tc_failed(tc);
+        goto done;
+    }
+
+    /* same size, likely the same second: only nanoseconds differ */
+    if (rie_test_exec("touch %s/missing_icon.png", dir) != RIE_OK) {
+        rc = RIE_ERROR;
+        goto done;
+    }
+
+    skin[2] = rie_skin_new(name, fonts, cache);
+    if (skin[2] == NULL) {
+        rc = RIE_ERROR;
+        goto done;
+    }
+
+    rie_skin_cache_stats(cache, &hits, &misses);
+
+    if (misses != m + 1) {
+        rie_tc_failed(tc);
+        goto done;
+    }
+
+    /* file is replaced, while timestamp and size are kept */
+    if (rie_test_exec("cp -p %s/img.png %s/img.new && mv %s/img.new %s/img.png",
+                      dir, dir, dir, dir)
+        != RIE_OK)
+    {
+        rc = RIE_ERROR;
+        goto done;
+    }
+
+    skin[3] = rie_skin_new(name, fonts, cache);
+    if (skin[3] == NULL) {
+        rc = RIE_ERROR;
+        goto done;
+    }
+
+    rie_skin_cache_stats(cache, &h, &m);
+
+    if (m != misses + 1) {
+        rie_tc_failed(tc);
+        goto done;
+    }
+
+    tc->passed = 1;
+
+done:
+
+    for (i = 0; i < 4; i++) {
+        if (skin[i]) {
+            rie_skin_delete(skin[i]);
+        }
+    }
+
+    rie_skin_cache_delete(cache);
+
+    if (fonts) {
+        rie_font_ctx_cleanup(fonts);
+    }
+
+    (void) rie_test_exec("rm -rf %s", dir);
+
+    return rc;
+}
+
+
+/*
+ * icons are disabled and enabled by reload in place; icon changed while
+ * disabled is fetched once enabled, as icon size changes
+ */
+static int
+rie_testcase_reload_icons(rie_t *pager, rie_testcase_t *tc)
+{
+    int       rc;
+    char      conf[FILENAME_MAX];
+    uint32_t  id;
+
+    if (!pager->cfg->show_window_icons) {
+        rie_log_error0(0, "window icons are not shown");
+        return RIE_ERROR;
+    }
+
+    if (snprintf(conf, FILENAME_MAX, "%s", pager->cfg->meta.conf_file)
+        >= FILENAME_MAX)
+    {
+        return RIE_ERROR;
+    }
+
+    if (rie_test_exec(TEST_APP" &") != RIE_OK) {
+        return RIE_ERROR;
+    }
+
+    rie_test_poll_cond(tc, rie_test_app_windows(pager, &id, 1) != 1, 2000);
+    if (rie_test_app_windows(pager, &id, 1) != 1) {
+        rie_log_error0(0, "executed "TEST_APP" window not found");
+        (void) rie_test_exec("killall "TEST_APP);
+        return RIE_ERROR;
+    }
+
+    if (rie_test_set_icon(pager, id, 16, 0xFFFF0000) != RIE_OK) {
+        (void) rie_test_exec("killall "TEST_APP);
+        return RIE_ERROR;
+    }
+
+    rie_test_poll_cond(tc, rie_test_icon_width(pager, id) != 16, 1000);
+
+    /* no icons at all: neither on windows, nor in minitray */
+    if (rie_test_exec("cp %s %s.orig && sed "
+                      "-e 's/^appearance.window_icon .*/"
+                      "appearance.window_icon false/' "
+                      "-e 's/^appearance.minitray .*/"
+                      "appearance.minitray false/' %s.orig > %s",
+                      conf, conf, conf, conf)
+        != RIE_OK)
+    {
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    rie_test_poll_cond(tc, pager->icon_size != 0, 2000);
+    if (pager->icon_size != 0 || pagerp != pager) {
+        /* reloaded in place, so test pager is still valid */
+        rie_tc_failed(tc);
+        rc = RIE_OK;
+        goto restore;
+    }
+
+    /* not fetched, as icons are not shown */
+    if (rie_test_set_icon(pager, id, 32, 0xFF0000FF) != RIE_OK) {
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    sleep(1);
+
+    if (rie_test_exec("mv %s.orig %s", conf, conf) != RIE_OK) {
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    rie_test_poll_cond(tc, rie_test_icon_width(pager, id) != 32, 2000);
+    if (rie_test_icon_width(pager, id) != 32 || pagerp != pager) {
+        rie_tc_failed(tc);
+        rc = RIE_OK;
+        goto restore;
+    }
+
+    tc->passed = 1;
+    rc = RIE_OK;
+
+restore:
+
+    (void) rie_test_exec("test -f %s.orig && mv %s.orig %s", conf, conf, conf);
+    (void) rie_test_exec("killall "TEST_APP);
+
+    /* do not start other tests until configuration is back */
+    rie_test_poll_cond(tc, pager->icon_size == 0, 2000);
+
+    return rc;
+}
+
+
+/* reload that needs new pager moves known windows and desktops into it */
+static int
+rie_testcase_transplant(rie_t *pager, rie_testcase_t *tc)
+{
+    int            rc;
+    char           conf[FILENAME_MAX];
+    size_t         ndesktops;
+    uint32_t       id, current;
+    rie_t         *newpager;
+    rie_rect_t     box;
+    rie_window_t  *win;
+
+    if (snprintf(conf, FILENAME_MAX, "%s", pager->cfg->meta.conf_file)
+        >= FILENAME_MAX)
+    {
+        return RIE_ERROR;
+    }
+
+    if (rie_test_exec(TEST_APP" &") != RIE_OK) {
+        return RIE_ERROR;
+    }
+
+    rie_test_poll_cond(tc, rie_test_app_windows(pager, &id, 1) != 1, 2000);
+    if (rie_test_app_windows(pager, &id, 1) != 1) {
+        rie_log_error0(0, "executed "TEST_APP" window not found");
+        (void) rie_test_exec("killall "TEST_APP);
+        return RIE_ERROR;
+    }
+
+    /* let window manager settle */
+    sleep(1);
+
+    win = rie_window_lookup(pager, id);
+    if (win == NULL) {
+        (void) rie_test_exec("killall "TEST_APP);
+        return RIE_ERROR;
+    }
+
+    /* old pager is freed by reload, only copies are compared */
+    box = win->box;
+    ndesktops = pager->desktops.nitems;
+    current = pager->current_desktop;
+
+    /* thumbnails setting cannot be changed in place */
+    if (rie_test_exec("cp %s %s.orig && "
+                      "echo 'appearance.window_thumbnails true' >> %s",
+                      conf, conf, conf)
+        != RIE_OK)
+    {
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    rie_test_poll_cond(tc, pagerp == pager, 3000);
+    if (pagerp == pager) {
+        rie_log_error0(0, "pager was not replaced");
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    newpager = pagerp;
+
+    win = rie_window_lookup(newpager, id);
+
+    if (win == NULL
+        || win->box.x != box.x || win->box.y != box.y
+        || win->box.w != box.w || win->box.h != box.h
+        || newpager->desktops.nitems != ndesktops
+        || newpager->current_desktop != current
+        || !rie_test_index_valid(newpager))
+    {
+        rie_tc_failed(tc);
+        rc = RIE_OK;
+        goto restore;
+    }
+
+    tc->passed = 1;
+    rc = RIE_OK;
+
+restore:
+
+    newpager = pagerp;
+
+    if (rie_test_exec("test -f %s.orig && mv %s.orig %s", conf, conf, conf)
+        == RIE_OK)
+    {
+        /* do not start other tests until configuration is back */
+        rie_test_poll_cond(tc, pagerp == newpager, 3000);
+    }
+
+    (void) rie_test_exec("killall "TEST_APP);
+
+    return rc;
+}
+
+
+/* without _NET_DESKTOP_GEOMETRY, desktop is as large as root window */
+static int
+rie_testcase_root_geometry(rie_t *pager, rie_testcase_t *tc)
+{
+    int           rc;
+    uint32_t     *data;
+    rie_rect_t    root;
+    rie_array_t   res, fake;
+    xcb_window_t  rootwin;
+
+    rootwin = rie_xcb_get_root(pager->xcb);
+    root = rie_xcb_root_geom(pager->xcb);
+
+    /* preserve original settings of property */
+    rie_memzero(&res, sizeof(rie_array_t));
+
+    rc = rie_xcb_property_get_array(pager->xcb, rootwin,
+                                    RIE_NET_DESKTOP_GEOMETRY,
+                                    XCB_ATOM_CARDINAL, &res);
+    if (rc != RIE_OK) {
+        return RIE_ERROR;
+    }
+
+    if (rie_array_init(&fake, 2, sizeof(uint32_t), NULL) != RIE_OK) {
+        rie_array_wipe(&res);
+        return RIE_ERROR;
+    }
+
+    /* differs from root, but still a single viewport */
+    data = fake.data;
+    data[0] = root.w + 1;
+    data[1] = root.h + 1;
+
+    rc = rie_xcb_property_set_array(pager->xcb, rootwin,
+                                    rie_xcb_atom(pager->xcb,
+                                                 RIE_NET_DESKTOP_GEOMETRY),
+                                    XCB_ATOM_CARDINAL, &fake);
+    rie_array_wipe(&fake);
+
+    if (rc != RIE_OK) {
+        goto restore;
+    }
+
+    rie_test_poll_cond(tc, pager->desktop_geom.w != root.w + 1, 1000);
+    if (pager->desktop_geom.w != root.w + 1) {
+        rie_log_error0(0, "desktop geometry change is not noticed");
+        rc = RIE_ERROR;
+        goto restore;
+    }
+
+    rc = rie_xcb_property_delete(pager->xcb, rootwin,
+                                 RIE_NET_DESKTOP_GEOMETRY);
+    if (rc != RIE_OK) {
+        goto restore;
+    }
+
+    rie_test_poll_cond(tc, pager->desktop_geom.w != root.w
+                           || pager->desktop_geom.h != root.h,
+                       1000);
+
+    if (pager->desktop_geom.w != root.w || pager->desktop_geom.h != root.h) {
+        rie_tc_failed(tc);
+        rc = RIE_OK;
+        goto restore;
+    }
+
+    tc->passed = 1;
+    rc = RIE_OK;
+
+restore:
+
+    (void) rie_xcb_property_set_array(pager->xcb, rootwin,
+                                      rie_xcb_atom(pager->xcb,
+                                                   RIE_NET_DESKTOP_GEOMETRY),
+                                      XCB_ATOM_CARDINAL, &res);
+    rie_array_wipe(&res);
+
+    return rc;
+}
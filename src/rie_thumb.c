@@ -0,0 +1,270 @@
+
+/*
+ * Copyright (C) 2017-2025 Vladimir Homutov
+ */
+
+/*
+ * This file is part of Rieman.
+ *
+ * Rieman is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Rieman is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ */
+
+
+#include "rieman.h"
+#include "rie_xcb.h"
+#include "rie_thumb.h"
+
+/*
+ * Live window thumbnails.
+ *
+ * Each shown window is tracked with a DAMAGE object.  Window contents is
+ * named as a pixmap when the window is mapped or resized, outside of frame
+ * drawing.  A snapshot is taken by scaling the pixmap on the X server into
+ * a surface of the window box size, which is then reused by all following
+ * frames.  Snapshot is retaken only if window was damaged or resized, at
+ * most thumbnail_fps times per second for each window; windows that are
+ * not mapped keep their last snapshot.
+ */
+
+static int rie_thumb_visible(rie_t *pager, rie_window_t *win);
+static int rie_thumb_refresh(rie_t *pager, rie_window_t *win, rie_rect_t *box,
+    uint64_t now);
+
+
+void
+rie_thumb_init(rie_t *pager)
+{
+    pager->thumbnails = 0;
+
+    if (!pager->cfg->show_thumbnails) {
+        return;
+    }
+
+    if (rie_xcb_enable_thumbnails(pager->xcb) != RIE_OK) {
+        rie_log("WARNING: live window thumbnails are not available");
+        return;
+    }
+
+    pager->thumbnails = 1;
+}
+
+
+void
+rie_thumb_start(rie_t *pager, rie_window_t *win)
+{
+    if (!pager->thumbnails || win->damage) {
+        return;
+    }
+
+    if (win->types & (RIE_WINDOW_TYPE_DESKTOP | RIE_WINDOW_TYPE_DOCK)) {
+        /* never drawn in pager */
+        return;
+    }
+
+    win->damage = rie_xcb_thumbnail_start(pager->xcb, win->winid);
+
+    rie_thumb_contents(pager, win);
+}
+
+
+void
+rie_thumb_stop(rie_t *pager, rie_window_t *win, int unredirect)
+{
+    if (win->damage) {
+        rie_xcb_thumbnail_stop(pager->xcb, win->winid, win->damage,
+                               unredirect);
+        win->damage = 0;
+    }
+
+    if (win->pixmap) {
+        rie_xcb_free_pixmap(pager->xcb, win->pixmap);
+        win->pixmap = 0;
+    }
+
+    if (win->thumb.tx) {
+        rie_gfx_surface_free(win->thumb.tx);
+        win->thumb.tx = NULL;
+    }
+}
+
+
+void
+rie_thumb_damaged(rie_t *pager, uint32_t winid)
+{
+    rie_window_t  *win;
+
+    win = rie_window_lookup(pager, winid);
+    if (win == NULL || win->damage == 0 || win->damaged) {
+        /* further damage is not reported until the snapshot is taken */
+        return;
+    }
+
+    win->damaged = 1;
+
+    pager->render = 1;
+}
+
+
+/*
+ * names window contents again: storage is allocated when window is mapped
+ * and reallocated when it is resized; unmapped window has no contents
+ */
+void
+rie_thumb_contents(rie_t *pager, rie_window_t *win)
+{
+    if (win->pixmap) {
+        rie_xcb_free_pixmap(pager->xcb, win->pixmap);
+        win->pixmap = 0;
+    }
+
+    if (win->damage == 0 || !win->viewable) {
+        return;
+    }
+
+    win->pixmap = rie_xcb_thumbnail_pixmap(pager->xcb, win->winid);
+    if (win->pixmap == 0) {
+        return;
+    }
+
+    win->damaged = 1;
+
+    pager->render = 1;
+}
+
+
+/* returns the latest snapshot of window contents, or NULL if none */
+rie_surface_t *
+rie_thumb_get(rie_t *pager, rie_window_t *win, rie_rect_t *box)
+{
+    uint64_t  now, due;
+
+    if (!pager->thumbnails || win->damage == 0) {
+        return NULL;
+    }
+
+    if (box->w == 0 || box->h == 0 || win->box.w == 0 || win->box.h == 0) {
+        return NULL;
+    }
+
+    if (win->thumb.tx && !win->damaged
+        && win->thumb.box.w == box->w && win->thumb.box.h == box->h)
+    {
+        return win->thumb.tx;
+    }
+
+    if (!rie_thumb_visible(pager, win)) {
+        /* contents is not available, keep whatever we have */
+        return win->thumb.tx;
+    }
+
+    now = rie_loop_msec();
+
+    due = win->thumb_time;
+    if (pager->cfg->thumbnail_fps) {
+        due += 1000 / pager->cfg->thumbnail_fps;
+    }
+
+    if (win->thumb.tx && now < due) {
+        /* throttled: come back when the earliest window is due */
+        if (pager->thumb_due == 0 || due < pager->thumb_due) {
+            pager->thumb_due = due;
+        }
+
+        return win->thumb.tx;
+    }
+
+    /* errors are not fatal: window may be unmapped at any moment */
+    (void) rie_thumb_refresh(pager, win, box, now);
+
+    return win->thumb.tx;
+}
+
+
+void
+rie_thumb_frame_done(rie_t *pager)
+{
+    uint64_t  now, delay;
+
+    if (!pager->thumbnails || pager->thumb_due == 0) {
+        return;
+    }
+
+    now = rie_loop_msec();
+    delay = (pager->thumb_due > now) ? pager->thumb_due - now : 0;
+
+    pager->thumb_due = 0;
+
+    (void) rie_loop_timer_set(pager->thumb_timer, delay);
+}
+
+
+static int
+rie_thumb_visible(rie_t *pager, rie_window_t *win)
+{
+    if (win->state & (RIE_WIN_STATE_HIDDEN | RIE_WIN_STATE_SHADED)) {
+        return 0;
+    }
+
+    return win->desktop == pager->current_desktop
+           || (win->state & RIE_WIN_STATE_STICKY);
+}
+
+
+static int
+rie_thumb_refresh(rie_t *pager, rie_window_t *win, rie_rect_t *box,
+    uint64_t now)
+{
+    rie_rect_t      src;
+    rie_surface_t  *contents, *thumb;
+
+    if (win->pixmap == 0) {
+        /* not viewable, last snapshot is kept */
+        return RIE_NOTFOUND;
+    }
+
+    src.x = 0;
+    src.y = 0;
+    src.w = win->box.w;
+    src.h = win->box.h;
+
+    /* all requests below are sent without waiting for any reply */
+
+    rie_xcb_thumbnail_reset(pager->xcb, win->damage);
+
+    win->damaged = 0;
+    win->thumb_time = now;
+
+    contents = rie_gfx_surface_from_drawable(pager->xcb, win->pixmap,
+                                             win->visual, src.w, src.h);
+    if (contents == NULL) {
+        return RIE_ERROR;
+    }
+
+    thumb = rie_gfx_surface_scale_for(pager->gfx, contents, &src,
+                                      box->w, box->h);
+
+    rie_gfx_surface_free(contents);
+
+    if (thumb == NULL) {
+        return RIE_ERROR;
+    }
+
+    if (win->thumb.tx) {
+        rie_gfx_surface_free(win->thumb.tx);
+    }
+
+    win->thumb.tx = thumb;
+    win->thumb.box = *box;
+
+    return RIE_OK;
+}
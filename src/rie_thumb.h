@@ -1,6 +1,6 @@
 
 /*
- * Copyright (C) 2017 Vladimir Homutov
+ * Copyright (C) 2017-2025 Vladimir Homutov
  */
 
 /*
@@ -19,11 +19,20 @@
  * You should have received a copy of the GNU General Public License
  */
 
-#ifndef __RIE_EXTERNAL_H__
-#define __RIE_EXTERNAL_H__
+
+#ifndef __RIE_THUMB_H__
+#define __RIE_THUMB_H__
 
 #include "rieman.h"
 
-int rie_external_get_desktop_geometry(uint32_t *w, uint32_t *h);
+void rie_thumb_init(rie_t *pager);
+
+void rie_thumb_start(rie_t *pager, rie_window_t *win);
+void rie_thumb_stop(rie_t *pager, rie_window_t *win, int unredirect);
+void rie_thumb_damaged(rie_t *pager, uint32_t winid);
+void rie_thumb_contents(rie_t *pager, rie_window_t *win);
+
+rie_surface_t *rie_thumb_get(rie_t *pager, rie_window_t *win, rie_rect_t *box);
+void rie_thumb_frame_done(rie_t *pager);
 
 #endif
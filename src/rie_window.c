@@ -21,12 +21,55 @@
 
 #include "rieman.h"
 #include "rie_xcb.h"
+#include "rie_render.h"
+#include "rie_thumb.h"
 
 #include <math.h>
 
+/* number of _NET_WM_ICON images fetched per window */
+#define RIE_WINDOW_NICONS  2
+
+/* location of a single image inside _NET_WM_ICON */
+typedef struct {
+    uint32_t         offset;
+    uint32_t         w;
+    uint32_t         h;
+} rie_window_icon_hdr_t;
+
+/* state of _NET_WM_ICON headers walk for a single window */
+typedef struct {
+    rie_window_t                *window;
+    xcb_get_property_cookie_t    cookie;      /* next header, if any */
+    uint32_t                     offset;
+    int                          n;
+    rie_window_icon_hdr_t        best[RIE_WINDOW_NICONS];
+    xcb_get_property_cookie_t    data[RIE_WINDOW_NICONS];
+} rie_window_icon_walk_t;
+
+
 static void rie_window_cleanup_winlist(void *windows, size_t nitems);
-static int rie_window_get_icon(rie_xcb_t *xcb, rie_gfx_t *gc,
-    rie_window_t *window);
+static uint32_t rie_window_hash(uint32_t winid);
+static size_t rie_window_index_size(size_t nwindows);
+static void rie_window_index_fill(rie_array_t *index, rie_array_t *windows);
+static uint32_t *rie_window_index_slot(rie_t *pager, uint32_t winid);
+static void rie_window_index_swap(uint32_t *slot, uint32_t i, uint32_t j);
+static int rie_window_reorder_list(rie_t *pager, uint32_t *ids, size_t n);
+static void rie_window_set_parent(rie_window_t *window, rie_rect_t *vp,
+    rie_rect_t *rel);
+static int rie_window_query_desktop(rie_t *pager, rie_window_t *window,
+    rie_xcb_window_cookies_t *wc);
+static int rie_window_query_reply(rie_t *pager, rie_window_t *window,
+    rie_xcb_window_cookies_t *wc);
+static int rie_window_query_icons(rie_t *pager, rie_window_t *windows,
+    rie_xcb_window_cookies_t *wc, size_t n);
+static int rie_window_text_reply(rie_xcb_t *xcb,
+    xcb_get_property_cookie_t *cookie, unsigned int property, char **text);
+static int rie_window_get_icons(rie_t *pager, rie_window_icon_walk_t *walks,
+    size_t n);
+static int rie_window_icon_header(rie_t *pager, rie_window_icon_walk_t *walk);
+static void rie_window_icon_request(rie_t *pager,
+    rie_window_icon_walk_t *walk);
+static int rie_window_icon_reply(rie_t *pager, rie_window_icon_walk_t *walk);
 static void rie_window_free_icons(void *data, size_t nitems);
 static int rie_window_center_resize(rie_t *pager, rie_window_t *win,
     rie_rect_t bb);
@@ -35,6 +78,9 @@ static int rie_windows_tile_awesome_fair(rie_t *pager, int desk,
 
 static char *rie_window_missing_name = "-";
 
+/* window index is a hash with open addressing; slots keep position + 1 */
+#define RIE_WINDEX_EMPTY  0
+
 
 int
 rie_window_init_list(rie_array_t *windows, size_t len)
@@ -67,6 +113,11 @@ rie_window_cleanup_winlist(void *windows, size_t nitems)
             free(win[i].icons);
             win[i].icons = NULL;
         }
+
+        if (win[i].thumb.tx) {
+            rie_gfx_surface_free(win[i].thumb.tx);
+            win[i].thumb.tx = NULL;
+        }
     }
 }
 
@@ -74,15 +125,102 @@ rie_window_cleanup_winlist(void *windows, size_t nitems)
 rie_window_t *
 rie_window_lookup(rie_t *pager, uint32_t winid)
 {
-    int            i;
+    uint32_t      *slot;
     rie_window_t  *win;
 
+    slot = rie_window_index_slot(pager, winid);
+    if (slot == NULL) {
+        return NULL;
+    }
+
     win = (rie_window_t *) pager->windows.data;
 
-    for (i = 0; i < pager->windows.nitems; i++) {
+    return &win[*slot - 1];
+}
+
+
+static uint32_t
+rie_window_hash(uint32_t winid)
+{
+    /* X resource ids of a single client differ in low bits only */
+    winid ^= winid >> 16;
+    winid *= 0x45d9f3b;
+    winid ^= winid >> 16;
+
+    return winid;
+}
 
-        if (win[i].winid == winid) {
-            return &win[i];
+
+static size_t
+rie_window_index_size(size_t nwindows)
+{
+    size_t  size;
+
+    /* power of two, keep load factor below 0.5 */
+    for (size = 16; size < nwindows * 2; size <<= 1) {
+        /* void */
+    }
+
+    return size;
+}
+
+
+static void
+rie_window_index_fill(rie_array_t *index, rie_array_t *windows)
+{
+    uint32_t       i, h, mask, *slots;
+    rie_window_t  *win;
+
+    slots = index->data;
+    mask = index->nitems - 1;
+    win = windows->data;
+
+    rie_memzero(slots, index->nitems * sizeof(uint32_t));
+
+    for (i = 0; i < windows->nitems; i++) {
+
+        if (win[i].winid == 0) {
+            /* query failed before window id was set */
+            continue;
+        }
+
+        for (h = rie_window_hash(win[i].winid) & mask;
+             slots[h] != RIE_WINDEX_EMPTY;
+             h = (h + 1) & mask)
+        {
+            if (win[slots[h] - 1].winid == win[i].winid) {
+                /* duplicate, first one is found as with linear search */
+                break;
+            }
+        }
+
+        if (slots[h] == RIE_WINDEX_EMPTY) {
+            slots[h] = i + 1;
+        }
+    }
+}
+
+
+static uint32_t *
+rie_window_index_slot(rie_t *pager, uint32_t winid)
+{
+    uint32_t       h, mask, *slots;
+    rie_window_t  *win;
+
+    if (pager->windex.data == NULL || winid == 0) {
+        return NULL;
+    }
+
+    slots = pager->windex.data;
+    mask = pager->windex.nitems - 1;
+    win = pager->windows.data;
+
+    for (h = rie_window_hash(winid) & mask;
+         slots[h] != RIE_WINDEX_EMPTY;
+         h = (h + 1) & mask)
+    {
+        if (win[slots[h] - 1].winid == winid) {
+            return &slots[h];
         }
     }
 
@@ -94,25 +232,145 @@ int
 rie_window_update_geometry(rie_t *pager)
 {
     int            i, rc;
-    rie_rect_t    *vp;
+    rie_rect_t    *vp, rel;
     rie_window_t  *win;
     xcb_window_t  *root;
 
+    rie_xcb_window_cookies_t  *wc;
+
+    if (pager->windows.nitems == 0) {
+        return RIE_OK;
+    }
+
+    wc = malloc(pager->windows.nitems * sizeof(rie_xcb_window_cookies_t));
+    if (wc == NULL) {
+        rie_log_error0(errno, "malloc");
+        return RIE_ERROR;
+    }
+
+    rie_memzero(wc, pager->windows.nitems * sizeof(rie_xcb_window_cookies_t));
+
     win = pager->windows.data;
 
     for (i = 0; i < pager->windows.nitems; i++) {
 
-        vp = rie_array_get(&pager->viewports, win[i].desktop, rie_rect_t);
         root = rie_array_get(&pager->virtual_roots, win[i].desktop,
                              xcb_window_t);
 
-        rc = rie_xcb_get_window_geometry(pager->xcb, &win[i].winid, root,
-                                         &win[i].box, vp);
+        rie_xcb_window_geometry_request(pager->xcb, win[i].winid, *root,
+                                        &wc[i].geometry, &wc[i].translate);
+    }
+
+    rc = RIE_OK;
+
+    for (i = 0; i < pager->windows.nitems; i++) {
+
+        if (rc != RIE_OK) {
+            rie_xcb_window_query_discard(pager->xcb, &wc[i]);
+            continue;
+        }
+
+        vp = rie_array_get(&pager->viewports, win[i].desktop, rie_rect_t);
+
+        rc = rie_xcb_window_geometry_reply(pager->xcb, &wc[i].geometry,
+                                           &wc[i].translate, &win[i].box, vp,
+                                           &rel);
         if (rc != RIE_OK) {
-            return rc;
+            rie_xcb_window_query_discard(pager->xcb, &wc[i]);
+            continue;
+        }
+
+        rie_window_set_parent(&win[i], vp, &rel);
+    }
+
+    free(wc);
+
+    return rc;
+}
+
+
+/* remembers where window parent is, to follow moves without querying X */
+static void
+rie_window_set_parent(rie_window_t *window, rie_rect_t *vp, rie_rect_t *rel)
+{
+    window->rel = *rel;
+
+    window->parent.x = window->box.x - rel->x - (vp ? vp->x : 0);
+    window->parent.y = window->box.y - rel->y - (vp ? vp->y : 0);
+
+    window->parent_known = 1;
+}
+
+
+/*
+ * Updates window position using ConfigureNotify data: box is relative to
+ * the parent for real events, and to the root for synthetic events sent
+ * by reparenting window manager when frame is moved (ICCCM 4.1.5).
+ * X server is queried only if position of the parent is unknown.
+ */
+int
+rie_window_update_position(rie_t *pager, rie_window_t *window,
+    rie_rect_t *box, uint32_t border, uint8_t synthetic)
+{
+    int            x, y, rc;
+    rie_rect_t    *vp, rel;
+    xcb_window_t  *root;
+
+    xcb_get_geometry_cookie_t           geometry;
+    xcb_translate_coordinates_cookie_t  translate;
+
+    vp = rie_array_get(&pager->viewports, window->desktop, rie_rect_t);
+    root = rie_array_get(&pager->virtual_roots, window->desktop, xcb_window_t);
+
+    x = box->x + border;
+    y = box->y + border;
+
+    if (synthetic) {
+
+        if (*root != rie_xcb_get_root(pager->xcb)) {
+            /* coordinates are not relative to the virtual root */
+            goto query;
+        }
+
+        if (window->parent_known) {
+            /* window stays inside the frame, while the frame moves */
+            window->parent.x = x - window->rel.x;
+            window->parent.y = y - window->rel.y;
+        }
+
+    } else {
+
+        if (!window->parent_known) {
+            goto query;
         }
+
+        window->rel.x = x;
+        window->rel.y = y;
+
+        x += window->parent.x;
+        y += window->parent.y;
     }
 
+    window->box.x = x + (vp ? vp->x : 0);
+    window->box.y = y + (vp ? vp->y : 0);
+    window->box.w = box->w;
+    window->box.h = box->h;
+
+    return RIE_OK;
+
+query:
+
+    rie_xcb_window_geometry_request(pager->xcb, window->winid, *root,
+                                    &geometry, &translate);
+
+    rc = rie_xcb_window_geometry_reply(pager->xcb, &geometry, &translate,
+                                       &window->box, vp, &rel);
+    if (rc != RIE_OK) {
+        return rc;
+    }
+
+    rie_window_set_parent(window, vp, &rel);
+
     return RIE_OK;
 }
 
@@ -120,51 +378,455 @@ rie_window_update_geometry(rie_t *pager)
 int
 rie_window_query(rie_t *pager, rie_window_t *window, uint32_t winid)
 {
-    int    rc;
-    char  *textres;
+    int                       rc;
+    rie_xcb_window_cookies_t  wc;
+
+    rie_xcb_window_query_send(pager->xcb, &wc, winid,
+                              rie_render_icon_size(pager) != 0);
+
+    rc = rie_window_query_desktop(pager, window, &wc);
+
+    if (rc == RIE_OK) {
+        rc = rie_window_query_reply(pager, window, &wc);
+    }
+
+    if (rc == RIE_OK) {
+        rc = rie_window_query_icons(pager, window, &wc, 1);
+    }
+
+    rie_xcb_window_query_discard(pager->xcb, &wc);
+
+    return rc;
+}
+
+
+/*
+ * Queries a list of windows: requests for all windows are sent first,
+ * and replies are collected afterwards. Thus the whole list costs a couple
+ * of round-trips instead of a dozen round-trips per window.
+ *
+ * Windows that cannot be queried are marked dead.
+ */
+int
+rie_window_query_list(rie_t *pager, rie_window_t *windows, uint32_t *ids,
+    size_t n)
+{
+    int  i, rc, icons;
+
+    rie_xcb_window_cookies_t  *wc;
+
+    if (n == 0) {
+        return RIE_OK;
+    }
+
+    wc = malloc(n * sizeof(rie_xcb_window_cookies_t));
+    if (wc == NULL) {
+        rie_log_error0(errno, "malloc");
+        return RIE_ERROR;
+    }
+
+    icons = (rie_render_icon_size(pager) != 0);
+
+    for (i = 0; i < n; i++) {
+        rie_xcb_window_query_send(pager->xcb, &wc[i], ids[i], icons);
+    }
+
+    /* desktop is required to send coordinates translation request */
+    for (i = 0; i < n; i++) {
+
+        rc = rie_window_query_desktop(pager, &windows[i], &wc[i]);
+
+        if (rc == RIE_ERROR) {
+            goto failed;
+        }
+
+        if (rc == RIE_NOTFOUND) {
+            /* we failed to obtain information about this window, ignore it */
+            rie_xcb_window_query_discard(pager->xcb, &wc[i]);
+            windows[i].dead = 1;
+            windows[i].desktop = 0;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+
+        if (windows[i].dead) {
+            continue;
+        }
+
+        rc = rie_window_query_reply(pager, &windows[i], &wc[i]);
+
+        if (rc == RIE_ERROR) {
+            goto failed;
+        }
+
+        if (rc == RIE_NOTFOUND) {
+            rie_xcb_window_query_discard(pager->xcb, &wc[i]);
+            windows[i].dead = 1;
+            windows[i].desktop = 0;
+        }
+    }
+
+    rc = rie_window_query_icons(pager, windows, wc, n);
+    if (rc != RIE_OK) {
+        goto failed;
+    }
+
+    free(wc);
+
+    return RIE_OK;
+
+failed:
+
+    for (i = 0; i < n; i++) {
+        rie_xcb_window_query_discard(pager->xcb, &wc[i]);
+    }
+
+    free(wc);
+
+    return RIE_ERROR;
+}
+
+
+/*
+ * Brings the list of windows in sync with the new stacking order:
+ * known windows keep their data and are only moved, new windows
+ * are queried, and windows that are gone are released.
+ */
+int
+rie_window_update_list(rie_t *pager, uint32_t *ids, size_t n)
+{
+    int            i, j, k, rc, *src;
+    size_t         nfresh;
+    uint32_t      *fresh_ids, *slot;
+    rie_array_t    winlist, fresh, windex, old;
+    rie_window_t  *win, *nwin, *fwin;
+
+    /* points into the list being modified, will be updated by caller */
+    pager->fwindow = NULL;
+
+    if (rie_window_reorder_list(pager, ids, n) == RIE_OK) {
+        return RIE_OK;
+    }
+
+    src = malloc(n * (sizeof(int) + sizeof(uint32_t)));
+    if (src == NULL) {
+        rie_log_error0(errno, "malloc");
+        return RIE_ERROR;
+    }
+
+    fresh_ids = (uint32_t *) (src + n);
+
+    /* map each window of a new list to its position in the old list */
+
+    win = pager->windows.data;
+    nfresh = 0;
+
+    for (i = 0; i < n; i++) {
+
+        src[i] = -1;
+
+        slot = rie_window_index_slot(pager, ids[i]);
+
+        if (slot && !win[*slot - 1].dead) {
+            src[i] = *slot - 1;
+        }
+
+        if (src[i] == -1) {
+            fresh_ids[nfresh++] = ids[i];
+        }
+    }
+
+    rc = rie_window_init_list(&fresh, nfresh);
+    if (rc != RIE_OK) {
+        free(src);
+        return RIE_ERROR;
+    }
+
+    rc = rie_window_query_list(pager, fresh.data, fresh_ids, nfresh);
+    if (rc != RIE_OK) {
+        rie_array_wipe(&fresh);
+        free(src);
+        return RIE_ERROR;
+    }
+
+    rc = rie_window_init_list(&winlist, n);
+    if (rc != RIE_OK) {
+        rie_array_wipe(&fresh);
+        free(src);
+        return RIE_ERROR;
+    }
+
+    rc = rie_array_init(&windex, rie_window_index_size(n), sizeof(uint32_t),
+                        NULL);
+    if (rc != RIE_OK) {
+        rie_array_wipe(&winlist);
+        rie_array_wipe(&fresh);
+        free(src);
+        return RIE_ERROR;
+    }
+
+    /* nothing may fail since now: move items, ownership goes with them */
+
+    nwin = winlist.data;
+    fwin = fresh.data;
+
+    for (i = 0, k = 0; i < n; i++) {
+
+        if (src[i] == -1) {
+            nwin[i] = fwin[k];
+            rie_memzero(&fwin[k], sizeof(rie_window_t));
+            k++;
+            continue;
+        }
+
+        if (win[src[i]].winid != ids[i]) {
+            /* duplicate in the list, original is already moved */
+            nwin[i].dead = 1;
+            continue;
+        }
+
+        nwin[i] = win[src[i]];
+        rie_memzero(&win[src[i]], sizeof(rie_window_t));
+    }
+
+    rie_array_wipe(&fresh);
+    free(src);
+
+    old = pager->windows;
+
+    pager->windows = winlist;
+
+    rie_window_index_fill(&windex, &pager->windows);
+
+    if (pager->windex.data != NULL) {
+        rie_array_wipe(&pager->windex);
+    }
+
+    pager->windex = windex;
+
+    /* releases windows that are gone */
+    if (old.data != NULL) {
+
+        for (j = 0; j < old.nitems; j++) {
+            /*
+             * dead entry may share id with a window just queried again:
+             * its redirection is already taken over by the new entry
+             */
+            rie_thumb_stop(pager, &win[j],
+                           rie_window_lookup(pager, win[j].winid) == NULL);
+        }
+
+        rie_array_wipe(&old);
+    }
+
+    return RIE_OK;
+}
+
+
+static void
+rie_window_index_swap(uint32_t *slot, uint32_t i, uint32_t j)
+{
+    if (*slot == i + 1) {
+        *slot = j + 1;
+
+    } else if (*slot == j + 1) {
+        *slot = i + 1;
+    }
+}
+
+
+/* restacking of known windows only: order is updated in place */
+static int
+rie_window_reorder_list(rie_t *pager, uint32_t *ids, size_t n)
+{
+    int            i, j;
+    uint32_t      *si, *sj;
+    rie_window_t  *win;
+
+    if (pager->windows.data == NULL || pager->windows.nitems != n) {
+        return RIE_NOTFOUND;
+    }
+
+    win = pager->windows.data;
+
+    for (i = 0; i < n; i++) {
+
+        sj = rie_window_index_slot(pager, ids[i]);
+        if (sj == NULL) {
+            /* list is still valid, just partially reordered */
+            return RIE_NOTFOUND;
+        }
+
+        j = *sj - 1;
+
+        if (j < i || win[j].dead) {
+            /* duplicate or dead, left to the full update */
+            return RIE_NOTFOUND;
+        }
+
+        if (j == i) {
+            continue;
+        }
+
+        /* index follows the windows being swapped */
+        si = rie_window_index_slot(pager, win[i].winid);
+        sj = rie_window_index_slot(pager, win[j].winid);
+
+        if (si == sj) {
+            /* same id (one is dead), slot points to one of them */
+            sj = NULL;
+        }
+
+        if (si) {
+            rie_window_index_swap(si, i, j);
+        }
 
-    rie_xcb_t     *xcb;
-    rie_rect_t    *vp;
+        if (sj) {
+            rie_window_index_swap(sj, i, j);
+        }
+
+        rie_swap(win[i], win[j], rie_window_t);
+    }
+
+    return RIE_OK;
+}
+
+
+static int
+rie_window_query_desktop(rie_t *pager, rie_window_t *window,
+    rie_xcb_window_cookies_t *wc)
+{
+    int            rc;
     xcb_window_t  *root;
 
+    rc = rie_xcb_property_reply(pager->xcb, &wc->desktop, RIE_NET_WM_DESKTOP,
+                                XCB_ATOM_CARDINAL, &window->desktop);
+    if (rc != RIE_OK) {
+        return rc;
+    }
+
+    root = rie_array_get(&pager->virtual_roots, window->desktop, xcb_window_t);
+
+    rie_xcb_window_geometry_request(pager->xcb, wc->win, *root,
+                                    &wc->geometry, &wc->translate);
+
+    return RIE_OK;
+}
+
+
+static int
+rie_window_query_reply(rie_t *pager, rie_window_t *window,
+    rie_xcb_window_cookies_t *wc)
+{
+    int  rc;
+
+    rie_xcb_t   *xcb;
+    rie_rect_t  *vp, rel;
+
     xcb = pager->xcb;
 
-    rc = rie_xcb_property_get(xcb, winid, RIE_NET_WM_DESKTOP,
-                              XCB_ATOM_CARDINAL, &window->desktop);
+    vp = rie_array_get(&pager->viewports, window->desktop, rie_rect_t);
+
+    rc = rie_xcb_window_geometry_reply(xcb, &wc->geometry, &wc->translate,
+                                       &window->box, vp, &rel);
     if (rc != RIE_OK) {
         return rc;
     }
 
-    vp = rie_array_get(&pager->viewports, window->desktop, rie_rect_t);
-    root = rie_array_get(&pager->virtual_roots, window->desktop, xcb_window_t);
+    rie_window_set_parent(window, vp, &rel);
 
-    rc = rie_xcb_get_window_geometry(xcb, &winid, root, &window->box, vp);
+    rc = rie_xcb_window_frame_reply(xcb, &wc->frame, &window->frame);
     if (rc != RIE_OK) {
         return rc;
     }
 
-    rc = rie_xcb_get_window_frame(pager->xcb, winid, &window->frame);
+    window->winid = wc->win;
+
+    rc = rie_window_text_reply(xcb, &wc->title, RIE_NET_WM_NAME,
+                               &window->title);
     if (rc != RIE_OK) {
         return rc;
     }
 
-    window->winid = winid;
+    rc = rie_window_text_reply(xcb, &wc->name, RIE_WM_CLASS, &window->name);
+    if (rc != RIE_OK) {
+        return rc;
+    }
 
-    rc = rie_xcb_property_get_utftext(xcb, winid, RIE_NET_WM_NAME, &textres);
+    rc = rie_xcb_window_type_reply(xcb, &wc->type, window);
     if (rc == RIE_ERROR) {
         return RIE_ERROR;
 
-    } else  if (rc != RIE_OK) {
-        textres = rie_window_missing_name; /* property is unset */
+    } else if (rc == RIE_NOTFOUND) {
+        window->types = 0;
     }
 
-    if (window->title && window->title != rie_window_missing_name) {
-        free(window->title);
+    rc = rie_xcb_window_state_reply(xcb, &wc->state, window);
+    if (rc == RIE_ERROR) {
+        return RIE_ERROR;
     }
 
-    window->title = textres;
+    /* we want to receive events about this window changes */
+    rie_xcb_event_mask_reply(xcb, &wc->attrs, wc->win, SubstructureNotifyMask
+                                                       | StructureNotifyMask
+                                                       | PropertyChangeMask,
+                             &window->visual, &window->viewable);
+
+    /* result is ignored, as window may not exist */
+
+    rie_thumb_start(pager, window);
+
+    return RIE_OK;
+}
+
+
+/* collects icons of queried windows, see rie_window_get_icons() */
+static int
+rie_window_query_icons(rie_t *pager, rie_window_t *windows,
+    rie_xcb_window_cookies_t *wc, size_t n)
+{
+    int     rc;
+    size_t  i, k;
+
+    rie_window_icon_walk_t  *walks;
+
+    walks = calloc(n, sizeof(rie_window_icon_walk_t));
+    if (walks == NULL) {
+        rie_log_error0(errno, "calloc");
+        return RIE_ERROR;
+    }
+
+    for (i = 0, k = 0; i < n; i++) {
+
+        if (windows[i].dead || wc[i].icon.sequence == 0) {
+            /* icons are not shown */
+            continue;
+        }
+
+        walks[k].window = &windows[i];
+        walks[k].cookie = wc[i].icon;
+        wc[i].icon.sequence = 0;
+        k++;
+    }
+
+    rc = rie_window_get_icons(pager, walks, k);
+
+    free(walks);
+
+    return rc;
+}
+
+
+/* replaces title or name of the window with the current property value */
+static int
+rie_window_text_reply(rie_xcb_t *xcb, xcb_get_property_cookie_t *cookie,
+    unsigned int property, char **text)
+{
+    int    rc;
+    char  *textres;
 
-    rc = rie_xcb_property_get_utftext(xcb, winid, RIE_WM_CLASS, &textres);
+    rc = rie_xcb_property_reply_utftext(xcb, cookie, property, &textres);
     if (rc == RIE_ERROR) {
         return RIE_ERROR;
 
@@ -172,33 +834,111 @@ rie_window_query(rie_t *pager, rie_window_t *window, uint32_t winid)
         textres = rie_window_missing_name; /* property is unset */
     }
 
-    if (window->name && window->name != rie_window_missing_name) {
-        free(window->name);
+    if (*text && *text != rie_window_missing_name) {
+        free(*text);
     }
 
-    window->name = textres;
+    *text = textres;
 
-    rc = rie_window_get_icon(xcb, pager->gfx, window);
-    if (rc != RIE_OK) {
-        return rc;
+    return RIE_OK;
+}
+
+
+int
+rie_window_update_title(rie_t *pager, rie_window_t *window)
+{
+    xcb_get_property_cookie_t  cookie;
+
+    cookie = rie_xcb_property_request(pager->xcb, window->winid,
+                                      RIE_NET_WM_NAME,
+                                      XCB_GET_PROPERTY_TYPE_ANY);
+
+    return rie_window_text_reply(pager->xcb, &cookie, RIE_NET_WM_NAME,
+                                 &window->title);
+}
+
+
+int
+rie_window_update_name(rie_t *pager, rie_window_t *window)
+{
+    xcb_get_property_cookie_t  cookie;
+
+    cookie = rie_xcb_property_request(pager->xcb, window->winid,
+                                      RIE_WM_CLASS,
+                                      XCB_GET_PROPERTY_TYPE_ANY);
+
+    return rie_window_text_reply(pager->xcb, &cookie, RIE_WM_CLASS,
+                                 &window->name);
+}
+
+
+int
+rie_window_update_icon(rie_t *pager, rie_window_t *window)
+{
+    rie_window_icon_walk_t  walk;
+
+    if (rie_render_icon_size(pager) == 0) {
+        return RIE_OK;
     }
 
-    rc = rie_xcb_get_window_type(pager->xcb, window, winid);
-    if (rc == RIE_ERROR) {
+    rie_memzero(&walk, sizeof(rie_window_icon_walk_t));
+
+    walk.window = window;
+    walk.cookie = rie_xcb_property_request_range(pager->xcb, window->winid,
+                                                 RIE_NET_WM_ICON,
+                                                 XCB_ATOM_CARDINAL, 0, 2);
+
+    return rie_window_get_icons(pager, &walk, 1);
+}
+
+
+/* refetches icons of all windows for the size pager currently draws */
+int
+rie_window_update_icons(rie_t *pager)
+{
+    int      rc;
+    size_t   i, k, n;
+
+    rie_window_t            *win;
+    rie_window_icon_walk_t  *walks;
+
+    pager->icon_size = rie_render_icon_size(pager);
+
+    n = pager->windows.nitems;
+
+    if (pager->icon_size == 0 || n == 0) {
+        /* icons that are already fetched are just not drawn */
+        return RIE_OK;
+    }
+
+    walks = calloc(n, sizeof(rie_window_icon_walk_t));
+    if (walks == NULL) {
+        rie_log_error0(errno, "calloc");
         return RIE_ERROR;
+    }
 
-    } else if (rc == RIE_NOTFOUND) {
-        window->types = 0;
+    win = pager->windows.data;
+
+    for (i = 0, k = 0; i < n; i++) {
+
+        if (win[i].dead) {
+            continue;
+        }
+
+        walks[k].window = &win[i];
+        walks[k].cookie = rie_xcb_property_request_range(pager->xcb,
+                                                         win[i].winid,
+                                                         RIE_NET_WM_ICON,
+                                                         XCB_ATOM_CARDINAL,
+                                                         0, 2);
+        k++;
     }
 
-    /* we want to receive events about this window changes */
-    (void) rie_xcb_update_event_mask(xcb, winid, SubstructureNotifyMask
-                                                 | StructureNotifyMask
-                                                 | PropertyChangeMask);
+    rc = rie_window_get_icons(pager, walks, k);
 
-    /* result is ignored, as window may not exist */
+    free(walks);
 
-    return RIE_OK;
+    return rc;
 }
 
 
@@ -239,65 +979,229 @@ rie_window_update_pager_focus(rie_t *pager)
 }
 
 
+/*
+ * walks over headers of all images in _NET_WM_ICON, transferring only
+ * their sizes; then pixels are fetched just for the two images closest
+ * to the largest size pager may draw: the smallest one that is not
+ * smaller, and the largest one that is smaller
+ *
+ * all windows are walked in lockstep: each step sends requests for the
+ * next header of every window before waiting for any reply, so the walk
+ * costs as many round-trips as the longest list of images, not the total
+ */
 static int
-rie_window_get_icon(rie_xcb_t *xcb, rie_gfx_t *gc, rie_window_t *window)
+rie_window_get_icons(rie_t *pager, rie_window_icon_walk_t *walks, size_t n)
 {
-    int        rc, i;
-    uint32_t  *data, *last;
+    int     rc, pending;
+    size_t  i, j;
+
+    rie_xcb_t  *xcb;
+
+    xcb = pager->xcb;
+
+    do {
+        pending = 0;
+
+        for (i = 0; i < n; i++) {
+
+            if (walks[i].cookie.sequence == 0) {
+                continue;
+            }
+
+            if (rie_window_icon_header(pager, &walks[i]) != RIE_OK) {
+                goto failed;
+            }
+
+            if (walks[i].cookie.sequence) {
+                pending = 1;
+            }
+        }
+
+    } while (pending);
+
+    for (i = 0; i < n; i++) {
+        rie_window_icon_request(pager, &walks[i]);
+    }
+
+    for (i = 0; i < n; i++) {
+        rc = rie_window_icon_reply(pager, &walks[i]);
+        if (rc == RIE_ERROR) {
+            goto failed;
+        }
+    }
+
+    return RIE_OK;
+
+failed:
+
+    for (i = 0; i < n; i++) {
+        rie_xcb_property_discard(xcb, &walks[i].cookie);
+
+        for (j = 0; j < walks[i].n; j++) {
+            rie_xcb_property_discard(xcb, &walks[i].data[j]);
+        }
+    }
+
+    return RIE_ERROR;
+}
+
 
-    rie_array_t   res, *icons;
-    rie_image_t  *img;
+/* handles next image header, requesting one more if the list continues */
+static int
+rie_window_icon_header(rie_t *pager, rie_window_icon_walk_t *walk)
+{
+    int        rc;
+    uint32_t   size, w, h, left, len, dim;
 
-    rie_memzero(&res, sizeof(rie_array_t));
+    rie_window_icon_hdr_t  *best;
 
-    rc = rie_xcb_property_get_array(xcb, window->winid, RIE_NET_WM_ICON,
-                                    XCB_ATOM_CARDINAL, &res);
+    rc = rie_xcb_icon_header_reply(pager->xcb, &walk->cookie, &w, &h, &left);
     if (rc == RIE_ERROR) {
         return RIE_ERROR;
 
-    } else if (rc == RIE_NOTFOUND) {
-        /* ignore missing icons */
+    } else if (rc != RIE_OK) {
+        return RIE_OK;
+    }
+
+    len = w * h;
+
+    if (w == 0 || h == 0 || w > 0xFFFF || h > 0xFFFF || len > left) {
+        /* malformed, use what was found so far */
         return RIE_OK;
     }
 
-    data = res.data;
-    last = ((uint32_t *) res.data) + res.nitems;
+    size = rie_render_icon_size(pager);
+    best = walk->best;
+
+    dim = rie_max(w, h);
+
+    if (dim >= size) {
+        if (best[0].w == 0 || dim < rie_max(best[0].w, best[0].h)) {
+            best[0].offset = walk->offset;
+            best[0].w = w;
+            best[0].h = h;
+        }
+
+    } else if (best[1].w == 0 || dim > rie_max(best[1].w, best[1].h)) {
+        best[1].offset = walk->offset;
+        best[1].w = w;
+        best[1].h = h;
+    }
+
+    if (left - len < 2) {
+        /* last image */
+        return RIE_OK;
+    }
+
+    walk->offset += 2 + len;
+
+    walk->cookie = rie_xcb_property_request_range(pager->xcb,
+                                                  walk->window->winid,
+                                                  RIE_NET_WM_ICON,
+                                                  XCB_ATOM_CARDINAL,
+                                                  walk->offset, 2);
+    return RIE_OK;
+}
+
+
+/* requests pixels of images selected by the walk */
+static void
+rie_window_icon_request(rie_t *pager, rie_window_icon_walk_t *walk)
+{
+    int  i;
+
+    rie_window_icon_hdr_t  *best;
+
+    best = walk->best;
+
+    for (walk->n = 0, i = 0; i < RIE_WINDOW_NICONS; i++) {
+        if (best[i].w) {
+            best[walk->n++] = best[i];
+        }
+    }
+
+    for (i = 0; i < walk->n; i++) {
+        walk->data[i] = rie_xcb_property_request_range(pager->xcb,
+                                                       walk->window->winid,
+                                                       RIE_NET_WM_ICON,
+                                                       XCB_ATOM_CARDINAL,
+                                                       best[i].offset + 2,
+                                                       best[i].w * best[i].h);
+    }
+}
+
+
+static int
+rie_window_icon_reply(rie_t *pager, rie_window_icon_walk_t *walk)
+{
+    int        rc, i, n;
+
+    rie_xcb_t              *xcb;
+    rie_array_t             res, *icons;
+    rie_image_t            *img;
+    rie_window_t           *window;
+    rie_window_icon_hdr_t  *best;
 
-    /* calculate number of icons in array */
-    for (i = 0; data < (last - 2); i++) {
-        data += 2 + data[0] * data[1]; /* width, height, pixels[] */
+    n = walk->n;
+
+    if (n == 0) {
+        /* ignore missing icons */
+        return RIE_OK;
     }
 
+    xcb = pager->xcb;
+    best = walk->best;
+    window = walk->window;
+
+    rc = RIE_ERROR;
+
     icons = malloc(sizeof(rie_array_t));
     if (icons == NULL) {
         rie_log_error0(errno, "malloc");
-        rie_array_wipe(&res);
-        return RIE_ERROR;
+        goto failed;
     }
 
     /* new per-window icons array */
-    if (rie_array_init(icons, i, sizeof(rie_image_t), rie_window_free_icons)
+    if (rie_array_init(icons, n, sizeof(rie_image_t), rie_window_free_icons)
         != RIE_OK)
     {
-        return RIE_ERROR;
+        free(icons);
+        goto failed;
     }
 
-    data = res.data;
     img = icons->data;
 
-    for (i = 0; i < icons->nitems; i++) {
-        img[i].box.w = data[0];
-        img[i].box.h = data[1];
+    for (i = 0; i < n; i++) {
 
-        img[i].tx = rie_gfx_surface_from_icon(gc, &data[2], data[0], data[1]);
-        if (img[i].tx == NULL) {
+        rc = rie_xcb_property_reply_array(xcb, &walk->data[i], RIE_NET_WM_ICON,
+                                          XCB_ATOM_CARDINAL, &res);
+        if (rc != RIE_OK) {
+            rie_array_wipe(icons);
+            free(icons);
             goto failed;
         }
 
-        data += 2 + data[0] * data[1];
-    }
+        if (res.nitems == best[i].w * best[i].h) {
+            /* else property has changed meanwhile */
 
-    rie_array_wipe(&res);
+            img[i].box.w = best[i].w;
+            img[i].box.h = best[i].h;
+
+            img[i].tx = rie_icon_cache_get(pager->icons, pager->gfx,
+                                           res.data, best[i].w, best[i].h,
+                                           window->name);
+        }
+
+        rie_array_wipe(&res);
+
+        if (img[i].tx == NULL) {
+            /* no icons at all is better than an empty one */
+            rie_array_wipe(icons);
+            free(icons);
+            rc = RIE_NOTFOUND;
+            goto failed;
+        }
+    }
 
     /* replace old array with a new one, deallocating old */
     if (window->icons) {
@@ -311,11 +1215,12 @@ rie_window_get_icon(rie_xcb_t *xcb, rie_gfx_t *gc, rie_window_t *window)
 
 failed:
 
-    rie_array_wipe(&res);
-    rie_array_wipe(icons);
-    free(icons);
+    for (i = 0; i < n; i++) {
+        rie_xcb_property_discard(xcb, &walk->data[i]);
+    }
 
-    return RIE_OK;
+    /* window may disappear or change its icon meanwhile, this is fine */
+    return (rc == RIE_ERROR) ? RIE_ERROR : RIE_OK;
 }
 
 
@@ -35,6 +35,8 @@ struct  rie_window_s {
     rie_rect_t       sbox;       /* scaled window inside pager    */
     rie_rect_t       hbox;       /* box of a hidden window on pad */
     rie_rect_t       frame;      /* window manager decorations (real) */
+    rie_rect_t       rel;        /* window origin inside parent */
+    rie_rect_t       parent;     /* parent origin (real), x/y only */
 
     char            *name;
     char            *title;
@@ -46,7 +48,16 @@ struct  rie_window_s {
     uint8_t          focused;
     uint8_t          m_in;       /* mouse is over window *in pager* */
     uint8_t          dead;
+    uint8_t          parent_known; /* rel/parent are valid */
     rie_array_t     *icons;
+
+    uint32_t         visual;     /* for live thumbnail */
+    uint8_t          viewable;   /* mapped, contents may be named */
+    uint32_t         pixmap;     /* named contents, 0 if not available */
+    uint32_t         damage;     /* DAMAGE object, 0 if not tracked */
+    uint8_t          damaged;    /* contents changed since snapshot */
+    uint64_t         thumb_time; /* when snapshot was taken, msec */
+    rie_image_t      thumb;      /* scaled snapshot of contents */
 };
 
 int rie_window_init_list(rie_array_t *windows, size_t len);
@@ -54,7 +65,16 @@ int rie_window_init_list(rie_array_t *windows, size_t len);
 rie_window_t *rie_window_lookup(rie_t *pager, uint32_t winid);
 
 int rie_window_update_geometry(rie_t *pager);
+int rie_window_update_position(rie_t *pager, rie_window_t *window,
+    rie_rect_t *box, uint32_t border, uint8_t synthetic);
+int rie_window_update_title(rie_t *pager, rie_window_t *window);
+int rie_window_update_name(rie_t *pager, rie_window_t *window);
+int rie_window_update_icon(rie_t *pager, rie_window_t *window);
+int rie_window_update_icons(rie_t *pager);
 int rie_window_query(rie_t *pager, rie_window_t *window, uint32_t winid);
+int rie_window_update_list(rie_t *pager, uint32_t *ids, size_t n);
+int rie_window_query_list(rie_t *pager, rie_window_t *windows,
+    uint32_t *ids, size_t n);
 
 void rie_window_update_pager_focus(rie_t *pager);
 int rie_windows_tile(rie_t *pager, int desk);
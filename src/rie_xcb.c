@@ -25,6 +25,18 @@
 #include <stdarg.h>
 #include <stdio.h>
 
+#if defined(RIE_HAVE_XCB_SHM)
+#include <xcb/shm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif
+
+#if defined(RIE_HAVE_XCB_COMPOSITE) && defined(RIE_HAVE_XCB_DAMAGE)
+#define RIE_XCB_THUMBNAILS
+#include <xcb/composite.h>
+#include <xcb/damage.h>
+#endif
+
 /* #define RIE_XCB_DBG */
 
 
@@ -32,16 +44,36 @@ struct rie_xcb_s {
     int                     screen;
     xcb_window_t            root;
     xcb_window_t            window;
+    xcb_gcontext_t          gc;    /* for copying between pixmaps, window */
     xcb_connection_t       *xc;
     xcb_screen_t           *xs;
     xcb_ewmh_connection_t   ewmh;
     rie_rect_t              root_geom;
     uint8_t                 event_base_randr;
+    uint8_t                 shm;   /* MIT-SHM is usable */
+    uint8_t                 thumbnails; /* Composite and Damage are usable */
+    uint8_t                 event_base_damage;
     xcb_atom_t              atoms[RIE_ATOM_LAST];
 };
 
+/* pixmap released together with the surface referring to it */
+typedef struct {
+    rie_xcb_t              *xcb;
+    xcb_pixmap_t            pixmap;
+} rie_xcb_pixmap_ref_t;
+
 
 static int rie_xcb_enable_randr(rie_xcb_t *xcb);
+static int rie_xcb_copy_gc(rie_xcb_t *xcb);
+static void rie_xcb_pixmap_release(void *data);
+static int rie_xcb_root_pixmap_id(rie_xcb_t *xcb, xcb_drawable_t *pixmap,
+    rie_rect_t *box);
+#if defined(RIE_HAVE_XCB_SHM)
+static void rie_xcb_enable_shm(rie_xcb_t *xcb);
+static int rie_xcb_get_screen_pixmap_shm(rie_xcb_t *xcb, xcb_drawable_t obj,
+    rie_rect_t *box, rie_surface_t **surface);
+static void rie_xcb_shm_release(void *data);
+#endif
 static int rie_xcb_init_atoms(rie_xcb_t *xcb);
 static int rie_xcb_set_window_borderless(rie_xcb_t *xcb);
 static int rie_xcb_set_window_title(rie_xcb_t *xcb);
@@ -103,6 +135,8 @@ static const char *rie_atom_names[] = {
 
     "_NET_WM_STRUT",
     "_NET_WM_STRUT_PARTIAL",
+
+    "_NET_FRAME_EXTENTS",
 };
 
 
@@ -170,6 +204,10 @@ rie_xcb_new(rie_settings_t *cfg)
         }
     }
 
+#if defined(RIE_HAVE_XCB_SHM)
+    rie_xcb_enable_shm(xcb);
+#endif
+
     /*
      * PropertyChangeMask is expected to be set by WM,
      * but this is not always true;
@@ -276,6 +314,349 @@ rie_xcb_enable_randr(rie_xcb_t *xcb)
 }
 
 
+#if defined(RIE_HAVE_XCB_SHM)
+
+static void
+rie_xcb_enable_shm(rie_xcb_t *xcb)
+{
+    xcb_generic_error_t                *err;
+    xcb_shm_query_version_reply_t      *ver_reply;
+    const xcb_query_extension_reply_t  *ext_reply;
+
+    /* MIT-SHM is an optimization only: any failure means fallback */
+
+    ext_reply = xcb_get_extension_data(xcb->xc, &xcb_shm_id);
+    if (ext_reply == NULL || !ext_reply->present) {
+        rie_debug("MIT-SHM extension is not present");
+        return;
+    }
+
+    ver_reply = xcb_shm_query_version_reply(xcb->xc,
+                                            xcb_shm_query_version(xcb->xc),
+                                            &err);
+    if (ver_reply == NULL) {
+        free(err);
+        rie_debug("MIT-SHM version query failed");
+        return;
+    }
+
+    rie_debug("found MIT-SHM extension v.%d.%d",
+              ver_reply->major_version, ver_reply->minor_version);
+
+    free(ver_reply);
+
+    xcb->shm = 1;
+}
+
+#endif
+
+
+/*
+ * live thumbnails: windows are redirected to offscreen storage, which is
+ * named as a pixmap when a snapshot is taken; Damage tells when contents
+ * change. Redirection is automatic, so windows are still shown as usual.
+ */
+int
+rie_xcb_enable_thumbnails(rie_xcb_t *xcb)
+{
+#if defined(RIE_XCB_THUMBNAILS)
+
+    xcb_generic_error_t                   *err;
+    const xcb_query_extension_reply_t     *ext_reply;
+    xcb_damage_query_version_reply_t      *dmg_reply;
+    xcb_composite_query_version_reply_t   *cmp_reply;
+    xcb_damage_query_version_cookie_t      dmg_cookie;
+    xcb_composite_query_version_cookie_t   cmp_cookie;
+
+    if (xcb->thumbnails) {
+        return RIE_OK;
+    }
+
+    ext_reply = xcb_get_extension_data(xcb->xc, &xcb_composite_id);
+    if (ext_reply == NULL || !ext_reply->present) {
+        rie_log_error(0, "Composite extension is not present");
+        return RIE_ERROR;
+    }
+
+    ext_reply = xcb_get_extension_data(xcb->xc, &xcb_damage_id);
+    if (ext_reply == NULL || !ext_reply->present) {
+        rie_log_error(0, "Damage extension is not present");
+        return RIE_ERROR;
+    }
+
+    xcb->event_base_damage = ext_reply->first_event;
+
+    /* NameWindowPixmap appeared in 0.2 */
+    cmp_cookie = xcb_composite_query_version(xcb->xc, 0, 2);
+    dmg_cookie = xcb_damage_query_version(xcb->xc, 1, 1);
+
+    cmp_reply = xcb_composite_query_version_reply(xcb->xc, cmp_cookie, &err);
+    if (cmp_reply == NULL) {
+        xcb_discard_reply(xcb->xc, dmg_cookie.sequence);
+        return rie_xcb_handle_error0(err, "xcb_composite_query_version_reply");
+    }
+
+    dmg_reply = xcb_damage_query_version_reply(xcb->xc, dmg_cookie, &err);
+    if (dmg_reply == NULL) {
+        free(cmp_reply);
+        return rie_xcb_handle_error0(err, "xcb_damage_query_version_reply");
+    }
+
+    rie_debug("found Composite v.%d.%d and Damage v.%d.%d, damage base is %d",
+              cmp_reply->major_version, cmp_reply->minor_version,
+              dmg_reply->major_version, dmg_reply->minor_version,
+              xcb->event_base_damage);
+
+    if (cmp_reply->major_version == 0 && cmp_reply->minor_version < 2) {
+        rie_log_error(0, "Composite extension v.0.2 or later is required");
+        free(cmp_reply);
+        free(dmg_reply);
+        return RIE_ERROR;
+    }
+
+    free(cmp_reply);
+    free(dmg_reply);
+
+    xcb->thumbnails = 1;
+
+    return RIE_OK;
+
+#else
+
+    rie_log_error(0, "rieman is built without Composite/Damage support");
+
+    return RIE_ERROR;
+
+#endif
+}
+
+
+int
+rie_xcb_thumbnails(rie_xcb_t *xcb)
+{
+    return xcb->thumbnails;
+}
+
+
+/* returns DAMAGE object tracking the window, or 0 */
+uint32_t
+rie_xcb_thumbnail_start(rie_xcb_t *xcb, xcb_window_t win)
+{
+#if defined(RIE_XCB_THUMBNAILS)
+
+    uint32_t           damage;
+    xcb_void_cookie_t  vcookie;
+
+    if (!xcb->thumbnails) {
+        return 0;
+    }
+
+    /*
+     * fails with BadAccess if already redirected by us, i.e. window was
+     * inherited from the previous configuration; this is fine
+     */
+    vcookie = xcb_composite_redirect_window_checked(xcb->xc, win,
+                                              XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+    xcb_discard_reply(xcb->xc, vcookie.sequence);
+
+    damage = xcb_generate_id(xcb->xc);
+
+    vcookie = xcb_damage_create_checked(xcb->xc, damage, win,
+                                        XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+    xcb_discard_reply(xcb->xc, vcookie.sequence);
+
+    return damage;
+
+#else
+
+    return 0;
+
+#endif
+}
+
+
+/*
+ * window may be gone already, together with damage object: errors are
+ * not interesting; redirection is only dropped if window is not shown
+ * anymore, as the next configuration may still use it
+ */
+void
+rie_xcb_thumbnail_stop(rie_xcb_t *xcb, xcb_window_t win, uint32_t damage,
+    int unredirect)
+{
+#if defined(RIE_XCB_THUMBNAILS)
+
+    xcb_void_cookie_t  vcookie;
+
+    vcookie = xcb_damage_destroy_checked(xcb->xc, damage);
+    xcb_discard_reply(xcb->xc, vcookie.sequence);
+
+    if (unredirect) {
+        vcookie = xcb_composite_unredirect_window_checked(xcb->xc, win,
+                                              XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+        xcb_discard_reply(xcb->xc, vcookie.sequence);
+    }
+
+#endif
+}
+
+
+/*
+ * names window contents as a pixmap, to be released by rie_xcb_free_pixmap();
+ * the pixmap follows contents until window is unmapped or resized;
+ * returns 0 if window is not viewable
+ */
+uint32_t
+rie_xcb_thumbnail_pixmap(rie_xcb_t *xcb, xcb_window_t win)
+{
+#if defined(RIE_XCB_THUMBNAILS)
+
+    uint32_t              pixmap;
+    xcb_void_cookie_t     vcookie;
+    xcb_generic_error_t  *error;
+
+    pixmap = xcb_generate_id(xcb->xc);
+
+    vcookie = xcb_composite_name_window_pixmap_checked(xcb->xc, win, pixmap);
+
+    error = xcb_request_check(xcb->xc, vcookie);
+    if (error != NULL) {
+        /* BadMatch for unmapped window, or window is already gone */
+        free(error);
+        return 0;
+    }
+
+    return pixmap;
+
+#else
+
+    return 0;
+
+#endif
+}
+
+
+/* damage is reset, so next change is reported again */
+void
+rie_xcb_thumbnail_reset(rie_xcb_t *xcb, uint32_t damage)
+{
+#if defined(RIE_XCB_THUMBNAILS)
+
+    xcb_damage_subtract(xcb->xc, damage, XCB_NONE, XCB_NONE);
+
+#endif
+}
+
+
+/* pixmap compatible with pager window, 0 on error */
+uint32_t
+rie_xcb_create_pixmap(rie_xcb_t *xcb, int w, int h)
+{
+    xcb_pixmap_t          pixmap;
+    xcb_void_cookie_t     cookie;
+    xcb_generic_error_t  *error;
+
+    pixmap = xcb_generate_id(xcb->xc);
+
+    cookie = xcb_create_pixmap_checked(xcb->xc, xcb->xs->root_depth, pixmap,
+                                       xcb->window, w, h);
+
+    error = xcb_request_check(xcb->xc, cookie);
+    if (error != NULL) {
+        (void) rie_xcb_handle_error0(error, "xcb_create_pixmap");
+        return 0;
+    }
+
+    return pixmap;
+}
+
+
+/* GC for copying between drawables of root depth */
+static int
+rie_xcb_copy_gc(rie_xcb_t *xcb)
+{
+    uint32_t              values[1];
+    xcb_gcontext_t        gc;
+    xcb_void_cookie_t     cookie;
+    xcb_generic_error_t  *error;
+
+    if (xcb->gc != XCB_NONE) {
+        return RIE_OK;
+    }
+
+    gc = xcb_generate_id(xcb->xc);
+
+    /* copy source is never obscured */
+    values[0] = 0;
+
+    cookie = xcb_create_gc_checked(xcb->xc, gc, xcb->window,
+                                   XCB_GC_GRAPHICS_EXPOSURES, values);
+
+    error = xcb_request_check(xcb->xc, cookie);
+    if (error != NULL) {
+        return rie_xcb_handle_error0(error, "xcb_create_gc");
+    }
+
+    xcb->gc = gc;
+
+    return RIE_OK;
+}
+
+
+/* copies box from pixmap into the same place of pager window */
+int
+rie_xcb_copy_to_window(rie_xcb_t *xcb, uint32_t pixmap, rie_rect_t *box)
+{
+    if (rie_xcb_copy_gc(xcb) != RIE_OK) {
+        return RIE_ERROR;
+    }
+
+    (void) xcb_copy_area(xcb->xc, pixmap, xcb->window, xcb->gc,
+                         box->x, box->y, box->x, box->y, box->w, box->h);
+
+    return RIE_OK;
+}
+
+
+void
+rie_xcb_free_pixmap(rie_xcb_t *xcb, uint32_t pixmap)
+{
+    xcb_void_cookie_t  vcookie;
+
+    vcookie = xcb_free_pixmap_checked(xcb->xc, pixmap);
+    xcb_discard_reply(xcb->xc, vcookie.sequence);
+}
+
+
+/* returns 1 and damaged window if the event is DamageNotify */
+int
+rie_xcb_damage_notify(rie_xcb_t *xcb, xcb_generic_event_t *ev,
+    xcb_window_t *win)
+{
+#if defined(RIE_XCB_THUMBNAILS)
+
+    xcb_damage_notify_event_t  *dn;
+
+    if (!xcb->thumbnails
+        || rie_xcb_event_type(ev) != xcb->event_base_damage + XCB_DAMAGE_NOTIFY)
+    {
+        return 0;
+    }
+
+    dn = (xcb_damage_notify_event_t *) ev;
+
+    *win = dn->drawable;
+
+    return 1;
+
+#else
+
+    return 0;
+
+#endif
+}
+
+
 uint8_t
 rie_xcb_randr_event(rie_xcb_t *xcb, uint8_t off)
 {
@@ -286,6 +667,10 @@ rie_xcb_randr_event(rie_xcb_t *xcb, uint8_t off)
 void
 rie_xcb_delete(rie_xcb_t *xcb)
 {
+    if (xcb->gc != XCB_NONE) {
+        xcb_free_gc(xcb->xc, xcb->gc);
+    }
+
     xcb_ewmh_connection_wipe(&xcb->ewmh);
     xcb_disconnect(xcb->xc);
 
@@ -454,6 +839,13 @@ rie_xcb_get_screen(xcb_connection_t *c, int screen)
 
 xcb_visualtype_t *
 rie_xcb_root_visual(rie_xcb_t *xcb)
+{
+    return rie_xcb_visual(xcb, xcb->xs->root_visual);
+}
+
+
+xcb_visualtype_t *
+rie_xcb_visual(rie_xcb_t *xcb, xcb_visualid_t id)
 {
     xcb_depth_iterator_t       di;
     xcb_screen_iterator_t      si;
@@ -468,7 +860,7 @@ rie_xcb_root_visual(rie_xcb_t *xcb)
             vi = xcb_depth_visuals_iterator(di.data);
 
             for (; vi.rem; xcb_visualtype_next(&vi)) {
-                if (xcb->xs->root_visual == vi.data->visual_id) {
+                if (id == vi.data->visual_id) {
                     return vi.data;
                 }
             }
@@ -597,18 +989,55 @@ int
 rie_xcb_get_window_geometry(rie_xcb_t *xcb, xcb_window_t *winp,
     xcb_window_t *vrootp, rie_rect_t *box, rie_rect_t *viewport)
 {
-    int                                 x, y;
     xcb_window_t                        win, root;
+    xcb_get_geometry_cookie_t           geometry;
+    xcb_translate_coordinates_cookie_t  translate;
+
+    win = winp ? *winp : xcb->window;
+    root = vrootp ? *vrootp : xcb->root; /* root may be reparented to window */
+
+    rie_xcb_window_geometry_request(xcb, win, root, &geometry, &translate);
+
+    return rie_xcb_window_geometry_reply(xcb, &geometry, &translate, box,
+                                         viewport, NULL);
+}
+
+
+void
+rie_xcb_window_geometry_request(rie_xcb_t *xcb, xcb_window_t win,
+    xcb_window_t vroot, xcb_get_geometry_cookie_t *geometry,
+    xcb_translate_coordinates_cookie_t *translate)
+{
+    *geometry = xcb_get_geometry(xcb->xc, win);
+
+    /*
+     * we need coordinates in the root window coordinate system;
+     * the origin of the window is translated, so both requests
+     * may be sent without waiting for geometry reply
+     */
+    *translate = xcb_translate_coordinates(xcb->xc, win, vroot, 0, 0);
+}
+
+
+/* rel, if set, receives position of window origin inside its parent */
+int
+rie_xcb_window_geometry_reply(rie_xcb_t *xcb,
+    xcb_get_geometry_cookie_t *geometry,
+    xcb_translate_coordinates_cookie_t *translate, rie_rect_t *box,
+    rie_rect_t *viewport, rie_rect_t *rel)
+{
+    int                                 x, y;
     xcb_generic_error_t                *error;
     xcb_get_geometry_reply_t           *geom;
     xcb_translate_coordinates_reply_t  *trans;
 
-    win = winp ? *winp : xcb->window;
-    root = vrootp ? *vrootp : xcb->root; /* root may be reparented to window */
+    geom = xcb_get_geometry_reply(xcb->xc, *geometry, &error);
+    geometry->sequence = 0;
 
-    geom = xcb_get_geometry_reply(xcb->xc, xcb_get_geometry(xcb->xc, win),
-                                                            &error);
     if (geom == NULL) {
+        xcb_discard_reply(xcb->xc, translate->sequence);
+        translate->sequence = 0;
+
         return rie_xcb_handle_error0(error, "xcb_get_geometry");
     }
 
@@ -621,17 +1050,21 @@ rie_xcb_get_window_geometry(rie_xcb_t *xcb, xcb_window_t *winp,
         y = 0;
     }
 
-    box->x = geom->x;
-    box->y = geom->y;
     box->w = geom->width;
     box->h = geom->height;
 
+    if (rel) {
+        rel->x = geom->x + geom->border_width;
+        rel->y = geom->y + geom->border_width;
+        rel->w = geom->width;
+        rel->h = geom->height;
+    }
+
     free(geom);
 
-    /* we need coordinates in the root window coordinate system */
-    trans = xcb_translate_coordinates_reply(xcb->xc,
-                          xcb_translate_coordinates(xcb->xc, win, root,
-                                                    box->x, box->y), &error);
+    trans = xcb_translate_coordinates_reply(xcb->xc, *translate, &error);
+    translate->sequence = 0;
+
     if (trans == NULL) {
         return rie_xcb_handle_error0(error, "xcb_translate_coordinates");
     }
@@ -639,12 +1072,13 @@ rie_xcb_get_window_geometry(rie_xcb_t *xcb, xcb_window_t *winp,
     /*
      * returned coordinates are absolute to desktop;
      *
-     * box->x and y are non-zero in case of our window is reparented
+     * window origin is translated, thus position inside parent is
+     * already accounted in case our window is reparented
      * (i.e. inside some dock window and not in a first position)
      *
      */
-    box->x = trans->dst_x + x - box->x;
-    box->y = trans->dst_y + y - box->y;
+    box->x = trans->dst_x + x;
+    box->y = trans->dst_y + y;
 
     free(trans);
 
@@ -659,19 +1093,29 @@ rie_xcb_get_window_geometry(rie_xcb_t *xcb, xcb_window_t *winp,
 
 int
 rie_xcb_get_window_frame(rie_xcb_t *xcb, xcb_window_t win, rie_rect_t *frame)
+{
+    xcb_get_property_cookie_t  cookie;
+
+    cookie = xcb_ewmh_get_frame_extents(rie_xcb_ewmh(xcb), win);
+
+    return rie_xcb_window_frame_reply(xcb, &cookie, frame);
+}
+
+
+int
+rie_xcb_window_frame_reply(rie_xcb_t *xcb, xcb_get_property_cookie_t *cookie,
+    rie_rect_t *frame)
 {
     int  rc;
 
     xcb_generic_error_t           *error;
     xcb_ewmh_connection_t         *ec;
-    xcb_get_property_cookie_t      cookie;
     xcb_ewmh_get_extents_reply_t   reply;
 
     ec = rie_xcb_ewmh(xcb);
 
-    cookie = xcb_ewmh_get_frame_extents(ec, win);
-
-    rc = xcb_ewmh_get_frame_extents_reply(ec, cookie, &reply, &error);
+    rc = xcb_ewmh_get_frame_extents_reply(ec, *cookie, &reply, &error);
+    cookie->sequence = 0;
 
     if (rc == 0) {
 
@@ -769,6 +1213,28 @@ rie_xcb_next_event(rie_xcb_t *xcb)
 }
 
 
+/* returns events already read from the connection, does not block/read */
+xcb_generic_event_t *
+rie_xcb_next_queued_event(rie_xcb_t *xcb)
+{
+    xcb_generic_event_t  *event;
+    xcb_generic_error_t  *err;
+
+    while ((event = xcb_poll_for_queued_event(xcb->xc))) {
+
+        if (event->response_type != 0) {
+            return event;
+        }
+
+        err = (xcb_generic_error_t *) event;
+        rie_xcb_handle_error0(err, "xcb_poll_for_queued_event()");
+        free(err);
+    }
+
+    return NULL;
+}
+
+
 int
 rie_xcb_get_fd(rie_xcb_t *xcb)
 {
@@ -794,6 +1260,18 @@ rie_xcb_event_is_error(rie_xcb_t *xcb)
 int
 rie_xcb_property_get(rie_xcb_t *xcb, xcb_window_t win,
     unsigned int property, xcb_atom_t type, void *value)
+{
+    xcb_get_property_cookie_t  cookie;
+
+    cookie = rie_xcb_property_request(xcb, win, property, type);
+
+    return rie_xcb_property_reply(xcb, &cookie, property, type, value);
+}
+
+
+int
+rie_xcb_property_reply(rie_xcb_t *xcb, xcb_get_property_cookie_t *cookie,
+    unsigned int property, xcb_atom_t type, void *value)
 {
     int           rc;
     rie_array_t   res;
@@ -805,7 +1283,7 @@ rie_xcb_property_get(rie_xcb_t *xcb, xcb_window_t win,
 
     rie_memzero(&res, sizeof(rie_array_t));
 
-    rc = rie_xcb_property_get_array(xcb, win, property, type, &res);
+    rc = rie_xcb_property_reply_array(xcb, cookie, property, type, &res);
     if (rc != RIE_OK) {
         return rc;
     }
@@ -882,6 +1360,88 @@ rie_xcb_atom_name(rie_xcb_t *xcb, xcb_atom_t atom, int *len)
 int
 rie_xcb_property_get_array(rie_xcb_t *xcb, xcb_window_t win,
     unsigned int property, xcb_atom_t type, rie_array_t *res)
+{
+    xcb_get_property_cookie_t  cookie;
+
+    cookie = rie_xcb_property_request(xcb, win, property, type);
+
+    return rie_xcb_property_reply_array(xcb, &cookie, property, type, res);
+}
+
+
+xcb_get_property_cookie_t
+rie_xcb_property_request(rie_xcb_t *xcb, xcb_window_t win,
+    unsigned int property, xcb_atom_t type)
+{
+    return xcb_get_property(xcb->xc, 0, win, xcb->atoms[property], type,
+                            0, 0xFFFFFF);
+}
+
+
+/* offset and length are in 32-bit units */
+xcb_get_property_cookie_t
+rie_xcb_property_request_range(rie_xcb_t *xcb, xcb_window_t win,
+    unsigned int property, xcb_atom_t type, uint32_t offset, uint32_t length)
+{
+    return xcb_get_property(xcb->xc, 0, win, xcb->atoms[property], type,
+                            offset, length);
+}
+
+
+void
+rie_xcb_property_discard(rie_xcb_t *xcb, xcb_get_property_cookie_t *cookie)
+{
+    if (cookie->sequence) {
+        xcb_discard_reply(xcb->xc, cookie->sequence);
+        cookie->sequence = 0;
+    }
+}
+
+
+/*
+ * reads width and height of a single _NET_WM_ICON image, requested
+ * as 2 items at image offset; 'left' is set to the number of items
+ * in the property following the header
+ */
+int
+rie_xcb_icon_header_reply(rie_xcb_t *xcb, xcb_get_property_cookie_t *cookie,
+    uint32_t *width, uint32_t *height, uint32_t *left)
+{
+    uint32_t                  *hdr;
+    xcb_generic_error_t       *error;
+    xcb_get_property_reply_t  *reply;
+
+    reply = xcb_get_property_reply(xcb->xc, *cookie, &error);
+    cookie->sequence = 0;
+
+    if (reply == NULL) {
+        return rie_xcb_handle_error0(error, "xcb_get_property(_NET_WM_ICON)");
+    }
+
+    if (reply->type != XCB_ATOM_CARDINAL
+        || reply->format != 32
+        || xcb_get_property_value_length(reply) < 2 * sizeof(uint32_t))
+    {
+        /* missing or malformed */
+        free(reply);
+        return RIE_NOTFOUND;
+    }
+
+    hdr = xcb_get_property_value(reply);
+
+    *width = hdr[0];
+    *height = hdr[1];
+    *left = reply->bytes_after / sizeof(uint32_t);
+
+    free(reply);
+
+    return RIE_OK;
+}
+
+
+int
+rie_xcb_property_reply_array(rie_xcb_t *xcb, xcb_get_property_cookie_t *cookie,
+    unsigned int property, xcb_atom_t type, rie_array_t *res)
 {
     int          i;
     char        *aname;
@@ -891,12 +1451,10 @@ rie_xcb_property_get_array(rie_xcb_t *xcb, xcb_window_t win,
 
     xcb_generic_error_t        *error;
     xcb_get_property_reply_t   *reply;
-    xcb_get_property_cookie_t   cookie;
 
-    cookie = xcb_get_property(xcb->xc, 0, win, xcb->atoms[property], type,
-                              0, 0xFFFFFF);
+    reply = xcb_get_property_reply(xcb->xc, *cookie, &error);
+    cookie->sequence = 0;
 
-    reply = xcb_get_property_reply(xcb->xc, cookie, &error);
     if (reply == NULL) {
         rie_xcb_handle_error0(error, "xcb_get_property_reply");
         return RIE_NOTFOUND;
@@ -1045,6 +1603,19 @@ rie_xcb_property_delete(rie_xcb_t *xcb, xcb_window_t win, unsigned int property)
 int
 rie_xcb_property_get_utftext(rie_xcb_t *xcb, xcb_window_t win,
     unsigned int property, char **value)
+{
+    xcb_get_property_cookie_t  cookie;
+
+    cookie = rie_xcb_property_request(xcb, win, property,
+                                      XCB_GET_PROPERTY_TYPE_ANY);
+
+    return rie_xcb_property_reply_utftext(xcb, &cookie, property, value);
+}
+
+
+int
+rie_xcb_property_reply_utftext(rie_xcb_t *xcb,
+    xcb_get_property_cookie_t *cookie, unsigned int property, char **value)
 {
     int    rc;
     char  *p;
@@ -1053,7 +1624,7 @@ rie_xcb_property_get_utftext(rie_xcb_t *xcb, xcb_window_t win,
 
     rie_memzero(&array, sizeof(rie_array_t));
 
-    rc = rie_xcb_property_get_array_utftext(xcb, win, property, &array);
+    rc = rie_xcb_property_reply_array_utftext(xcb, cookie, property, &array);
 
     if (rc != RIE_OK) {
         return rc;
@@ -1077,18 +1648,28 @@ rie_xcb_property_get_utftext(rie_xcb_t *xcb, xcb_window_t win,
 int
 rie_xcb_property_get_array_utftext(rie_xcb_t *xcb, xcb_window_t win,
     unsigned int property, rie_array_t *arr)
+{
+    xcb_get_property_cookie_t  cookie;
+
+    cookie = rie_xcb_property_request(xcb, win, property,
+                                      XCB_GET_PROPERTY_TYPE_ANY);
+
+    return rie_xcb_property_reply_array_utftext(xcb, &cookie, property, arr);
+}
+
+
+int
+rie_xcb_property_reply_array_utftext(rie_xcb_t *xcb,
+    xcb_get_property_cookie_t *cookie, unsigned int property, rie_array_t *arr)
 {
     int                         len, rc;
     char                       *val;
     xcb_generic_error_t        *error;
     xcb_get_property_reply_t   *reply;
-    xcb_get_property_cookie_t   cookie;
 
+    reply = xcb_get_property_reply(xcb->xc, *cookie, &error);
+    cookie->sequence = 0;
 
-    cookie = xcb_get_property(xcb->xc, 0, win, xcb->atoms[property],
-                              XCB_GET_PROPERTY_TYPE_ANY, 0, 0xFFFFFF);
-
-    reply = xcb_get_property_reply(xcb->xc, cookie, &error);
     if (reply == NULL) {
         return rie_xcb_handle_error(error, "xcb_get_property(%s)",
                                     rie_atom_names[property]);
@@ -1228,18 +1809,158 @@ rie_xcb_update_event_mask(rie_xcb_t *xcb, xcb_window_t win,
 }
 
 
+/* pipelined version of rie_xcb_update_event_mask(), errors are ignored */
+void
+rie_xcb_event_mask_reply(rie_xcb_t *xcb,
+    xcb_get_window_attributes_cookie_t *cookie, xcb_window_t win,
+    unsigned long mask, uint32_t *visual, uint8_t *viewable)
+{
+    uint32_t res_mask;
+
+    xcb_void_cookie_t                    vcookie;
+    xcb_generic_error_t                 *error;
+    xcb_get_window_attributes_reply_t   *reply;
+
+    reply = xcb_get_window_attributes_reply(xcb->xc, *cookie, &error);
+    cookie->sequence = 0;
+
+    if (reply == NULL) {
+        /* window is already gone */
+        free(error);
+        return;
+    }
+
+    if (visual) {
+        *visual = reply->visual;
+    }
+
+    if (viewable) {
+        *viewable = (reply->map_state == XCB_MAP_STATE_VIEWABLE);
+    }
+
+    res_mask = reply->your_event_mask | mask;
+
+    if (res_mask == reply->your_event_mask) {
+        /* already subscribed, nothing to change */
+        free(reply);
+        return;
+    }
+
+    free(reply);
+
+    /* do not wait for the result, window may disappear any time */
+    vcookie = xcb_change_window_attributes_checked(xcb->xc, win,
+                                                   XCB_CW_EVENT_MASK,
+                                                   &res_mask);
+    xcb_discard_reply(xcb->xc, vcookie.sequence);
+}
+
+
 int
 rie_xcb_get_root_pixmap(rie_xcb_t *xcb, rie_gfx_t *gc, rie_image_t *img)
+{
+    rie_rect_t      box;
+    xcb_drawable_t  pixmap;
+
+    if (rie_xcb_root_pixmap_id(xcb, &pixmap, &box) != RIE_OK) {
+        return RIE_ERROR;
+    }
+
+    return rie_xcb_get_screen_pixmap(xcb, gc, pixmap, &box, img);
+}
+
+
+/*
+ * root pixmap is copied on server side: client keeps no copy of pixels;
+ * the copy is owned by pager, as wallpaper setters may free their pixmap
+ * before _XROOTPMAP_ID is changed
+ */
+int
+rie_xcb_wrap_root_pixmap(rie_xcb_t *xcb, rie_image_t *img)
+{
+    rie_rect_t             box;
+    rie_surface_t         *surface;
+    xcb_drawable_t         pixmap;
+    xcb_void_cookie_t      cookie;
+    xcb_generic_error_t   *error;
+    rie_xcb_pixmap_ref_t  *ref;
+
+    if (rie_xcb_root_pixmap_id(xcb, &pixmap, &box) != RIE_OK) {
+        return RIE_ERROR;
+    }
+
+    if (rie_xcb_copy_gc(xcb) != RIE_OK) {
+        return RIE_ERROR;
+    }
+
+    ref = malloc(sizeof(rie_xcb_pixmap_ref_t));
+    if (ref == NULL) {
+        rie_log_error0(errno, "malloc");
+        return RIE_ERROR;
+    }
+
+    ref->xcb = xcb;
+    ref->pixmap = rie_xcb_create_pixmap(xcb, box.w, box.h);
+    if (ref->pixmap == 0) {
+        free(ref);
+        return RIE_ERROR;
+    }
+
+    cookie = xcb_copy_area_checked(xcb->xc, pixmap, ref->pixmap, xcb->gc,
+                                   0, 0, 0, 0, box.w, box.h);
+
+    error = xcb_request_check(xcb->xc, cookie);
+    if (error != NULL) {
+        rie_xcb_pixmap_release(ref);
+        return rie_xcb_handle_error0(error, "xcb_copy_area");
+    }
+
+    surface = rie_gfx_surface_from_drawable(xcb, ref->pixmap, 0,
+                                            box.w, box.h);
+    if (surface == NULL) {
+        rie_xcb_pixmap_release(ref);
+        return RIE_ERROR;
+    }
+
+    if (rie_gfx_surface_on_release(surface, ref, rie_xcb_pixmap_release)
+        != RIE_OK)
+    {
+        rie_gfx_surface_free(surface);
+        rie_xcb_pixmap_release(ref);
+        return RIE_ERROR;
+    }
+
+    if (img->tx) {
+        rie_gfx_surface_free(img->tx);
+    }
+
+    img->tx = surface;
+    img->box = box;
+
+    return RIE_OK;
+}
+
+
+static void
+rie_xcb_pixmap_release(void *data)
+{
+    rie_xcb_pixmap_ref_t  *ref = data;
+
+    rie_xcb_free_pixmap(ref->xcb, ref->pixmap);
+    free(ref);
+}
+
+
+static int
+rie_xcb_root_pixmap_id(rie_xcb_t *xcb, xcb_drawable_t *pixmap, rie_rect_t *box)
 {
     int                        rc;
-    rie_rect_t                 box;
-    xcb_drawable_t             pixmap;
     xcb_generic_error_t       *error;
     xcb_get_geometry_reply_t  *geom;
 
     /* locate ID of root window pixmap */
     rc = rie_xcb_property_get(xcb, xcb->root, RIE_XROOTPMAP_ID,
-                              XCB_ATOM_PIXMAP, &pixmap);
+                              XCB_ATOM_PIXMAP, pixmap);
     if (rc != RIE_OK) {
         return RIE_ERROR;
     }
@@ -1247,20 +1968,20 @@ rie_xcb_get_root_pixmap(rie_xcb_t *xcb, rie_gfx_t *gc, rie_image_t *img)
     /* TODO: also try accessing XA_ESETROOT_PMAP_ID */
 
     /* root pixmap size does not always match root window size */
-    geom = xcb_get_geometry_reply(xcb->xc, xcb_get_geometry(xcb->xc, pixmap),
+    geom = xcb_get_geometry_reply(xcb->xc, xcb_get_geometry(xcb->xc, *pixmap),
                                                             &error);
     if (geom == NULL) {
         return rie_xcb_handle_error0(error, "xcb_get_geometry");
     }
 
-    box.x = geom->x;
-    box.y = geom->y;
-    box.w = geom->width;
-    box.h = geom->height;
+    box->x = geom->x;
+    box->y = geom->y;
+    box->w = geom->width;
+    box->h = geom->height;
 
     free(geom);
 
-    return rie_xcb_get_screen_pixmap(xcb, gc, pixmap, &box, img);
+    return RIE_OK;
 }
 
 
@@ -1280,6 +2001,16 @@ rie_xcb_get_screen_pixmap(rie_xcb_t *xcb, rie_gfx_t *gc, xcb_drawable_t obj,
     w = box->w;
     h = box->h;
 
+#if defined(RIE_HAVE_XCB_SHM)
+
+    if (xcb->shm
+        && rie_xcb_get_screen_pixmap_shm(xcb, obj, box, &surface) == RIE_OK)
+    {
+        goto done;
+    }
+
+#endif
+
     /* step 1: copy image data to client */
     cookie = xcb_get_image(xcb->xc, XCB_IMAGE_FORMAT_Z_PIXMAP, obj,
                            box->x, box->y, w, h, 0xffffffff);
@@ -1322,6 +2053,10 @@ rie_xcb_get_screen_pixmap(rie_xcb_t *xcb, rie_gfx_t *gc, xcb_drawable_t obj,
         return RIE_ERROR;
     }
 
+#if defined(RIE_HAVE_XCB_SHM)
+done:
+#endif
+
     if (img->tx) {
         /* previous root image, if any */
         rie_gfx_surface_free(img->tx);
@@ -1336,9 +2071,125 @@ rie_xcb_get_screen_pixmap(rie_xcb_t *xcb, rie_gfx_t *gc, xcb_drawable_t obj,
 }
 
 
+#if defined(RIE_HAVE_XCB_SHM)
+
+/*
+ * the server writes pixels directly into a private shared segment,
+ * which is then wrapped by a surface as is; the segment is detached
+ * when the surface is destroyed
+ */
+static int
+rie_xcb_get_screen_pixmap_shm(rie_xcb_t *xcb, xcb_drawable_t obj,
+    rie_rect_t *box, rie_surface_t **surface)
+{
+    int        id;
+    void      *data;
+    size_t     len;
+    uint32_t   seg;
+
+    xcb_void_cookie_t            vcookie;
+    xcb_generic_error_t         *err;
+    xcb_shm_get_image_reply_t   *reply;
+    xcb_shm_get_image_cookie_t   cookie;
+
+    len = box->w * box->h * sizeof(uint32_t);
+
+    id = shmget(IPC_PRIVATE, len, IPC_CREAT | 0600);
+    if (id == -1) {
+        rie_log_error0(errno, "shmget()");
+        return RIE_ERROR;
+    }
+
+    data = shmat(id, NULL, 0);
+    if (data == (void *) -1) {
+        rie_log_error0(errno, "shmat()");
+        (void) shmctl(id, IPC_RMID, NULL);
+        return RIE_ERROR;
+    }
+
+    seg = xcb_generate_id(xcb->xc);
+
+    vcookie = xcb_shm_attach_checked(xcb->xc, seg, id, 0);
+    err = xcb_request_check(xcb->xc, vcookie);
+
+    /* segment is destroyed as soon as both sides detach from it */
+    (void) shmctl(id, IPC_RMID, NULL);
+
+    if (err) {
+        (void) rie_xcb_handle_error0(err, "xcb_shm_attach");
+        (void) shmdt(data);
+
+        /* the server cannot access our memory, i.e. remote display */
+        rie_log("MIT-SHM is not usable, falling back to GetImage");
+        xcb->shm = 0;
+
+        return RIE_ERROR;
+    }
+
+    cookie = xcb_shm_get_image(xcb->xc, obj, box->x, box->y, box->w, box->h,
+                               0xffffffff, XCB_IMAGE_FORMAT_Z_PIXMAP, seg, 0);
+
+    reply = xcb_shm_get_image_reply(xcb->xc, cookie, &err);
+
+    xcb_shm_detach(xcb->xc, seg);
+
+    if (reply == NULL) {
+        (void) rie_xcb_handle_error0(err, "xcb_shm_get_image_reply");
+        (void) shmdt(data);
+        return RIE_ERROR;
+    }
+
+    /* same expectations as in the GetImage path below */
+
+    if (reply->depth != 24 || reply->size != len) {
+        rie_log_error(0, "unexpected MIT-SHM root image: depth %d, "
+                      "size %u (expected 24 and %zu)",
+                      reply->depth, reply->size, len);
+        free(reply);
+        (void) shmdt(data);
+        return RIE_ERROR;
+    }
+
+    free(reply);
+
+    *surface = rie_gfx_surface_from_data(data, box->w, box->h,
+                                         rie_xcb_shm_release);
+    if (*surface == NULL) {
+        (void) shmdt(data);
+        return RIE_ERROR;
+    }
+
+    return RIE_OK;
+}
+
+
+static void
+rie_xcb_shm_release(void *data)
+{
+    if (shmdt(data) == -1) {
+        rie_log_error0(errno, "shmdt()");
+    }
+}
+
+#endif
+
+
 int
 rie_xcb_get_window_state(rie_xcb_t *xcb, rie_window_t *window,
     xcb_window_t xwin)
+{
+    xcb_get_property_cookie_t  cookie;
+
+    cookie = rie_xcb_property_request(xcb, xwin, RIE_NET_WM_STATE,
+                                      XCB_ATOM_ATOM);
+
+    return rie_xcb_window_state_reply(xcb, &cookie, window);
+}
+
+
+int
+rie_xcb_window_state_reply(rie_xcb_t *xcb, xcb_get_property_cookie_t *cookie,
+    rie_window_t *window)
 {
     int              rc, i;
     uint32_t         mask;
@@ -1350,8 +2201,8 @@ rie_xcb_get_window_state(rie_xcb_t *xcb, rie_window_t *window,
 
     rie_memzero(&res, sizeof(rie_array_t));
 
-    rc = rie_xcb_property_get_array(xcb, xwin, RIE_NET_WM_STATE, XCB_ATOM_ATOM,
-                                    &res);
+    rc = rie_xcb_property_reply_array(xcb, cookie, RIE_NET_WM_STATE,
+                                      XCB_ATOM_ATOM, &res);
     if (rc == RIE_ERROR) {
         return rc;
     }
@@ -1392,6 +2243,18 @@ rie_xcb_get_window_state(rie_xcb_t *xcb, rie_window_t *window,
 int
 rie_xcb_get_window_type(rie_xcb_t *xcb, rie_window_t *window, xcb_window_t
     xwin)
+{
+    xcb_get_property_cookie_t  cookie;
+
+    cookie = xcb_ewmh_get_wm_window_type(rie_xcb_ewmh(xcb), xwin);
+
+    return rie_xcb_window_type_reply(xcb, &cookie, window);
+}
+
+
+int
+rie_xcb_window_type_reply(rie_xcb_t *xcb, xcb_get_property_cookie_t *cookie,
+    rie_window_t *window)
 {
     int  rc, i;
 
@@ -1402,14 +2265,13 @@ rie_xcb_get_window_type(rie_xcb_t *xcb, rie_window_t *window, xcb_window_t
 
     xcb_generic_error_t         *err;
     xcb_ewmh_connection_t       *ec;
-    xcb_get_property_cookie_t    cookie;
     xcb_ewmh_get_atoms_reply_t   atoms;
 
     ec = rie_xcb_ewmh(xcb);
 
-    cookie = xcb_ewmh_get_wm_window_type(ec, xwin);
+    rc = xcb_ewmh_get_wm_window_type_reply(ec, *cookie, &atoms, &err);
+    cookie->sequence = 0;
 
-    rc = xcb_ewmh_get_wm_window_type_reply(ec, cookie, &atoms, &err);
     if (rc == 0) {
 
         if (err) {
@@ -1445,6 +2307,63 @@ rie_xcb_get_window_type(rie_xcb_t *xcb, rie_window_t *window, xcb_window_t
 }
 
 
+/*
+ * sends all requests needed to describe a window without waiting for replies;
+ * coordinates translation depends on window desktop and is sent separately,
+ * as soon as desktop is known (see rie_xcb_window_geometry_request())
+ */
+void
+rie_xcb_window_query_send(rie_xcb_t *xcb, rie_xcb_window_cookies_t *wc,
+    xcb_window_t win, int icons)
+{
+    xcb_ewmh_connection_t  *ec;
+
+    ec = rie_xcb_ewmh(xcb);
+
+    rie_memzero(wc, sizeof(rie_xcb_window_cookies_t));
+
+    wc->win = win;
+
+    wc->desktop = rie_xcb_property_request(xcb, win, RIE_NET_WM_DESKTOP,
+                                           XCB_ATOM_CARDINAL);
+    wc->frame = xcb_ewmh_get_frame_extents(ec, win);
+    wc->title = rie_xcb_property_request(xcb, win, RIE_NET_WM_NAME,
+                                         XCB_GET_PROPERTY_TYPE_ANY);
+    wc->name = rie_xcb_property_request(xcb, win, RIE_WM_CLASS,
+                                        XCB_GET_PROPERTY_TYPE_ANY);
+    if (icons) {
+        /* only the header of the first image, see rie_window_get_icon() */
+        wc->icon = rie_xcb_property_request_range(xcb, win, RIE_NET_WM_ICON,
+                                                  XCB_ATOM_CARDINAL, 0, 2);
+    }
+    wc->type = xcb_ewmh_get_wm_window_type(ec, win);
+    wc->state = rie_xcb_property_request(xcb, win, RIE_NET_WM_STATE,
+                                         XCB_ATOM_ATOM);
+    wc->attrs = xcb_get_window_attributes(xcb->xc, win);
+}
+
+
+/* drops replies that were not collected, i.e. when query failed midway */
+void
+rie_xcb_window_query_discard(rie_xcb_t *xcb, rie_xcb_window_cookies_t *wc)
+{
+    int        i;
+    unsigned  *seq[] = {
+        &wc->desktop.sequence, &wc->geometry.sequence,
+        &wc->translate.sequence, &wc->frame.sequence, &wc->title.sequence,
+        &wc->name.sequence, &wc->icon.sequence, &wc->type.sequence,
+        &wc->state.sequence, &wc->attrs.sequence
+    };
+
+    for (i = 0; i < sizeof(seq) / sizeof(seq[0]); i++) {
+        if (*seq[i]) {
+            xcb_discard_reply(xcb->xc, *seq[i]);
+            *seq[i] = 0;
+        }
+    }
+}
+
+
 int
 rie_xcb_set_window_type(rie_xcb_t *xcb, xcb_window_t win, rie_atom_name_t type)
 {
@@ -65,6 +65,19 @@
 #define rie_xcb_event_type(ev)  ((ev)->response_type & ~0x80)
 uint8_t rie_xcb_randr_event(rie_xcb_t *xcb, uint8_t off);
 
+int rie_xcb_enable_thumbnails(rie_xcb_t *xcb);
+int rie_xcb_thumbnails(rie_xcb_t *xcb);
+uint32_t rie_xcb_thumbnail_start(rie_xcb_t *xcb, xcb_window_t win);
+void rie_xcb_thumbnail_stop(rie_xcb_t *xcb, xcb_window_t win, uint32_t damage,
+    int unredirect);
+uint32_t rie_xcb_thumbnail_pixmap(rie_xcb_t *xcb, xcb_window_t win);
+void rie_xcb_thumbnail_reset(rie_xcb_t *xcb, uint32_t damage);
+uint32_t rie_xcb_create_pixmap(rie_xcb_t *xcb, int w, int h);
+int rie_xcb_copy_to_window(rie_xcb_t *xcb, uint32_t pixmap, rie_rect_t *box);
+void rie_xcb_free_pixmap(rie_xcb_t *xcb, uint32_t pixmap);
+int rie_xcb_damage_notify(rie_xcb_t *xcb, xcb_generic_event_t *ev,
+    xcb_window_t *win);
+
 /* atom names are indexed by this enum */
 typedef enum {
     RIE_UTF8_STRING = 0,
@@ -122,15 +135,34 @@ typedef enum {
     RIE_NET_WM_STRUT,
     RIE_NET_WM_STRUT_PARTIAL,
 
+    RIE_NET_FRAME_EXTENTS,
+
     /* when adding, don't forget to update rie_atom_names[] */
     RIE_ATOM_LAST
 } rie_atom_name_t;
 
 
+/* outstanding requests of a pipelined window query */
+typedef struct {
+    xcb_window_t                         win;
+    xcb_get_property_cookie_t            desktop;
+    xcb_get_geometry_cookie_t            geometry;
+    xcb_translate_coordinates_cookie_t   translate;
+    xcb_get_property_cookie_t            frame;
+    xcb_get_property_cookie_t            title;
+    xcb_get_property_cookie_t            name;
+    xcb_get_property_cookie_t            icon;
+    xcb_get_property_cookie_t            type;
+    xcb_get_property_cookie_t            state;
+    xcb_get_window_attributes_cookie_t   attrs;
+} rie_xcb_window_cookies_t;
+
+
 xcb_connection_t *rie_xcb_get_connection(rie_xcb_t *xcb);
 xcb_window_t rie_xcb_get_root(rie_xcb_t *xcb);
 xcb_window_t rie_xcb_get_window(rie_xcb_t *xcb);
 xcb_visualtype_t *rie_xcb_root_visual(rie_xcb_t *xcb);
+xcb_visualtype_t *rie_xcb_visual(rie_xcb_t *xcb, xcb_visualid_t id);
 xcb_atom_t rie_xcb_atom(rie_xcb_t *xcb, rie_atom_name_t atom_name);
 xcb_ewmh_connection_t *rie_xcb_ewmh(rie_xcb_t *xcb);
 int rie_xcb_screen(rie_xcb_t *xcb);
@@ -145,6 +177,13 @@ int rie_xcb_create_window(rie_xcb_t *xcb, int w, int h);
 
 int rie_xcb_get_window_geometry(rie_xcb_t *xcb, xcb_window_t *win,
     xcb_window_t *vroot, rie_rect_t *box, rie_rect_t *viewport);
+void rie_xcb_window_geometry_request(rie_xcb_t *xcb, xcb_window_t win,
+    xcb_window_t vroot, xcb_get_geometry_cookie_t *geometry,
+    xcb_translate_coordinates_cookie_t *translate);
+int rie_xcb_window_geometry_reply(rie_xcb_t *xcb,
+    xcb_get_geometry_cookie_t *geometry,
+    xcb_translate_coordinates_cookie_t *translate, rie_rect_t *box,
+    rie_rect_t *viewport, rie_rect_t *rel);
 
 rie_xcb_t *rie_xcb_new(rie_settings_t *cfg);
 void rie_xcb_delete(rie_xcb_t *xcb);
@@ -158,6 +197,7 @@ int rie_xcb_property_notify_atom(rie_xcb_t *xcb,
     xcb_property_notify_event_t *ev);
 
 xcb_generic_event_t *rie_xcb_next_event(rie_xcb_t *xcb);
+xcb_generic_event_t *rie_xcb_next_queued_event(rie_xcb_t *xcb);
 
 int rie_xcb_get_fd(rie_xcb_t *xcb);
 
@@ -169,12 +209,40 @@ int rie_xcb_property_get(rie_xcb_t *xcb, xcb_window_t win,
 int rie_xcb_property_get_array(rie_xcb_t *xcb, xcb_window_t win,
     unsigned int property, xcb_atom_t type, rie_array_t *array);
 
+xcb_get_property_cookie_t rie_xcb_property_request(rie_xcb_t *xcb,
+    xcb_window_t win, unsigned int property, xcb_atom_t type);
+
+xcb_get_property_cookie_t rie_xcb_property_request_range(rie_xcb_t *xcb,
+    xcb_window_t win, unsigned int property, xcb_atom_t type,
+    uint32_t offset, uint32_t length);
+
+int rie_xcb_property_reply(rie_xcb_t *xcb, xcb_get_property_cookie_t *cookie,
+    unsigned int property, xcb_atom_t type, void *value);
+
+void rie_xcb_property_discard(rie_xcb_t *xcb,
+    xcb_get_property_cookie_t *cookie);
+
+int rie_xcb_icon_header_reply(rie_xcb_t *xcb,
+    xcb_get_property_cookie_t *cookie, uint32_t *width, uint32_t *height,
+    uint32_t *left);
+
+int rie_xcb_property_reply_array(rie_xcb_t *xcb,
+    xcb_get_property_cookie_t *cookie, unsigned int property, xcb_atom_t type,
+    rie_array_t *array);
+
 int rie_xcb_property_get_utftext(rie_xcb_t *xcb, xcb_window_t win,
     unsigned int property, char **value);
 
 int rie_xcb_property_get_array_utftext(rie_xcb_t *xcb, xcb_window_t win,
     unsigned int property, rie_array_t *array);
 
+int rie_xcb_property_reply_utftext(rie_xcb_t *xcb,
+    xcb_get_property_cookie_t *cookie, unsigned int property, char **value);
+
+int rie_xcb_property_reply_array_utftext(rie_xcb_t *xcb,
+    xcb_get_property_cookie_t *cookie, unsigned int property,
+    rie_array_t *array);
+
 int rie_xcb_property_set_array(rie_xcb_t *xcb, xcb_window_t win,
     xcb_atom_t property, xcb_atom_t xtype, rie_array_t *array);
 
@@ -188,6 +256,9 @@ int rie_xcb_client_message(rie_xcb_t *xcb, xcb_window_t target,
 
 int rie_xcb_update_event_mask(rie_xcb_t *xcb, xcb_window_t win,
     unsigned long mask);
+void rie_xcb_event_mask_reply(rie_xcb_t *xcb,
+    xcb_get_window_attributes_cookie_t *cookie, xcb_window_t win,
+    unsigned long mask, uint32_t *visual, uint8_t *viewable);
 
 int rie_xcb_configure_window(rie_xcb_t *xcb, int x, int y, int w, int h);
 
@@ -199,10 +270,13 @@ int rie_xcb_moveresize_window(rie_xcb_t *xcb, xcb_window_t target,
 
 int rie_xcb_get_window_frame(rie_xcb_t *xcb, xcb_window_t win,
     rie_rect_t *frame);
+int rie_xcb_window_frame_reply(rie_xcb_t *xcb,
+    xcb_get_property_cookie_t *cookie, rie_rect_t *frame);
 
 void rie_xcb_flush(rie_xcb_t *xcb);
 
 int rie_xcb_get_root_pixmap(rie_xcb_t *xcb, rie_gfx_t *gc, rie_image_t *img);
+int rie_xcb_wrap_root_pixmap(rie_xcb_t *xcb, rie_image_t *img);
 
 int rie_xcb_get_screen_pixmap(rie_xcb_t *xcb, rie_gfx_t *gc, xcb_drawable_t obj,
     rie_rect_t *box, rie_image_t *img);
@@ -213,6 +287,16 @@ int rie_xcb_get_window_state(rie_xcb_t *xcb, rie_window_t *window,
 int rie_xcb_get_window_type(rie_xcb_t *xcb, rie_window_t *window,
     xcb_window_t xwin);
 
+int rie_xcb_window_state_reply(rie_xcb_t *xcb,
+    xcb_get_property_cookie_t *cookie, rie_window_t *window);
+int rie_xcb_window_type_reply(rie_xcb_t *xcb,
+    xcb_get_property_cookie_t *cookie, rie_window_t *window);
+
+void rie_xcb_window_query_send(rie_xcb_t *xcb, rie_xcb_window_cookies_t *wc,
+    xcb_window_t win, int icons);
+void rie_xcb_window_query_discard(rie_xcb_t *xcb,
+    rie_xcb_window_cookies_t *wc);
+
 int rie_xcb_set_strut(rie_xcb_t *xcb, xcb_window_t win, rie_struts_t *struts);
 
 int rie_xcb_set_desktop(rie_xcb_t *xcb, uint32_t new_desk);
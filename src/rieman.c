@@ -24,7 +24,7 @@
 #include "rie_config.h"
 #include "rie_xcb.h"
 #include "rie_skin.h"
-#include "rie_external.h"
+#include "rie_render.h"
 
 #include <stdio.h>
 #include <limits.h>
@@ -33,6 +33,11 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <signal.h>
+#include <pthread.h>
+
+
+static void *rie_pager_load_skin(void *data);
+static int rie_pager_bootstrap(rie_t *pager, rie_t *oldpager);
 
 
 static rie_conf_map_t rie_conf_layers[] = {
@@ -83,161 +88,233 @@ static rie_conf_map_t rie_conf_labels[] = {
     { NULL, 0 }
 };
 
+static rie_conf_map_t rie_conf_root_modes[] = {
+    { "client", RIE_ROOT_CLIENT },
+    { "server", RIE_ROOT_SERVER },
+    { NULL, 0 }
+};
+
 
 static rie_conf_item_t rie_conf[] = {
 
     { "geometry.width", RIE_CTYPE_UINT32, "100",
-      offsetof(rie_settings_t, desktop.w), NULL, { NULL } },
+      offsetof(rie_settings_t, desktop.w), NULL, { NULL },
+      RIE_RELOAD_LAYOUT },
 
     { "geometry.height", RIE_CTYPE_UINT32, "0",
-      offsetof(rie_settings_t, desktop.h), NULL, { NULL } },
+      offsetof(rie_settings_t, desktop.h), NULL, { NULL },
+      RIE_RELOAD_LAYOUT },
 
     { "layout.wrap", RIE_CTYPE_UINT32, "0",
-      offsetof(rie_settings_t, desktop.wrap), NULL, { NULL } },
+      offsetof(rie_settings_t, desktop.wrap), NULL, { NULL },
+      RIE_RELOAD_LAYOUT },
 
     { "layout.corner", RIE_CTYPE_STR, "topleft",
       offsetof(rie_settings_t, desktop.corner),
-      rie_conf_set_variants, { &rie_conf_corners } },
+      rie_conf_set_variants, { &rie_conf_corners },
+      RIE_RELOAD_LAYOUT },
 
     { "layout.orientation", RIE_CTYPE_STR, "horizontal",
       offsetof(rie_settings_t, desktop.orientation),
-      rie_conf_set_variants, { &rie_conf_orientations } },
+      rie_conf_set_variants, { &rie_conf_orientations },
+      RIE_RELOAD_LAYOUT },
 
 
     { "appearance.skin", RIE_CTYPE_STR,  "default",
-      offsetof(rie_settings_t, skin), NULL, { NULL } },
+      offsetof(rie_settings_t, skin), NULL, { NULL },
+      RIE_RELOAD_SKIN },
 
     { "appearance.desktop_pad", RIE_CTYPE_BOOL, "true",
-      offsetof(rie_settings_t, show_pad), NULL, { NULL } },
+      offsetof(rie_settings_t, show_pad), NULL, { NULL },
+      RIE_RELOAD_LAYOUT },
 
    { "appearance.desktop_pad.position", RIE_CTYPE_STR, "below",
       offsetof(rie_settings_t, pad_position),
-      rie_conf_set_variants, { &rie_conf_pad_positions } },
+      rie_conf_set_variants, { &rie_conf_pad_positions },
+      RIE_RELOAD_LAYOUT },
 
    { "appearance.desktop_pad.margin", RIE_CTYPE_UINT32, "2",
-      offsetof(rie_settings_t, pad_margin), NULL, { NULL } },
+      offsetof(rie_settings_t, pad_margin), NULL, { NULL },
+      RIE_RELOAD_LAYOUT },
 
     { "appearance.desktop_text", RIE_CTYPE_BOOL, "true",
-      offsetof(rie_settings_t, show_text), NULL, { NULL } },
+      offsetof(rie_settings_t, show_text), NULL, { NULL },
+      RIE_RELOAD_LAYOUT },
 
     { "appearance.desktop_text.content", RIE_CTYPE_STR, "number",
       offsetof(rie_settings_t, desktop.content),
-      rie_conf_set_variants, { &rie_conf_labels } },
+      rie_conf_set_variants, { &rie_conf_labels },
+      RIE_RELOAD_LAYOUT },
 
     { "appearance.window_icon", RIE_CTYPE_BOOL, "true",
-      offsetof(rie_settings_t, show_window_icons), NULL, { NULL } },
+      offsetof(rie_settings_t, show_window_icons), NULL, { NULL },
+      RIE_RELOAD_LAYOUT },
 
     { "appearance.viewports", RIE_CTYPE_BOOL, "true",
-      offsetof(rie_settings_t, show_viewports), NULL, { NULL } },
+      offsetof(rie_settings_t, show_viewports), NULL, { NULL },
+      RIE_RELOAD_LAYOUT },
 
     { "appearance.minitray", RIE_CTYPE_BOOL, "true",
-      offsetof(rie_settings_t, show_minitray), NULL, { NULL } },
+      offsetof(rie_settings_t, show_minitray), NULL, { NULL },
+      RIE_RELOAD_LAYOUT },
+
+    { "appearance.window_thumbnails", RIE_CTYPE_BOOL, "false",
+      offsetof(rie_settings_t, show_thumbnails), NULL, { NULL },
+      RIE_RELOAD_THUMBS },
 
     { "window.withdrawn", RIE_CTYPE_BOOL, "false",
-      offsetof(rie_settings_t, withdrawn), NULL, { NULL } },
+      offsetof(rie_settings_t, withdrawn), NULL, { NULL },
+      RIE_RELOAD_NONE },
 
     { "window.skip_taskbar", RIE_CTYPE_BOOL, "true",
-      offsetof(rie_settings_t, skip_taskbar), NULL, { NULL } },
+      offsetof(rie_settings_t, skip_taskbar), NULL, { NULL },
+      RIE_RELOAD_HINTS },
 
     { "window.skip_pager", RIE_CTYPE_BOOL, "true",
-      offsetof(rie_settings_t, skip_pager), NULL, { NULL } },
+      offsetof(rie_settings_t, skip_pager), NULL, { NULL },
+      RIE_RELOAD_HINTS },
 
     { "window.sticky", RIE_CTYPE_BOOL, "true",
-      offsetof(rie_settings_t, sticky), NULL, { NULL } },
+      offsetof(rie_settings_t, sticky), NULL, { NULL },
+      RIE_RELOAD_HINTS },
 
     { "window.layer", RIE_CTYPE_STR, "normal",
       offsetof(rie_settings_t, layer),
-      rie_conf_set_variants, { &rie_conf_layers } },
+      rie_conf_set_variants, { &rie_conf_layers },
+      RIE_RELOAD_HINTS },
 
     { "window.position", RIE_CTYPE_STR, "topleft",
       offsetof(rie_settings_t, position),
-      rie_conf_set_variants, { &rie_conf_positions } },
+      rie_conf_set_variants, { &rie_conf_positions },
+      RIE_RELOAD_LAYOUT },
 
 
     { "actions.change_desktop.mouse_button", RIE_CTYPE_STR, "left",
       offsetof(rie_settings_t, change_desktop_button),
-      rie_conf_set_variants, { &rie_conf_buttons } },
+      rie_conf_set_variants, { &rie_conf_buttons },
+      RIE_RELOAD_NONE },
 
     /* configuration schema 1.1 */
 
     { "actions.change_desktop", RIE_CTYPE_BOOL, "true",
-      offsetof(rie_settings_t, enable_change_desktop_button), NULL, { NULL } },
+      offsetof(rie_settings_t, enable_change_desktop_button), NULL, { NULL },
+      RIE_RELOAD_NONE },
 
     { "actions.tile_windows", RIE_CTYPE_BOOL, "true",
-      offsetof(rie_settings_t, enable_tile_button), NULL, { NULL } },
+      offsetof(rie_settings_t, enable_tile_button), NULL, { NULL },
+      RIE_RELOAD_NONE },
 
     { "actions.tile_windows.mouse_button", RIE_CTYPE_STR, "right",
       offsetof(rie_settings_t, tile_button),
-      rie_conf_set_variants, { &rie_conf_buttons } },
+      rie_conf_set_variants, { &rie_conf_buttons },
+      RIE_RELOAD_NONE },
 
     /* configuration schema 1.2 */
 
     { "window.dock", RIE_CTYPE_BOOL, "false",
-      offsetof(rie_settings_t, docked), NULL, { NULL } },
+      offsetof(rie_settings_t, docked), NULL, { NULL },
+      RIE_RELOAD_NONE },
 
     { "window.strut", RIE_CTYPE_BOOL, "false",
-      offsetof(rie_settings_t, struts.enabled), NULL, { NULL } },
+      offsetof(rie_settings_t, struts.enabled), NULL, { NULL },
+      RIE_RELOAD_NONE },
 
     { "window.strut.left", RIE_CTYPE_UINT32, "0",
-      offsetof(rie_settings_t, struts.left), NULL, { NULL } },
+      offsetof(rie_settings_t, struts.left), NULL, { NULL },
+      RIE_RELOAD_NONE },
 
     { "window.strut.left_start_y", RIE_CTYPE_UINT32, "0",
-      offsetof(rie_settings_t, struts.left_start_y), NULL, { NULL } },
+      offsetof(rie_settings_t, struts.left_start_y), NULL, { NULL },
+      RIE_RELOAD_NONE },
 
     { "window.strut.left_end_y", RIE_CTYPE_UINT32, "0",
-      offsetof(rie_settings_t, struts.left_end_y), NULL, { NULL } },
+      offsetof(rie_settings_t, struts.left_end_y), NULL, { NULL },
+      RIE_RELOAD_NONE },
 
     { "window.strut.right", RIE_CTYPE_UINT32, "0",
-      offsetof(rie_settings_t, struts.right), NULL, { NULL } },
+      offsetof(rie_settings_t, struts.right), NULL, { NULL },
+      RIE_RELOAD_NONE },
 
     { "window.strut.right_start_y", RIE_CTYPE_UINT32, "0",
-      offsetof(rie_settings_t, struts.right_start_y), NULL, { NULL } },
+      offsetof(rie_settings_t, struts.right_start_y), NULL, { NULL },
+      RIE_RELOAD_NONE },
 
     { "window.strut.right_end_y", RIE_CTYPE_UINT32, "0",
-      offsetof(rie_settings_t, struts.right_end_y), NULL, { NULL } },
+      offsetof(rie_settings_t, struts.right_end_y), NULL, { NULL },
+      RIE_RELOAD_NONE },
 
     { "window.strut.top", RIE_CTYPE_UINT32, "0",
-      offsetof(rie_settings_t, struts.top), NULL, { NULL } },
+      offsetof(rie_settings_t, struts.top), NULL, { NULL },
+      RIE_RELOAD_NONE },
 
     { "window.strut.top_start_x", RIE_CTYPE_UINT32, "0",
-      offsetof(rie_settings_t, struts.top_start_x), NULL, { NULL } },
+      offsetof(rie_settings_t, struts.top_start_x), NULL, { NULL },
+      RIE_RELOAD_NONE },
 
     { "window.strut.top_end_x", RIE_CTYPE_UINT32, "0",
-      offsetof(rie_settings_t, struts.top_end_x), NULL, { NULL } },
+      offsetof(rie_settings_t, struts.top_end_x), NULL, { NULL },
+      RIE_RELOAD_NONE },
 
     { "window.strut.bottom", RIE_CTYPE_UINT32, "0",
-      offsetof(rie_settings_t, struts.bottom), NULL, { NULL } },
+      offsetof(rie_settings_t, struts.bottom), NULL, { NULL },
+      RIE_RELOAD_NONE },
 
     { "window.strut.bottom_start_x", RIE_CTYPE_UINT32, "0",
-      offsetof(rie_settings_t, struts.bottom_start_x), NULL, { NULL } },
+      offsetof(rie_settings_t, struts.bottom_start_x), NULL, { NULL },
+      RIE_RELOAD_NONE },
 
     { "window.strut.bottom_end_x", RIE_CTYPE_UINT32, "0",
-      offsetof(rie_settings_t, struts.bottom_end_x), NULL, { NULL } },
+      offsetof(rie_settings_t, struts.bottom_end_x), NULL, { NULL },
+      RIE_RELOAD_NONE },
 
     { "control.socket", RIE_CTYPE_STR, "",
-      offsetof(rie_settings_t, control_socket_path), NULL, { NULL } },
+      offsetof(rie_settings_t, control_socket_path), NULL, { NULL },
+      RIE_RELOAD_CONTROL },
 
     { "window.position.dx", RIE_CTYPE_UINT32, "0",
-      offsetof(rie_settings_t, pos_x_offset), NULL, { NULL } },
+      offsetof(rie_settings_t, pos_x_offset), NULL, { NULL },
+      RIE_RELOAD_LAYOUT },
 
     { "window.position.dy", RIE_CTYPE_UINT32, "0",
-      offsetof(rie_settings_t, pos_y_offset), NULL, { NULL } },
+      offsetof(rie_settings_t, pos_y_offset), NULL, { NULL },
+      RIE_RELOAD_LAYOUT },
 
     /* configuration schema 1.3 */
 
     { "subset.enabled", RIE_CTYPE_BOOL, "false",
-      offsetof(rie_settings_t, subset.enabled), NULL, { NULL } },
+      offsetof(rie_settings_t, subset.enabled), NULL, { NULL },
+      RIE_RELOAD_SUBSET },
 
     { "subset.output", RIE_CTYPE_STR, "",
-      offsetof(rie_settings_t, subset.output), NULL, { NULL } },
+      offsetof(rie_settings_t, subset.output), NULL, { NULL },
+      RIE_RELOAD_SUBSET },
 
     { "subset.start_desktop", RIE_CTYPE_UINT32, "0",
-      offsetof(rie_settings_t, subset.start_desktop), NULL, { NULL } },
+      offsetof(rie_settings_t, subset.start_desktop), NULL, { NULL },
+      RIE_RELOAD_SUBSET },
 
     { "subset.ndesktops", RIE_CTYPE_UINT32, "1",
-      offsetof(rie_settings_t, subset.ndesktops), NULL, { NULL } },
+      offsetof(rie_settings_t, subset.ndesktops), NULL, { NULL },
+      RIE_RELOAD_SUBSET },
 
-    { NULL, 0, NULL, 0, NULL, { NULL } }
+    { "render.fps", RIE_CTYPE_UINT32, "60",
+      offsetof(rie_settings_t, fps), NULL, { NULL },
+      RIE_RELOAD_NONE },
+
+    { "render.icon_cache_size", RIE_CTYPE_UINT32, "4096",
+      offsetof(rie_settings_t, icon_cache_size), NULL, { NULL },
+      RIE_RELOAD_ICONS },
+
+    { "render.root_background", RIE_CTYPE_STR, "client",
+      offsetof(rie_settings_t, root_mode),
+      rie_conf_set_variants, { &rie_conf_root_modes },
+      RIE_RELOAD_ROOT },
+
+    { "render.thumbnail_fps", RIE_CTYPE_UINT32, "2",
+      offsetof(rie_settings_t, thumbnail_fps), NULL, { NULL },
+      RIE_RELOAD_NONE },
+
+    { NULL, 0, NULL, 0, NULL, { NULL }, RIE_RELOAD_NONE }
 };
 
 
@@ -246,13 +323,18 @@ rie_t    *pagerp;
 #endif
 
 uint8_t   rie_withdraw;
-uint8_t   rie_quit;
-uint8_t   rie_reload;
 
 
+/*
+ * skin and fonts are read from files only and do not depend on X server,
+ * so at startup they are loaded while X server state is queried
+ */
 int
 rie_pager_init(rie_t *pager, rie_t *oldpager)
 {
+    int        rc, err;
+    pthread_t  loader;
+
     pager->selected_desktop = -1;
     pager->selected_vp.x = -1;
     pager->selected_vp.y = -1;
@@ -262,29 +344,47 @@ rie_pager_init(rie_t *pager, rie_t *oldpager)
     if (oldpager) {
         pager->xcb = oldpager->xcb;
         pager->log = oldpager->log;
-
-    } else {
-        pager->xcb = rie_xcb_new(pager->cfg);
-        if (pager->xcb == NULL) {
+        pager->loop = oldpager->loop;
+        pager->reload_timer = oldpager->reload_timer;
+        pager->watcher = oldpager->watcher;
+        pager->icons = oldpager->icons;
+        pager->fonts = oldpager->fonts;
+        pager->assets = oldpager->assets;
+
+        pager->skin = rie_skin_new(pager->cfg->skin, pager->fonts,
+                                   pager->assets);
+        if (pager->skin == NULL) {
             return RIE_ERROR;
         }
+
+        return rie_pager_bootstrap(pager, oldpager);
     }
 
-    if (rie_xcb_set_desktop_layout(pager->xcb, pager->cfg) != RIE_OK) {
+    pager->assets = rie_skin_cache_new();
+    if (pager->assets == NULL) {
         return RIE_ERROR;
     }
 
-    pager->gfx = rie_gfx_new(pager->xcb);
-    if (pager->gfx == NULL) {
+    err = pthread_create(&loader, NULL, rie_pager_load_skin, pager);
+    if (err) {
+        rie_log_error(err, "pthread_create()");
         return RIE_ERROR;
     }
 
-    pager->skin = rie_skin_new(pager->cfg->skin, pager->gfx);
-    if (pager->skin == NULL) {
+    /* pager->fonts and pager->skin are not touched until thread is done */
+    rc = rie_pager_bootstrap(pager, NULL);
+
+    err = pthread_join(loader, NULL);
+    if (err) {
+        rie_log_error(err, "pthread_join()");
         return RIE_ERROR;
     }
 
-    if (rie_event_init(pager) != RIE_OK) {
+    if (rc != RIE_OK || pager->skin == NULL) {
+        return RIE_ERROR;
+    }
+
+    if (rie_event_start(pager) != RIE_OK) {
         return RIE_ERROR;
     }
 
@@ -294,13 +394,179 @@ rie_pager_init(rie_t *pager, rie_t *oldpager)
         return RIE_ERROR;
     }
 
+    return RIE_OK;
+}
+
+
+static void *
+rie_pager_load_skin(void *data)
+{
+    rie_t  *pager = data;
+
+    pager->fonts = rie_font_ctx_new();
+    if (pager->fonts == NULL) {
+        return NULL;
+    }
+
+    pager->skin = rie_skin_new(pager->cfg->skin, pager->fonts, pager->assets);
+
+    return NULL;
+}
+
+
+/* everything that needs X server, except for the parts using skin */
+static int
+rie_pager_bootstrap(rie_t *pager, rie_t *oldpager)
+{
+    if (oldpager == NULL) {
+        pager->xcb = rie_xcb_new(pager->cfg);
+        if (pager->xcb == NULL) {
+            return RIE_ERROR;
+        }
+
+        pager->loop = rie_loop_new();
+        if (pager->loop == NULL) {
+            return RIE_ERROR;
+        }
+
+        pager->icons = rie_icon_cache_new();
+        if (pager->icons == NULL) {
+            return RIE_ERROR;
+        }
+    }
+
+    rie_icon_cache_set_budget(pager->icons, pager->cfg->icon_cache_size * 1024);
+
+    if (rie_xcb_set_desktop_layout(pager->xcb, pager->cfg) != RIE_OK) {
+        return RIE_ERROR;
+    }
+
+    pager->gfx = rie_gfx_new(pager->xcb);
+    if (pager->gfx == NULL) {
+        return RIE_ERROR;
+    }
+
     if (strlen(pager->cfg->control_socket_path)) {
-        pager->ctl = rie_control_new(pager->cfg, pager);
+        pager->ctl = rie_control_new(pager->cfg, pager->loop, pager);
         if (pager->ctl == NULL) {
             return RIE_ERROR;
         }
     }
 
+    if (oldpager) {
+        /* takes state from old pager, so cannot fail after that */
+        return rie_event_transplant(pager, oldpager);
+    }
+
+    return rie_event_init(pager);
+}
+
+
+/*
+ * applies reloaded configuration to the running pager: only parts affected
+ * by changed keys, or requested by 'force', are rebuilt, while windows and
+ * caches are kept as is; NULL settings mean current ones are kept;
+ * settings are owned by pager on success; RIE_NOTFOUND means changes
+ * cannot be applied in place
+ */
+int
+rie_pager_reconfigure(rie_t *pager, rie_settings_t *cfg, uint32_t force)
+{
+    uint32_t         changes;
+    rie_skin_t      *skin;
+    rie_control_t   *ctl;
+    rie_settings_t  *oldcfg;
+
+    changes = force;
+
+    if (cfg) {
+        /* takes effect at window creation only */
+        cfg->withdrawn = pager->cfg->withdrawn;
+
+        changes |= rie_conf_diff(&cfg->meta, pager->cfg, cfg);
+
+    } else {
+        cfg = pager->cfg;
+    }
+
+    if (changes & (RIE_RELOAD_SUBSET | RIE_RELOAD_THUMBS)) {
+        /* desktops and windows need to be queried again */
+        return RIE_NOTFOUND;
+    }
+
+    skin = NULL;
+    ctl = NULL;
+
+    /* anything that may fail is created before old objects are replaced */
+
+    if (changes & RIE_RELOAD_SKIN) {
+        skin = rie_skin_new(cfg->skin, pager->fonts, pager->assets);
+        if (skin == NULL) {
+            return RIE_ERROR;
+        }
+    }
+
+    if ((changes & RIE_RELOAD_CONTROL) && strlen(cfg->control_socket_path)) {
+        ctl = rie_control_new(cfg, pager->loop, pager);
+        if (ctl == NULL) {
+            if (skin) {
+                rie_skin_delete(skin);
+            }
+            return RIE_ERROR;
+        }
+    }
+
+    oldcfg = pager->cfg;
+
+    if (cfg != oldcfg) {
+        pager->cfg = cfg;
+        rie_settings_delete(oldcfg);
+    }
+
+    if (changes & RIE_RELOAD_CONTROL) {
+        /* old socket is not used anymore */
+        rie_control_delete(pager->ctl, 1);
+        pager->ctl = ctl;
+    }
+
+    if (changes & RIE_RELOAD_SKIN) {
+        rie_skin_delete(pager->skin);
+        pager->skin = skin;
+
+        /* assets that were used by old skin only */
+        rie_font_ctx_sweep(pager->fonts, 0);
+        rie_skin_cache_sweep(pager->assets);
+
+        /* new skin may show root background and has own sizes */
+        changes |= RIE_RELOAD_ROOT | RIE_RELOAD_LAYOUT;
+    }
+
+    if (changes & RIE_RELOAD_ICONS) {
+        rie_icon_cache_set_budget(pager->icons, cfg->icon_cache_size * 1024);
+    }
+
+    /* settings are already replaced, errors below are only logged */
+
+    if (changes & RIE_RELOAD_HINTS) {
+        (void) rie_xcb_set_window_hints(pager->xcb, cfg,
+                                        pager->current_desktop);
+    }
+
+    if (changes & RIE_RELOAD_ROOT) {
+        (void) rie_render_root_background(pager);
+    }
+
+    if (changes & RIE_RELOAD_LAYOUT) {
+        (void) rie_xcb_set_desktop_layout(pager->xcb, cfg);
+
+        rie_render_layer_reset(pager);
+        rie_gfx_invalidate(pager->gfx);
+
+        pager->resize = 1;
+    }
+
+    pager->render = 1;
+
     return RIE_OK;
 }
 
@@ -447,11 +713,14 @@ rie_pager_run_cmd(rie_t *pager, rie_command_t cmd)
     switch (cmd) {
 
     case RIE_CMD_RELOAD:
-        rie_reload = 1; /* to be handled by event loop */
+        pager->reload_pending |= RIE_CONF_MAIN | RIE_CONF_SKIN;
+
+        /* pager is replaced outside of the current handler */
+        (void) rie_loop_timer_set(pager->reload_timer, 0);
         break;
 
     case RIE_CMD_EXIT:
-        rie_quit = 1; /* to be handled by event loop */
+        rie_loop_stop(pager->loop);
         break;
 
     case RIE_CMD_SWITCH_DESKTOP_LEFT:
@@ -477,14 +746,22 @@ rie_pager_delete(rie_t *pager, int final)
     rie_skin_delete(pager->skin);
     rie_gfx_delete(pager->gfx);
     rie_control_delete(pager->ctl, final);
-    rie_conf_cleanup(&pager->cfg->meta, pager->cfg);
+    rie_settings_delete(pager->cfg);
 
     if (final) {
+        rie_skin_cache_delete(pager->assets);
+        rie_font_ctx_cleanup(pager->fonts);
+        rie_icon_cache_delete(pager->icons);
+        rie_loop_delete(pager->loop);
         rie_xcb_delete(pager->xcb);
         rie_log_delete(pager->log);
+
+    } else {
+        /* assets that were used by this skin only */
+        rie_font_ctx_sweep(pager->fonts, 0);
+        rie_skin_cache_sweep(pager->assets);
     }
 
-    free(pager->cfg);
     free(pager);
 }
 
@@ -549,53 +826,15 @@ rie_version(int verbose)
 }
 
 
-static void
-rie_signal_handler(int sig_num)
-{
-    switch (sig_num) {
-    case SIGTERM:
-    case SIGINT:   /* CTRL-C */
-        rie_quit = 1;
-        break;
-    case SIGUSR1:
-        rie_reload = 1;
-        break;
-    default:
-        /* should never happen */
-        break;
-    }
-}
-
-
+/*
+ * all signals are blocked; the ones we are interested in are
+ * received via signalfd in the event loop
+ */
 static int
 rie_init_signals(sigset_t *ss)
 {
     int  rc;
 
-    struct sigaction  sa;
-
-    sa.sa_flags = 0;
-    sa.sa_handler = rie_signal_handler;
-
-    rc = sigaction(SIGINT, &sa, NULL);
-    if (-1 == rc) {
-        rie_log_error0(errno, "sigaction()");
-        return RIE_ERROR;
-    }
-
-    rc = sigaction(SIGTERM, &sa, NULL);
-    if (-1 == rc) {
-        rie_log_error0(errno, "sigaction()");
-        return RIE_ERROR;
-    }
-
-    rc = sigaction(SIGUSR1, &sa, NULL);
-    if (-1 == rc) {
-        rie_log_error0(errno, "sigaction()");
-        return RIE_ERROR;
-    }
-
-    /* block all signals */
     rc = sigfillset(ss);
     if (-1 == rc) {
         rie_log_error0(errno, "sigfillset()");
@@ -608,23 +847,29 @@ rie_init_signals(sigset_t *ss)
         return RIE_ERROR;
     }
 
-    /* prepare signal mask for pselect() */
+    /* prepare signal mask for signalfd() */
+
+    rc = sigemptyset(ss);
+    if (-1 == rc) {
+        rie_log_error0(errno, "sigemptyset()");
+        return RIE_ERROR;
+    }
 
-    rc = sigdelset(ss, SIGTERM);
+    rc = sigaddset(ss, SIGTERM);
     if (-1 == rc) {
-        rie_log_error0(errno, "sigdelset()");
+        rie_log_error0(errno, "sigaddset()");
         return RIE_ERROR;
     }
 
-    rc = sigdelset(ss, SIGINT);
+    rc = sigaddset(ss, SIGINT);
     if (-1 == rc) {
-        rie_log_error0(errno, "sigdelset()");
+        rie_log_error0(errno, "sigaddset()");
         return RIE_ERROR;
     }
 
-    rc = sigdelset(ss, SIGUSR1);
+    rc = sigaddset(ss, SIGUSR1);
     if (-1 == rc) {
-        rie_log_error0(errno, "sigdelset()");
+        rie_log_error0(errno, "sigaddset()");
         return RIE_ERROR;
     }
 
@@ -632,10 +877,9 @@ rie_init_signals(sigset_t *ss)
 }
 
 
-rie_t *
-rie_pager_new(char *cfile, rie_log_t *log)
+rie_settings_t *
+rie_settings_new(char *cfile)
 {
-    rie_t           *pager;
     rie_settings_t  *cfg;
 
     cfg = malloc(sizeof(rie_settings_t));
@@ -643,14 +887,7 @@ rie_pager_new(char *cfile, rie_log_t *log)
         return NULL;
     }
 
-    pager = malloc(sizeof(rie_t));
-    if (pager == NULL) {
-        free(cfg);
-        return NULL;
-    }
-
     rie_memzero(cfg, sizeof(rie_settings_t));
-    rie_memzero(pager, sizeof(rie_t));
 
     cfg->meta.version_min = 10;
     cfg->meta.version_max = 12;
@@ -661,12 +898,40 @@ rie_pager_new(char *cfile, rie_log_t *log)
     if (rie_conf_load(cfile, &cfg->meta, cfg) != RIE_OK) {
         rie_log_error(0, "configuration load failed");
         free(cfg);
-        free(pager);
         return NULL;
     }
 
     cfg->meta.conf_file = cfile;
 
+    if (rie_withdraw) {
+        /* commandline overrides any default or config file */
+        cfg->withdrawn = 1;
+    }
+
+    return cfg;
+}
+
+
+void
+rie_settings_delete(rie_settings_t *cfg)
+{
+    rie_conf_cleanup(&cfg->meta, cfg);
+    free(cfg);
+}
+
+
+rie_t *
+rie_pager_new(rie_settings_t *cfg, rie_log_t *log)
+{
+    rie_t  *pager;
+
+    pager = malloc(sizeof(rie_t));
+    if (pager == NULL) {
+        return NULL;
+    }
+
+    rie_memzero(pager, sizeof(rie_t));
+
     pager->cfg = cfg;
     pager->log = log;
 
@@ -681,11 +946,12 @@ rie_pager_new(char *cfile, rie_log_t *log)
 int
 main(int argc, char *argv[])
 {
-    int         i;
-    char       *cfile, *logfile, *sockpath, *msg;
-    rie_t      *pager;
-    sigset_t    sigmask;
-    rie_log_t  *log;
+    int              i;
+    char            *cfile, *logfile, *sockpath, *msg;
+    rie_t           *pager;
+    sigset_t         sigmask;
+    rie_log_t       *log;
+    rie_settings_t  *cfg;
 
     char conf_file[FILENAME_MAX];
 
@@ -787,14 +1053,14 @@ main(int argc, char *argv[])
         cfile = conf_file;
     }
 
-    pager = rie_pager_new(cfile, log);
-    if (pager == NULL) {
+    cfg = rie_settings_new(cfile);
+    if (cfg == NULL) {
         goto failed;
     }
 
-    if (rie_withdraw) {
-        /* commandline overrides any default or config file */
-        pager->cfg->withdrawn = 1;
+    pager = rie_pager_new(cfg, log);
+    if (pager == NULL) {
+        goto failed;
     }
 
     if (rie_init_signals(&sigmask) != RIE_OK) {
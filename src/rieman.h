@@ -38,9 +38,12 @@
 typedef struct rie_conf_item_s rie_conf_item_t;
 typedef struct rie_settings_s  rie_settings_t;
 typedef struct rie_control_s   rie_control_t;
+typedef struct rie_loop_s      rie_loop_t;
+typedef struct rie_loop_source_s  rie_loop_source_t;
 typedef struct rie_window_s    rie_window_t;
 typedef struct rie_image_s     rie_image_t;
 typedef struct rie_skin_s      rie_skin_t;
+typedef struct rie_skin_cache_s  rie_skin_cache_t;
 typedef struct rie_xcb_s       rie_xcb_t;
 typedef struct rie_gfx_s       rie_gfx_t;
 typedef struct rie_s           rie_t;
@@ -48,7 +51,9 @@ typedef struct rie_s           rie_t;
 #include "rie_util.h"
 #include "rie_log.h"
 #include "rie_gfx.h"
+#include "rie_icon.h"
 #include "rie_window.h"
+#include "rie_loop.h"
 #include "rie_control.h"
 
 enum rie_rc_e {
@@ -74,6 +79,22 @@ enum rie_desktop_labels_e {
     RIE_DESKTOP_NAME
 };
 
+enum rie_root_modes_e {
+    RIE_ROOT_CLIENT,                        /* copy pixels to client      */
+    RIE_ROOT_SERVER                         /* use root pixmap in place   */
+};
+
+/* parts of the running pager to rebuild if a configuration key changes */
+#define RIE_RELOAD_NONE     0x0000          /* used at startup or runtime */
+#define RIE_RELOAD_LAYOUT   0x0001          /* pager geometry, contents   */
+#define RIE_RELOAD_SKIN     0x0002
+#define RIE_RELOAD_CONTROL  0x0004          /* control socket             */
+#define RIE_RELOAD_HINTS    0x0008          /* window state hints to WM   */
+#define RIE_RELOAD_SUBSET   0x0010          /* shown desktops, RandR      */
+#define RIE_RELOAD_THUMBS   0x0020          /* windows redirection        */
+#define RIE_RELOAD_ROOT     0x0040          /* root background source     */
+#define RIE_RELOAD_ICONS    0x0080          /* icon cache budget          */
+
 typedef enum {
     RIE_TILE_MODE_FAIR_EAST,
     RIE_TILE_MODE_FAIR_WEST,
@@ -127,6 +148,7 @@ struct rie_settings_s {
     uint32_t         show_window_icons;
     uint32_t         show_viewports;
     uint32_t         show_minitray;
+    uint32_t         show_thumbnails;
     uint32_t         show_pad;
     uint32_t         pad_position;
     uint32_t         pad_margin;
@@ -168,6 +190,11 @@ struct rie_settings_s {
     uint32_t         sticky;
     uint32_t         layer;
 
+    uint32_t         fps;                   /* frame rate cap, 0 - no limit */
+    uint32_t         icon_cache_size;       /* scaled icons budget, KiB */
+    uint32_t         root_mode;             /* rie_root_modes_e */
+    uint32_t         thumbnail_fps;         /* snapshots per window, 0 - any */
+
     rie_struts_t     struts;
 };
 
@@ -182,6 +209,15 @@ typedef struct {
     uint32_t         lcol;
 } rie_desktop_t;
 
+typedef struct {
+    rie_rect_t       win;                   /* pager window geometry */
+    rie_rect_t       cell;                  /* desktop cell size */
+    uint32_t         nrows;
+    uint32_t         ncols;
+    uint32_t         first;                 /* first visible desktop */
+    uint32_t         ndesktops;
+} rie_layer_key_t;
+
 struct rie_s {
 
     rie_settings_t  *cfg;                   /* configuration */
@@ -191,14 +227,26 @@ struct rie_s {
     rie_gfx_t       *gfx;                   /* graphics context       */
     rie_skin_t      *skin;                  /* loaded skin object     */
     rie_control_t   *ctl;                   /* remote control object  */
+    rie_loop_t      *loop;                  /* event sources, shared      */
+    rie_loop_source_t  *reload_timer;       /* deferred reload, shared    */
+    rie_loop_source_t  *watcher;            /* config/skin files, shared  */
+    rie_icon_cache_t  *icons;               /* decoded icons, shared      */
+    rie_font_ctx_t    *fonts;               /* fontconfig, faces, shared  */
+    rie_skin_cache_t  *assets;              /* skin images, shared        */
 
     rie_rect_t       desktop_geom;          /* full desktop size      */
     rie_image_t      root_bg;               /* root window background */
+    rie_image_t      root_desk[2];          /* root_bg fit into desktop,  */
+                                            /* for other/current desktop  */
+    uint8_t          root_bg_scaled;        /* root_bg is reduced copy    */
     rie_desktop_t    template;
+    rie_image_t      layer;                 /* background, desktops grid */
+    rie_layer_key_t  layer_key;             /* layer was rendered for it */
 
     rie_rect_t       monitor_geom;          /* RandR output geometry */
 
     rie_array_t      windows;               /* of rie_window_t  */
+    rie_array_t      windex;                /* of uint32_t, winid => slot */
     rie_array_t      desktop_names;         /* of char *        */
     rie_array_t      desktops;              /* of rie_desktop_t */
     rie_array_t      workareas;             /* of rie_rect_t    */
@@ -211,6 +259,8 @@ struct rie_s {
     uint32_t         current_desktop;       /* active desktop number       */
     uint32_t         selected_desktop;      /* currently selected by mouse */
     rie_window_t    *fwindow;               /* currently focused window    */
+    uint32_t         active_window;         /* _NET_ACTIVE_WINDOW          */
+    uint32_t         icon_size;             /* window icons are fetched for */
 
     uint32_t         nrows;                 /* current pager geometry */
     uint32_t         ncols;
@@ -226,13 +276,25 @@ struct rie_s {
     uint8_t          resize;                /* 1 if event assumes resizing */
     uint8_t          render;                /* 1 if event assumes rendering */
     uint8_t          exposed;               /* 1 if window was exposed */
+    uint32_t         reload_pending;        /* RIE_CONF_* files to re-read */
+
+    rie_loop_source_t  *frame_timer;        /* frame pacing timer */
+    uint64_t         frame_time;            /* last frame, msec */
+
+    uint8_t          thumbnails;            /* live thumbnails are active */
+    rie_loop_source_t  *thumb_timer;        /* throttled snapshots */
+    uint64_t         thumb_due;             /* earliest throttled, msec */
 
     rie_tile_e       current_tile_mode;
 };
 
-rie_t *rie_pager_new(char *cfile, rie_log_t *log);
+rie_settings_t *rie_settings_new(char *cfile);
+void rie_settings_delete(rie_settings_t *cfg);
+
+rie_t *rie_pager_new(rie_settings_t *cfg, rie_log_t *log);
 void rie_pager_delete(rie_t *pager, int final);
 int rie_pager_init(rie_t *pager, rie_t *oldpager);
+int rie_pager_reconfigure(rie_t *pager, rie_settings_t *cfg, uint32_t force);
 void rie_pager_run_cmd(rie_t *pager, rie_command_t cmd);
 
 #endif